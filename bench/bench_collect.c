@@ -0,0 +1,151 @@
+#define _XOPEN_SOURCE 700
+#include "fixture.h"
+#include "proc.h"
+#include "selfstat.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Collection benchmark
+ *
+ * For every requested size a synthetic procfs tree is created, vtop is
+ * pointed at it and list_processes() is timed over a number of rounds.
+ * Between rounds the tree is churned, untimed, so counters move and some
+ * processes come and go as they would on a real system.
+ */
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-r ROUNDS] [-c PCT] [-t THREADS] [-H] [-u] [-d DIR] [TASKS...]\n"
+            "  -r ROUNDS   timed scans per size (default 10)\n"
+            "  -c PCT      percent of processes replaced between scans (default 5)\n"
+            "  -t THREADS  threads per process (default 1)\n"
+            "  -H          list threads instead of processes\n"
+            "  -u          write unique files instead of hard links\n"
+            "  -d DIR      fixture location (default /tmp/vtop-bench)\n"
+            "  TASKS       tree sizes in tasks (default 1000 10000 100000)\n",
+            prog);
+}
+
+static int run_size(const char *dir, size_t tasks, const struct fixture_opts *base,
+                    int rounds) {
+    struct fixture_opts opt = *base;
+    opt.procs = tasks / opt.threads;
+    if (opt.procs == 0)
+        opt.procs = 1;
+    fixture_remove(dir);
+    if (fixture_create(dir, &opt) != 0) {
+        perror(dir);
+        return -1;
+    }
+    size_t max = opt.procs * opt.threads * 2;
+    struct process_info *buf = malloc(max * sizeof(*buf));
+    double *ms = malloc((size_t)rounds * sizeof(*ms));
+    if (!buf || !ms) {
+        free(buf);
+        free(ms);
+        fixture_remove(dir);
+        return -1;
+    }
+
+    /* the first scan establishes the CPU baseline */
+    list_processes(buf, max);
+    list_processes(buf, max);
+    self_end_refresh();
+
+    unsigned long opens = 0, reads = 0;
+    size_t n = 0;
+    for (int r = 0; r < rounds; r++) {
+        if (fixture_churn(dir, &opt) != 0) {
+            perror(dir);
+            break;
+        }
+        self_end_refresh();
+        double start = now_ms();
+        n = list_processes(buf, max);
+        ms[r] = now_ms() - start;
+        self_end_refresh();
+        opens += self_last()->opens;
+        reads += self_last()->reads;
+    }
+
+    double mean = 0, var = 0;
+    for (int r = 0; r < rounds; r++)
+        mean += ms[r];
+    mean /= rounds;
+    for (int r = 0; r < rounds; r++)
+        var += (ms[r] - mean) * (ms[r] - mean);
+    double sd = rounds > 1 ? sqrt(var / (rounds - 1)) : 0;
+
+    printf("%8zu %8zu %10.3f %8.3f %10.1f %10.1f %10.1f\n", opt.procs * opt.threads,
+           n, mean, sd, n ? mean * 1e6 / n : 0.0, (double)opens / rounds,
+           (double)reads / rounds);
+    fflush(stdout);
+    free(buf);
+    free(ms);
+    return fixture_remove(dir);
+}
+
+int main(int argc, char **argv) {
+    struct fixture_opts opt = { 0, 1, 5.0, 1, 1 };
+    const char *dir = "/tmp/vtop-bench";
+    int rounds = 10;
+    int c;
+    while ((c = getopt(argc, argv, "r:c:t:Hud:h")) != -1) {
+        switch (c) {
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        case 'c':
+            opt.churn = atof(optarg);
+            break;
+        case 't':
+            opt.threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'H':
+            set_thread_mode(1);
+            break;
+        case 'u':
+            opt.link = 0;
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (rounds < 1 || opt.threads == 0 || opt.churn < 0 || opt.churn > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (set_proc_root(dir) != 0) {
+        fprintf(stderr, "%s: path too long\n", dir);
+        return 1;
+    }
+    set_show_idle(1);
+    self_set_enabled(1);
+
+    static const size_t defaults[] = { 1000, 10000, 100000 };
+    size_t nsizes = optind < argc ? (size_t)(argc - optind) : 3;
+    printf("%8s %8s %10s %8s %10s %10s %10s\n", "tasks", "listed", "ms/scan",
+           "sd", "ns/task", "opens", "reads");
+    for (size_t i = 0; i < nsizes; i++) {
+        size_t tasks = optind < argc ? strtoul(argv[optind + (int)i], NULL, 10)
+                                     : defaults[i];
+        if (tasks == 0 || run_size(dir, tasks, &opt, rounds) != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* Reach the static parser and filter of proc.c. */
+#include "../src/proc.c"
+#include "microbench.h"
+
+/*
+ * Microbenchmarks of the collection and sorting hot paths: the stat line
+ * parser, task filtering and every sort comparator at several sizes.
+ */
+
+static const char *const stat_lines[] = {
+    "1234 (bash) S 1200 1234 1234 34816 1250 4194304 5012 21349 0 3 12 4 "
+    "30 21 20 0 1 0 123456 11505664 1323 18446744073709551615 1 1 0 0 0 0 "
+    "65536 3670020 1266777851 0 0 0 17 2 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "88123 (Web Content) R 4410 4410 4410 0 -1 4194560 2251911 0 1512 0 "
+    "918273 88312 0 0 20 0 31 0 7780021 3488858112 145521 "
+    "18446744073709551615 1 1 0 0 0 0 0 16781312 1082195198 0 0 0 17 7 0 0 "
+    "0 0 0 0 0 0 0 0 0 0 0\n",
+    "512 (kworker/3:1-events) I 2 0 0 0 -1 69238880 0 0 0 0 0 1712 0 0 20 "
+    "0 1 0 412 0 0 18446744073709551615 0 0 0 0 0 0 0 2147483647 0 0 0 0 "
+    "17 3 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "7071 ((sd-pam)) S 7070 7070 7070 0 -1 1077936448 50 0 0 0 0 0 0 0 20 0 "
+    "1 0 9912 174485504 1201 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 "
+    "0 17 1 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+};
+#define NLINES (sizeof(stat_lines) / sizeof(stat_lines[0]))
+
+static void bench_parse_stat(void *arg, size_t iters) {
+    (void)arg;
+    struct stat_info st;
+    for (size_t i = 0; i < iters; i++) {
+        parse_stat(stat_lines[i % NLINES], &st);
+        mb_sink += st.utime;
+    }
+}
+
+static const char *const names[] = {
+    "bash", "sshd", "systemd-journald", "postgres: checkpointer", "nginx",
+    "java", "python3", "[kworker/3:1-events]", "containerd-shim-runc-v2",
+    "node", "Web Content", "(sd-pam)", "rsyslogd", "cron", "dbus-daemon",
+    "redis-server"
+};
+static const char *const users[] = { "root", "postgres", "www-data", "alice" };
+#define NNAMES (sizeof(names) / sizeof(names[0]))
+
+static void bench_match_filter(void *arg, size_t iters) {
+    (void)arg;
+    for (size_t i = 0; i < iters; i++)
+        mb_sink += (unsigned long)match_filter((int)(i & 0xffff), names[i % NNAMES],
+                                               users[i & 3], 'S');
+}
+
+static void clear_filters(void) {
+    set_name_filter(NULL);
+    set_user_filter(NULL);
+    set_pid_filter(NULL);
+    set_state_filter(0);
+    set_hide_kthreads(0);
+}
+
+struct sort_arg {
+    int (*cmp)(const void *, const void *);
+    const struct process_info *src;
+    struct process_info *work;
+    size_t n;
+};
+
+static void bench_sort(void *arg, size_t iters) {
+    struct sort_arg *s = arg;
+    for (size_t i = 0; i < iters; i++) {
+        mb_pause();
+        memcpy(s->work, s->src, s->n * sizeof(*s->work));
+        mb_resume();
+        qsort(s->work, s->n, sizeof(*s->work), s->cmp);
+    }
+    mb_sink += (unsigned long)s->work[0].pid;
+}
+
+/* tasks with independent, realistic looking keys */
+static void fill_tasks(struct process_info *p, size_t n) {
+    unsigned int seed = 42;
+    for (size_t i = 0; i < n; i++) {
+        memset(&p[i], 0, sizeof(p[i]));
+        p[i].pid = p[i].tid = (int)(rand_r(&seed) % 4000000);
+        p[i].ppid = 1;
+        snprintf(p[i].user, sizeof(p[i].user), "%s", users[rand_r(&seed) % 4]);
+        snprintf(p[i].name, sizeof(p[i].name), "%s", names[rand_r(&seed) % NNAMES]);
+        /* most tasks are idle */
+        p[i].cpu_usage = rand_r(&seed) % 4 ? 0.0 : (rand_r(&seed) % 10000) / 100.0;
+        p[i].rss_percent = (rand_r(&seed) % 10000) / 1000.0;
+        p[i].vsize = (unsigned long long)(rand_r(&seed) % 1000000) << 12;
+        p[i].cpu_time = (rand_r(&seed) % 1000000) / 100.0;
+        p[i].priority = 20 - (long)(rand_r(&seed) % 3);
+        p[i].start_timestamp = 1.7e9 + rand_r(&seed) % 100000;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (mb_init(argc, argv) != 0)
+        return 1;
+
+    mb_run("parse_stat", bench_parse_stat, NULL);
+
+    clear_filters();
+    mb_run("match_filter/none", bench_match_filter, NULL);
+    set_name_filter("ContAIner");
+    mb_run("match_filter/name", bench_match_filter, NULL);
+    clear_filters();
+    set_pid_filter("1,22,333,4444,5555,6666,7777,8888,9999,10000");
+    mb_run("match_filter/pids", bench_match_filter, NULL);
+    clear_filters();
+    set_user_filter("postgres");
+    set_name_filter("post");
+    mb_run("match_filter/user+name", bench_match_filter, NULL);
+    clear_filters();
+
+    static const struct {
+        const char *name;
+        int (*cmp)(const void *, const void *);
+    } cmps[] = {
+        { "pid", cmp_proc_pid }, { "cpu", cmp_proc_cpu },
+        { "mem", cmp_proc_mem }, { "vsize", cmp_proc_vsize },
+        { "time", cmp_proc_time }, { "priority", cmp_proc_priority },
+        { "user", cmp_proc_user }, { "start", cmp_proc_start }
+    };
+    static const size_t sizes[] = { 100, 1000, 10000 };
+    size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    struct process_info *src = malloc(max * sizeof(*src));
+    struct process_info *work = malloc(max * sizeof(*work));
+    if (!src || !work)
+        return 1;
+    fill_tasks(src, max);
+    set_sort_descending(1);
+    for (size_t c = 0; c < sizeof(cmps) / sizeof(cmps[0]); c++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            char name[64];
+            snprintf(name, sizeof(name), "sort/%s/%zu", cmps[c].name, sizes[s]);
+            struct sort_arg a = { cmps[c].cmp, src, work, sizes[s] };
+            mb_run(name, bench_sort, &a);
+        }
+    }
+    free(src);
+    free(work);
+    return mb_finish();
+}
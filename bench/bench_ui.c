@@ -0,0 +1,138 @@
+/* Reach the static forest and row drawing code of ui.c. */
+#include "../src/ui.c"
+#include "microbench.h"
+
+/*
+ * Microbenchmarks of the interface hot paths: building the forest view
+ * and drawing task rows. Rows are drawn into a headless ncurses screen
+ * whose output goes to a pipe and is never refreshed, so only the work
+ * of formatting cells into the virtual screen is measured.
+ */
+
+struct forest_arg {
+    const struct process_info *src;
+    struct process_info *work;
+    size_t n;
+};
+
+static void bench_forest(void *arg, size_t iters) {
+    struct forest_arg *f = arg;
+    for (size_t i = 0; i < iters; i++) {
+        mb_pause();
+        memcpy(f->work, f->src, f->n * sizeof(*f->work));
+        mb_resume();
+        build_forest(f->work, f->n);
+    }
+    mb_sink += (unsigned long)f->work[f->n - 1].level;
+}
+
+/* every task is a child of the first one */
+static void make_wide(struct process_info *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        memset(&p[i], 0, sizeof(p[i]));
+        p[i].pid = p[i].tid = (int)i + 1;
+        p[i].ppid = i ? 1 : 0;
+    }
+}
+
+/* a single chain, each task the parent of the next */
+static void make_deep(struct process_info *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        memset(&p[i], 0, sizeof(p[i]));
+        p[i].pid = p[i].tid = (int)i + 1;
+        p[i].ppid = (int)i;
+    }
+}
+
+struct draw_arg {
+    const struct process_info *procs;
+    size_t n;
+};
+
+static void bench_draw(void *arg, size_t iters) {
+    struct draw_arg *d = arg;
+    for (size_t i = 0; i < iters; i++)
+        draw_process_row(1 + (int)(i % (size_t)(LINES - 1)), &d->procs[i % d->n]);
+}
+
+static void fill_rows(struct process_info *p, size_t n) {
+    static const char *const cmds[] = {
+        "/usr/lib/postgresql/16/bin/postgres -D /var/lib/postgresql/16/main",
+        "nginx: worker process", "/usr/bin/python3 -m http.server 8080",
+        "[kworker/3:1-events]"
+    };
+    for (size_t i = 0; i < n; i++) {
+        memset(&p[i], 0, sizeof(p[i]));
+        p[i].pid = p[i].tid = 1000 + (int)i * 7;
+        p[i].ppid = 1;
+        snprintf(p[i].user, sizeof(p[i].user), "%s", i & 1 ? "postgres" : "root");
+        snprintf(p[i].cmdline, sizeof(p[i].cmdline), "%s", cmds[i % 4]);
+        snprintf(p[i].name, sizeof(p[i].name), "%.15s", cmds[i % 4]);
+        snprintf(p[i].start_time, sizeof(p[i].start_time), "12:%02zu:%02zu",
+                 i % 60, (i * 7) % 60);
+        p[i].state = "RSSD"[i % 4];
+        p[i].priority = 20;
+        p[i].vsize = (unsigned long long)(i + 1) << 24;
+        p[i].rss = (long)(i * 1000 + 512);
+        p[i].shared = (unsigned long long)i * 200;
+        p[i].rss_percent = (double)(i % 100) / 10.0;
+        p[i].cpu_usage = (double)(i % 37) * 1.3;
+        p[i].cpu_time = (double)i * 12.5;
+        p[i].read_bytes = (unsigned long long)i << 20;
+        p[i].write_bytes = (unsigned long long)i << 16;
+        p[i].cpu = (int)(i % 8);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (mb_init(argc, argv) != 0)
+        return 1;
+
+    static const size_t sizes[] = { 100, 1000, 10000 };
+    size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    struct process_info *src = malloc(max * sizeof(*src));
+    struct process_info *work = malloc(max * sizeof(*work));
+    if (!src || !work)
+        return 1;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char name[64];
+        struct forest_arg f = { src, work, sizes[s] };
+        make_wide(src, sizes[s]);
+        snprintf(name, sizeof(name), "forest/wide/%zu", sizes[s]);
+        mb_run(name, bench_forest, &f);
+        make_deep(src, sizes[s]);
+        snprintf(name, sizeof(name), "forest/deep/%zu", sizes[s]);
+        mb_run(name, bench_forest, &f);
+    }
+
+    int out[2];
+    FILE *in = fopen("/dev/null", "r");
+    if (!in || pipe(out) != 0) {
+        perror("bench_ui");
+        return 1;
+    }
+    FILE *term = fdopen(out[1], "w");
+    const char *type = getenv("TERM");
+    SCREEN *scr = newterm(type && *type ? type : "xterm", term, in);
+    if (!scr) {
+        fprintf(stderr, "bench_ui: cannot create a terminal\n");
+        return 1;
+    }
+    resizeterm(50, 200);
+    struct draw_arg d = { src, 64 };
+    fill_rows(src, d.n);
+    mb_run("draw_process_row/default", bench_draw, &d);
+    show_forest = 1;
+    mb_run("draw_process_row/forest", bench_draw, &d);
+    show_forest = 0;
+    show_full_cmd = 1;
+    for (int i = 0; i < COL_COUNT; i++)
+        columns[i].enabled = 1;
+    mb_run("draw_process_row/all", bench_draw, &d);
+    endwin();
+    delscreen(scr);
+
+    free(src);
+    free(work);
+    return mb_finish();
+}
@@ -0,0 +1,408 @@
+#define _XOPEN_SOURCE 700
+#include "fixture.h"
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* distinct file sets when linking */
+#define POOL_SIZE 256
+#define NCPU 4
+#define FIRST_PID 300
+
+/* a mix of short, long and awkward command names */
+static const char *const comms[] = {
+    "bash", "sshd", "systemd-journal", "postgres", "nginx", "java",
+    "python3", "kworker/3:1-events", "containerd-shim", "node",
+    "Web Content", "(sd-pam)", "rsyslogd", "cron", "dbus-daemon", "redis-server"
+};
+#define NCOMMS (sizeof(comms) / sizeof(comms[0]))
+
+static const char *const args[] = {
+    "--config=/etc/app/config.yaml", "-D", "/var/lib/data", "--verbose",
+    "-Xmx4g", "--port=8080", "worker", "-c", "/etc/nginx/nginx.conf"
+};
+#define NARGS (sizeof(args) / sizeof(args[0]))
+
+/* 4242 has no passwd entry on most systems */
+static const unsigned int uids[] = { 0, 0, 0, 1000, 33, 65534, 4242 };
+#define NUIDS (sizeof(uids) / sizeof(uids[0]))
+
+static unsigned int mix(unsigned int x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Everything about a task follows from its id and the churn round. */
+struct task_desc {
+    unsigned int id;
+    int pid;
+    int tid;
+    int ppid;
+    size_t threads;
+    unsigned int round;
+};
+
+static int write_file(const char *path, const char *data, size_t len) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    size_t n = fwrite(data, 1, len, fp);
+    return fclose(fp) == 0 && n == len ? 0 : -1;
+}
+
+static int gen_stat(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    unsigned long long utime = h % 5000 + (unsigned long long)t->round * (h % 37);
+    unsigned long long stime = h % 900 + (unsigned long long)t->round * (h % 11);
+    unsigned long long start = 1000 + h % 100000;
+    unsigned long long vsize = (unsigned long long)(h % 4096 + 8) << 20;
+    unsigned long long rss = (h % 65536) + 100;
+    return snprintf(buf, size,
+        "%d (%s) %c %d %d %d 0 -1 4194560 %u 0 %u 0 %llu %llu 0 0 20 %d %zu 0 "
+        "%llu %llu %llu 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 "
+        "%u 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+        t->pid, comms[h % NCOMMS], "SSSSRDI"[h % 7], t->ppid, t->pid, t->pid,
+        h % 100000 + t->round * 13, h % 50, utime, stime,
+        (int)(h % 7) - 3 > 0 ? 5 : 0, t->threads, start, vsize, rss,
+        h % NCPU);
+}
+
+static int gen_status(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    unsigned int uid = uids[h % NUIDS];
+    unsigned long long rss = ((h % 65536) + 100) * 4;
+    return snprintf(buf, size,
+        "Name:\t%s\nUmask:\t0022\nState:\t%c (sleeping)\nTgid:\t%d\n"
+        "Ngid:\t0\nPid:\t%d\nPPid:\t%d\nTracerPid:\t0\n"
+        "Uid:\t%u\t%u\t%u\t%u\nGid:\t%u\t%u\t%u\t%u\nFDSize:\t64\n"
+        "Groups:\t%u\nNStgid:\t%d\nNSpid:\t%d\nNSpgid:\t%d\nNSsid:\t%d\n"
+        "VmPeak:\t%8llu kB\nVmSize:\t%8llu kB\nVmLck:\t       0 kB\n"
+        "VmPin:\t       0 kB\nVmHWM:\t%8llu kB\nVmRSS:\t%8llu kB\n"
+        "RssAnon:\t%8llu kB\nRssFile:\t%8llu kB\nRssShmem:\t       0 kB\n"
+        "VmData:\t%8llu kB\nVmStk:\t     132 kB\nVmExe:\t    1024 kB\n"
+        "VmLib:\t    4096 kB\nVmPTE:\t     120 kB\nVmSwap:\t       0 kB\n"
+        "HugetlbPages:\t       0 kB\nCoreDumping:\t0\nTHP_enabled:\t1\n"
+        "Threads:\t%zu\nSigQ:\t0/23456\nSigPnd:\t0000000000000000\n"
+        "ShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\n"
+        "SigIgn:\t0000000000001000\nSigCgt:\t0000000180004a03\n"
+        "CapInh:\t0000000000000000\nCapPrm:\t0000000000000000\n"
+        "CapEff:\t0000000000000000\nCapBnd:\t000001ffffffffff\n"
+        "CapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\n"
+        "Speculation_Store_Bypass:\tthread vulnerable\n"
+        "Cpus_allowed:\tf\nCpus_allowed_list:\t0-3\n"
+        "Mems_allowed:\t00000001\nMems_allowed_list:\t0\n"
+        "voluntary_ctxt_switches:\t%u\nnonvoluntary_ctxt_switches:\t%u\n",
+        comms[h % NCOMMS], "SSSSRDI"[h % 7], t->pid, t->tid, t->ppid,
+        uid, uid, uid, uid, uid, uid, uid, uid, uid, t->pid, t->tid,
+        t->pid, t->pid, rss * 2, rss * 2, rss, rss, rss / 2, rss / 2, rss,
+        t->threads, h % 10000 + t->round * (h % 97),
+        h % 500 + t->round * (h % 5));
+}
+
+static int gen_statm(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    unsigned long long pages = (unsigned long long)(h % 4096 + 8) << 8;
+    unsigned long long rss = (h % 65536) + 100;
+    return snprintf(buf, size, "%llu %llu %llu 256 0 %llu 0\n", pages, rss,
+                    rss / 3, pages / 2);
+}
+
+static int gen_io(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    unsigned long long rd = (unsigned long long)(h % 100000) * 4096 +
+                            (unsigned long long)t->round * (h % 16) * 4096;
+    unsigned long long wr = (unsigned long long)(h % 30000) * 4096 +
+                            (unsigned long long)t->round * (h % 4) * 4096;
+    return snprintf(buf, size,
+        "rchar: %llu\nwchar: %llu\nsyscr: %u\nsyscw: %u\nread_bytes: %llu\n"
+        "write_bytes: %llu\ncancelled_write_bytes: 0\n",
+        rd * 2, wr * 2, h % 90000 + t->round, h % 40000 + t->round, rd, wr);
+}
+
+static int gen_schedstat(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    unsigned long long run = (unsigned long long)(h % 5000) * 10000000ull +
+                             (unsigned long long)t->round * (h % 37) * 10000000ull;
+    unsigned long long wait = run / (h % 9 + 2) +
+                              (unsigned long long)t->round * (h % 7) * 1000000ull;
+    return snprintf(buf, size, "%llu %llu %llu\n", run, wait,
+                    h % 100000 + (unsigned long long)t->round * (h % 13));
+}
+
+static int gen_cmdline(char *buf, size_t size, const struct task_desc *t) {
+    unsigned int h = mix(t->id);
+    int n = snprintf(buf, size, "/usr/bin/%s", comms[h % NCOMMS]);
+    for (unsigned int i = 0; i < h % 5 && n > 0 && (size_t)n < size; i++) {
+        buf[n++] = '\0';
+        int m = snprintf(buf + n, size - (size_t)n, "%s",
+                         args[mix(h + i) % NARGS]);
+        if (m < 0)
+            break;
+        n += m;
+    }
+    if (n > 0 && (size_t)n < size)
+        buf[n++] = '\0';
+    return n;
+}
+
+typedef int (*gen_fn)(char *, size_t, const struct task_desc *);
+
+static const struct {
+    const char *name;
+    gen_fn gen;
+    /* written for every thread, not only per process */
+    int per_thread;
+} files[] = {
+    { "stat", gen_stat, 1 },
+    { "status", gen_status, 1 },
+    { "statm", gen_statm, 0 },
+    { "io", gen_io, 1 },
+    { "schedstat", gen_schedstat, 1 },
+    { "cmdline", gen_cmdline, 0 }
+};
+#define NFILES (sizeof(files) / sizeof(files[0]))
+
+/* Write one file of task t, or link it to the pool variant. */
+static int put_file(const char *dir, const char *path, size_t f,
+                    const struct task_desc *t, const struct fixture_opts *opt) {
+    if (opt->link) {
+        char src[4096];
+        snprintf(src, sizeof(src), "%s/.pool/%s.%u", dir, files[f].name,
+                 t->id % POOL_SIZE);
+        return link(src, path);
+    }
+    char buf[8192];
+    int n = files[f].gen(buf, sizeof(buf), t);
+    if (n < 0 || (size_t)n >= sizeof(buf))
+        return -1;
+    return write_file(path, buf, (size_t)n);
+}
+
+static void describe(struct task_desc *t, const struct fixture_opts *opt,
+                     int pid, int tid, unsigned int round) {
+    t->pid = pid;
+    t->tid = tid;
+    /* a shallow random tree: parents are earlier processes or init */
+    unsigned int h = mix((unsigned int)pid * 7u);
+    t->ppid = pid <= FIRST_PID ? 1 : FIRST_PID + (int)(h % (unsigned int)(pid - FIRST_PID));
+    t->threads = opt->threads;
+    t->round = round;
+    /* linked trees only have POOL_SIZE distinct tasks */
+    t->id = opt->link ? (unsigned int)tid % POOL_SIZE : (unsigned int)tid;
+}
+
+static int create_process(const char *dir, const struct fixture_opts *opt,
+                          int pid, unsigned int round) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%d", dir, pid);
+    if (mkdir(path, 0755) != 0)
+        return -1;
+    struct task_desc t;
+    describe(&t, opt, pid, pid, round);
+    for (size_t f = 0; f < NFILES; f++) {
+        snprintf(path, sizeof(path), "%s/%d/%s", dir, pid, files[f].name);
+        if (put_file(dir, path, f, &t, opt) != 0)
+            return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%d/task", dir, pid);
+    if (mkdir(path, 0755) != 0)
+        return -1;
+    for (size_t i = 0; i < opt->threads; i++) {
+        int tid = pid + (int)i;
+        describe(&t, opt, pid, tid, round);
+        snprintf(path, sizeof(path), "%s/%d/task/%d", dir, pid, tid);
+        if (mkdir(path, 0755) != 0)
+            return -1;
+        for (size_t f = 0; f < NFILES; f++) {
+            if (!files[f].per_thread)
+                continue;
+            snprintf(path, sizeof(path), "%s/%d/task/%d/%s", dir, pid, tid,
+                     files[f].name);
+            if (put_file(dir, path, f, &t, opt) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* (Re)write the pool variants for a round. Variants are rewritten in
+ * place so every link sees the new contents. */
+static int write_pool(const char *dir, unsigned int round,
+                      const struct fixture_opts *opt) {
+    char path[4096];
+    char buf[8192];
+    for (unsigned int v = 0; v < POOL_SIZE; v++) {
+        struct task_desc t;
+        describe(&t, opt, FIRST_PID + (int)v, FIRST_PID + (int)v, round);
+        t.id = v;
+        for (size_t f = 0; f < NFILES; f++) {
+            int n = files[f].gen(buf, sizeof(buf), &t);
+            snprintf(path, sizeof(path), "%s/.pool/%s.%u", dir, files[f].name, v);
+            if (n < 0 || write_file(path, buf, (size_t)n) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_system(const char *dir, unsigned int round, size_t tasks,
+                        int last_pid) {
+    char path[4096];
+    char buf[4096];
+    int n = 0;
+    unsigned long long base = 100000ull + round * 400ull;
+    n += snprintf(buf + n, sizeof(buf) - (size_t)n,
+                  "cpu  %llu 120 %llu %llu 900 0 50 0 0 0\n",
+                  base * NCPU / 4, base * NCPU / 8, base * NCPU * 2);
+    for (int c = 0; c < NCPU; c++)
+        n += snprintf(buf + n, sizeof(buf) - (size_t)n,
+                      "cpu%d %llu 30 %llu %llu 225 0 12 0 0 0\n", c,
+                      base / 4, base / 8, base * 2);
+    n += snprintf(buf + n, sizeof(buf) - (size_t)n,
+                  "intr 123456 0 9 0 0 0 0 0 0\nctxt %llu\nbtime 1700000000\n"
+                  "processes %d\nprocs_running 2\nprocs_blocked 0\n"
+                  "softirq 4567 0 1200 3 400 0 0 10 1500 0 1454\n",
+                  base * 20, last_pid);
+    snprintf(path, sizeof(path), "%s/stat", dir);
+    if (write_file(path, buf, (size_t)n) != 0)
+        return -1;
+    n = snprintf(buf, sizeof(buf),
+                 "MemTotal:       32768000 kB\nMemFree:        12000000 kB\n"
+                 "MemAvailable:   24000000 kB\nBuffers:          500000 kB\n"
+                 "Cached:          9000000 kB\nSwapCached:            0 kB\n"
+                 "Active:         10000000 kB\nInactive:        6000000 kB\n"
+                 "SwapTotal:       8388604 kB\nSwapFree:        8000000 kB\n"
+                 "Dirty:              120 kB\nWriteback:             0 kB\n"
+                 "Shmem:           300000 kB\nSlab:            700000 kB\n");
+    snprintf(path, sizeof(path), "%s/meminfo", dir);
+    if (write_file(path, buf, (size_t)n) != 0)
+        return -1;
+    n = snprintf(buf, sizeof(buf), "0.52 0.58 0.59 2/%zu %d\n", tasks, last_pid);
+    snprintf(path, sizeof(path), "%s/loadavg", dir);
+    if (write_file(path, buf, (size_t)n) != 0)
+        return -1;
+    n = snprintf(buf, sizeof(buf), "%.2f %.2f\n", 86400.0 + round,
+                 86400.0 * NCPU * 0.9);
+    snprintf(path, sizeof(path), "%s/uptime", dir);
+    return write_file(path, buf, (size_t)n);
+}
+
+static int save_state(const char *dir, unsigned int round, int next_pid) {
+    char path[4096];
+    char buf[64];
+    snprintf(path, sizeof(path), "%s/.fixture", dir);
+    int n = snprintf(buf, sizeof(buf), "%u %d\n", round, next_pid);
+    return write_file(path, buf, (size_t)n);
+}
+
+static int load_state(const char *dir, unsigned int *round, int *next_pid) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.fixture", dir);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    int ok = fscanf(fp, "%u %d", round, next_pid) == 2;
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+int fixture_create(const char *dir, const struct fixture_opts *opt) {
+    char path[4096];
+    if (opt->threads == 0 || mkdir(dir, 0755) != 0)
+        return -1;
+    if (opt->link) {
+        snprintf(path, sizeof(path), "%s/.pool", dir);
+        if (mkdir(path, 0755) != 0 || write_pool(dir, 0, opt) != 0)
+            return -1;
+    }
+    int pid = FIRST_PID;
+    for (size_t i = 0; i < opt->procs; i++) {
+        if (create_process(dir, opt, pid, 0) != 0)
+            return -1;
+        pid += (int)opt->threads;
+    }
+    if (write_system(dir, 0, opt->procs * opt->threads, pid - 1) != 0)
+        return -1;
+    return save_state(dir, 0, pid);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int fixture_remove(const char *dir) {
+    return nftw(dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+int fixture_churn(const char *dir, const struct fixture_opts *opt) {
+    unsigned int round;
+    int next_pid;
+    if (load_state(dir, &round, &next_pid) != 0)
+        return -1;
+    round++;
+    unsigned int seed = opt->seed + round;
+    DIR *d = opendir(dir);
+    if (!d)
+        return -1;
+    size_t removed = 0;
+    struct dirent *ent;
+    char path[4096];
+    char buf[8192];
+    while ((ent = readdir(d)) != NULL) {
+        char *end;
+        long pid = strtol(ent->d_name, &end, 10);
+        if (*end != '\0' || end == ent->d_name)
+            continue;
+        if ((double)(rand_r(&seed) % 10000) < opt->churn * 100.0) {
+            snprintf(path, sizeof(path), "%s/%ld", dir, pid);
+            fixture_remove(path);
+            removed++;
+            continue;
+        }
+        if (opt->link)
+            continue;
+        /* counters move on for every surviving task */
+        for (size_t i = 0; i < opt->threads; i++) {
+            struct task_desc t;
+            describe(&t, opt, (int)pid, (int)pid + (int)i, round);
+            for (size_t f = 0; f < NFILES; f++) {
+                if (!files[f].per_thread)
+                    continue;
+                if (i == 0) {
+                    snprintf(path, sizeof(path), "%s/%ld/%s", dir, pid,
+                             files[f].name);
+                    int n = files[f].gen(buf, sizeof(buf), &t);
+                    write_file(path, buf, (size_t)n);
+                }
+                snprintf(path, sizeof(path), "%s/%ld/task/%d/%s", dir, pid,
+                         t.tid, files[f].name);
+                int n = files[f].gen(buf, sizeof(buf), &t);
+                write_file(path, buf, (size_t)n);
+            }
+        }
+    }
+    closedir(d);
+    if (opt->link && write_pool(dir, round, opt) != 0)
+        return -1;
+    for (size_t i = 0; i < removed; i++) {
+        if (create_process(dir, opt, next_pid, round) != 0)
+            return -1;
+        next_pid += (int)opt->threads;
+    }
+    if (write_system(dir, round, opt->procs * opt->threads, next_pid - 1) != 0)
+        return -1;
+    return save_state(dir, round, next_pid);
+}
@@ -0,0 +1,36 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <stddef.h>
+
+/*
+ * Synthetic procfs trees
+ *
+ * A fixture directory looks like /proc to vtop: system files at the top
+ * and one directory per process holding stat, status, statm, io,
+ * schedstat, cmdline and a task directory with one entry per thread.
+ * With link set the per-task files are hard links into a pool of
+ * variants kept in DIR/.pool, so trees with 100k tasks stay small.
+ */
+
+struct fixture_opts {
+    /* number of processes */
+    size_t procs;
+    /* threads per process, at least 1 */
+    size_t threads;
+    /* percentage of processes replaced by fixture_churn() */
+    double churn;
+    /* share per-task files through hard links */
+    int link;
+    unsigned int seed;
+};
+
+/* Create the tree in dir, which must not exist yet. Returns 0 on success. */
+int fixture_create(const char *dir, const struct fixture_opts *opt);
+/* Advance CPU and I/O counters and replace opt->churn percent of the
+ * processes with new ones. Returns 0 on success. */
+int fixture_churn(const char *dir, const struct fixture_opts *opt);
+/* Remove a fixture tree. */
+int fixture_remove(const char *dir);
+
+#endif /* FIXTURE_H */
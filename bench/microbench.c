@@ -0,0 +1,204 @@
+#include "microbench.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RESULTS 256
+#define NAME_LEN 64
+
+struct result {
+    char name[NAME_LEN];
+    double ns;
+};
+
+volatile unsigned long mb_sink;
+
+static int samples = 10;
+static double min_sample_ms = 20.0;
+static double threshold = 10.0;
+static const char *filter;
+static const char *baseline_in;
+static const char *baseline_out;
+static int regressions;
+
+static struct result baseline[MAX_RESULTS];
+static size_t baseline_count;
+static struct result results[MAX_RESULTS];
+static size_t result_count;
+
+/* time excluded by mb_pause() in the current sample */
+static uint64_t paused_ns;
+static uint64_t pause_start;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void mb_pause(void) { pause_start = now_ns(); }
+
+void mb_resume(void) { paused_ns += now_ns() - pause_start; }
+
+static size_t load_results(const char *path, struct result *out) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+    size_t n = 0;
+    char line[256];
+    while (n < MAX_RESULTS && fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%63s %lf", out[n].name, &out[n].ns) == 2)
+            n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static const struct result *find(const struct result *r, size_t n,
+                                 const char *name) {
+    for (size_t i = 0; i < n; i++)
+        if (strcmp(r[i].name, name) == 0)
+            return &r[i];
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n SAMPLES] [-m MS] [-f SUBSTR] [-b FILE] [-w FILE] [-t PCT]\n"
+            "  -n SAMPLES  samples per benchmark (default 10)\n"
+            "  -m MS       minimum duration of one sample (default 20)\n"
+            "  -f SUBSTR   only run benchmarks whose name contains SUBSTR\n"
+            "  -b FILE     compare with the baseline in FILE\n"
+            "  -w FILE     store the results as baseline in FILE\n"
+            "  -t PCT      flag runs this much slower than baseline (default 10)\n",
+            prog);
+}
+
+int mb_init(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "n:m:f:b:w:t:h")) != -1) {
+        switch (c) {
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        case 'm':
+            min_sample_ms = atof(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'b':
+            baseline_in = optarg;
+            break;
+        case 'w':
+            baseline_out = optarg;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (samples < 2 || min_sample_ms <= 0 || optind != argc) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (baseline_in) {
+        baseline_count = load_results(baseline_in, baseline);
+        if (baseline_count == 0)
+            fprintf(stderr, "%s: no baseline, nothing to compare\n", baseline_in);
+    }
+    printf("%-32s %12s %10s %6s  %s\n", "benchmark", "ns/op", "sd", "cv%",
+           "vs base");
+    return 0;
+}
+
+/* ns per iteration of one sample */
+static double sample(mb_fn fn, void *arg, size_t iters) {
+    paused_ns = 0;
+    uint64_t start = now_ns();
+    fn(arg, iters);
+    uint64_t total = now_ns() - start;
+    return (double)(total - paused_ns) / (double)iters;
+}
+
+void mb_run(const char *name, mb_fn fn, void *arg) {
+    if (filter && !strstr(name, filter))
+        return;
+    /* grow the iteration count until one sample is long enough */
+    size_t iters = 1;
+    for (;;) {
+        uint64_t start = now_ns();
+        fn(arg, iters);
+        double ms = (double)(now_ns() - start) / 1e6;
+        if (ms >= min_sample_ms || iters >= ((size_t)1 << 30))
+            break;
+        size_t next = ms > 0.01 ? (size_t)((double)iters * min_sample_ms / ms * 1.2) : iters * 10;
+        iters = next > iters ? next : iters * 2;
+    }
+
+    double sum = 0, sq = 0;
+    for (int i = 0; i < samples; i++) {
+        double ns = sample(fn, arg, iters);
+        sum += ns;
+        sq += ns * ns;
+    }
+    double mean = sum / samples;
+    double var = (sq - sum * sum / samples) / (samples - 1);
+    double sd = var > 0 ? sqrt(var) : 0;
+
+    char cmp[32] = "";
+    const struct result *base = find(baseline, baseline_count, name);
+    if (base && base->ns > 0) {
+        double delta = (mean - base->ns) / base->ns * 100.0;
+        /* noisy runs must be slower by more than their own spread */
+        int slow = delta > threshold && mean - 2 * sd > base->ns;
+        snprintf(cmp, sizeof(cmp), "%+.1f%%%s", delta, slow ? " REGRESSION" : "");
+        regressions += slow;
+    }
+    printf("%-32s %12.1f %10.1f %6.1f  %s\n", name, mean, sd,
+           mean > 0 ? sd / mean * 100.0 : 0.0, cmp);
+    fflush(stdout);
+
+    if (result_count < MAX_RESULTS) {
+        snprintf(results[result_count].name, NAME_LEN, "%s", name);
+        results[result_count].ns = mean;
+        result_count++;
+    }
+}
+
+int mb_finish(void) {
+    if (baseline_out) {
+        /* keep entries of other benchmark programs sharing the file */
+        struct result merged[MAX_RESULTS];
+        size_t n = load_results(baseline_out, merged);
+        for (size_t i = 0; i < result_count; i++) {
+            struct result *r = (struct result *)find(merged, n, results[i].name);
+            if (!r && n < MAX_RESULTS)
+                r = &merged[n++];
+            if (r)
+                *r = results[i];
+        }
+        FILE *fp = fopen(baseline_out, "w");
+        if (!fp) {
+            perror(baseline_out);
+            return 1;
+        }
+        fprintf(fp, "# benchmark ns/op\n");
+        for (size_t i = 0; i < n; i++)
+            fprintf(fp, "%s %.1f\n", merged[i].name, merged[i].ns);
+        fclose(fp);
+    }
+    if (regressions)
+        fprintf(stderr, "%d benchmark(s) more than %.0f%% slower than baseline\n",
+                regressions, threshold);
+    return regressions ? 1 : 0;
+}
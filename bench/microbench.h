@@ -0,0 +1,35 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stddef.h>
+
+/*
+ * Microbenchmark harness
+ *
+ * mb_run() calls a benchmark with a growing iteration count until one
+ * sample takes long enough to time reliably, then takes a number of
+ * samples and reports the mean and standard deviation in ns per
+ * iteration. Work that must not be measured, such as restoring an input
+ * array, goes between mb_pause() and mb_resume().
+ *
+ * With -b FILE results are compared with a stored baseline. A benchmark
+ * is flagged when its mean is slower than the threshold and its mean
+ * minus two standard deviations is still above the baseline; -w FILE merges the results into
+ * FILE as the new baseline.
+ */
+
+typedef void (*mb_fn)(void *arg, size_t iters);
+
+/* Parse the harness options; returns -1 on a usage error. */
+int mb_init(int argc, char **argv);
+void mb_run(const char *name, mb_fn fn, void *arg);
+void mb_pause(void);
+void mb_resume(void);
+/* Write the baseline if requested. Returns 1 when a regression was
+ * flagged, 0 otherwise. */
+int mb_finish(void);
+
+/* keeps results alive without the compiler seeing through them */
+extern volatile unsigned long mb_sink;
+
+#endif /* MICROBENCH_H */
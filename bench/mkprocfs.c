@@ -0,0 +1,60 @@
+#define _XOPEN_SOURCE 700
+#include "fixture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Build a synthetic procfs tree, or churn an existing one. */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n PROCS] [-t THREADS] [-c PCT] [-s SEED] [-l] [-u] DIR\n"
+            "  -n PROCS    number of processes (default 1000)\n"
+            "  -t THREADS  threads per process (default 1)\n"
+            "  -c PCT      percent of processes replaced by -u (default 5)\n"
+            "  -s SEED     random seed (default 1)\n"
+            "  -l          hard link per-task files to a shared pool\n"
+            "  -u          churn an existing tree instead of creating one\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    struct fixture_opts opt = { 1000, 1, 5.0, 0, 1 };
+    int update = 0;
+    int c;
+    while ((c = getopt(argc, argv, "n:t:c:s:luh")) != -1) {
+        switch (c) {
+        case 'n':
+            opt.procs = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            opt.threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            opt.churn = atof(optarg);
+            break;
+        case 's':
+            opt.seed = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            opt.link = 1;
+            break;
+        case 'u':
+            update = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1 || opt.threads == 0 || opt.churn < 0 || opt.churn > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *dir = argv[optind];
+    if (update ? fixture_churn(dir, &opt) : fixture_create(dir, &opt)) {
+        perror(dir);
+        return 1;
+    }
+    return 0;
+}
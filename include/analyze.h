@@ -0,0 +1,27 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stddef.h>
+
+enum analyze_key {
+    ANALYZE_BY_CPU,
+    ANALYZE_BY_RSS,
+    ANALYZE_BY_IO
+};
+
+struct analyze_options {
+    /* window bounds as accepted by recording_parse_time(), NULL = open */
+    const char *from;
+    const char *to;
+    /* number of rows per table */
+    size_t top;
+    enum analyze_key by;
+    /* worker threads, 0 = one per online CPU */
+    int jobs;
+};
+
+/* Summarise the top consumers of a recording and print the result.
+ * Returns 0 on success. */
+int run_analyze(const char *path, const struct analyze_options *opt);
+
+#endif /* ANALYZE_H */
@@ -0,0 +1,32 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stddef.h>
+
+/*
+ * CPU budget
+ *
+ * With a budget set, every refresh loop asks budget_next_delay() how long
+ * to wait before the next refresh. It measures the CPU time vtop used
+ * since the previous call with getrusage() and degrades collection in
+ * steps while the refresh would not fit the budget: first the optional
+ * task files are re-read only for a rotating part of the tasks, then not
+ * at all. Whatever still does not fit stretches the interval.
+ */
+
+/* Limit vtop to pct percent of one CPU; 0 removes the limit. Returns 0
+ * on success. */
+int budget_set(double pct);
+double budget_get(void);
+/* Longest interval budget_next_delay() stretches to, by default 60000 ms,
+ * for refresh loops that cannot wait longer. */
+void budget_set_max_delay(unsigned int ms);
+/* Delay before the next refresh given the requested one, in ms. */
+unsigned int budget_next_delay(unsigned int delay_ms);
+/* One line summary of the last cycle: usage, level and interval. */
+void budget_format(char *buf, size_t size);
+
+/* Run vtop under SCHED_IDLE. Returns 0 on success. */
+int budget_sched_idle(void);
+
+#endif /* BUDGET_H */
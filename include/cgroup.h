@@ -0,0 +1,94 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stddef.h>
+#include "proc.h"
+
+/*
+ * cgroup v2 hierarchy
+ *
+ * cgroup_collect() walks the unified hierarchy depth first, children in
+ * name order, and reads cpu.stat, memory.current, memory.stat, io.stat
+ * and the three pressure files of every cgroup: a handful of reads per cgroup instead of
+ * several per task. Rates are deltas against the previous collection.
+ * Values a cgroup does not have, such as memory.current of the root or
+ * io.stat without the io controller, are negative.
+ */
+
+struct cgroup_info {
+    /* Path below the root, "/" for the root itself */
+    char path[256];
+    /* Depth below the root, 0 for the root */
+    int level;
+    /* CPU usage since the previous collection, scaled like task CPU% */
+    double cpu_usage;
+    /* memory.current and the anon and file lines of memory.stat in KB */
+    long long memory;
+    long long anon;
+    long long file;
+    /* Bytes and I/O operations per second summed over all devices */
+    double read_rate;
+    double write_rate;
+    double rios_rate;
+    double wios_rate;
+    /* some avg10 of cpu.pressure, memory.pressure and io.pressure,
+     * negative when missing */
+    double cpu_pressure;
+    double memory_pressure;
+    double io_pressure;
+};
+
+struct cgroup_list {
+    struct cgroup_info *items;
+    size_t count;
+    size_t cap;
+    /* Seconds since the previous collection, 0 on the first */
+    double elapsed;
+};
+
+/* Mount point of the hierarchy. The default is /sys/fs/cgroup, or
+ * /sys/fs/cgroup/unified on hosts that mount v1 controllers there.
+ * Returns 0 on success. */
+int cgroup_set_root(const char *path);
+const char *cgroup_get_root(void);
+
+/* Read every cgroup into list. Returns -1 when there is no v2
+ * hierarchy at the root. */
+int cgroup_collect(struct cgroup_list *list);
+void cgroup_list_free(struct cgroup_list *list);
+
+/* Only list the processes of the cgroup at path (relative to the root)
+ * and its descendants; NULL or "" lists every process again. The
+ * members are re-read by cgroup_apply_filter() before each scan. */
+void cgroup_set_filter(const char *path);
+const char *cgroup_get_filter(void);
+void cgroup_apply_filter(void);
+
+/*
+ * CPU throttling of the tasks' cgroups
+ *
+ * With throttling on, cgroup_throttle_update() maps every process to its
+ * cgroup from /proc/PID/cgroup, once per process (pid and start time),
+ * and reads nr_periods, nr_throttled and throttled_usec from cpu.stat of
+ * those cgroups and their ancestors once per update. A task gets the
+ * figures of the most throttled cgroup on its path to the root, since a
+ * quota on a parent starves the children as well.
+ */
+
+struct cgroup_throttle_summary {
+    /* cgroups with a CPU quota, and those throttled since the last update */
+    size_t limited;
+    size_t throttled;
+    /* the cgroup throttled in the largest share of its periods */
+    char worst[256];
+    double worst_percent;
+    double worst_ms;
+};
+
+void cgroup_set_throttle(int on);
+int cgroup_get_throttle(void);
+/* Fill throttle_percent and throttle_ms of procs. */
+void cgroup_throttle_update(struct process_info *procs, size_t count);
+void cgroup_throttle_summary(struct cgroup_throttle_summary *out);
+
+#endif /* CGROUP_H */
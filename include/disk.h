@@ -0,0 +1,40 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include <stddef.h>
+
+/*
+ * Block device activity from /proc/diskstats
+ *
+ * disk_collect() reads the file once per refresh and turns the counters
+ * of every device into rates against the previous read. Partitions and
+ * loop and RAM disks are left out unless disk_set_all() is on: a
+ * partition counts the same requests as its disk, and a host with many
+ * snaps has dozens of idle loop devices.
+ */
+
+struct disk_info {
+    char name[32];
+    /* Completed requests per second */
+    double read_iops;
+    double write_iops;
+    /* Bytes per second */
+    double read_rate;
+    double write_rate;
+    /* Average milliseconds per request completed in the interval */
+    double await;
+    /* Percentage of the interval the device had requests in flight */
+    double util;
+};
+
+/* Also list partitions and loop and RAM disks. */
+void disk_set_all(int on);
+int disk_get_all(void);
+
+/* Read /proc/diskstats. Returns the number of listed devices, or -1
+ * when the file cannot be read. Rates are 0 on the first read. */
+int disk_collect(void);
+/* The devices of the last disk_collect(), in /proc/diskstats order */
+const struct disk_info *disk_get(size_t *count);
+
+#endif /* DISK_H */
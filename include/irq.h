@@ -0,0 +1,61 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stddef.h>
+
+/*
+ * Interrupts and softirqs per CPU
+ *
+ * irq_collect() reads /proc/softirqs and /proc/interrupts and turns the
+ * per CPU counters of every source into rates against the previous
+ * read. The files are parsed in place with a hand written number scanner
+ * and the counters of a read are kept in one flat array, so a 256 CPU
+ * host with a few hundred interrupt lines costs two reads and one pass
+ * over each file. Only the views that show the tables call it.
+ */
+
+enum irq_kind {
+    IRQ_SOFT,
+    IRQ_HARD,
+    IRQ_KINDS
+};
+
+struct irq_table {
+    /* CPU columns of the file; offline CPUs have none */
+    size_t ncpu;
+    int *cpu_ids;
+    /* Sources: the softirq name, the symbolic interrupt name (LOC, NMI)
+     * or the interrupt number followed by its device */
+    size_t nrows;
+    char (*names)[32];
+    /* Per second rates, nrows rows of ncpu columns */
+    double *rates;
+    /* Sum of each row, and the rows ordered by it, busiest first */
+    double *totals;
+    size_t *order;
+    /* Largest single rate, for scaling */
+    double max;
+};
+
+/* One busy source on one CPU */
+struct irq_hot {
+    enum irq_kind kind;
+    size_t row;
+    size_t col;
+    double rate;
+};
+
+/* Read both files. Returns -1 when neither can be read. */
+int irq_collect(void);
+const struct irq_table *irq_get(enum irq_kind kind);
+/* The n busiest cells over both tables, busiest first. Returns how many
+ * were found. */
+size_t irq_top(struct irq_hot *out, size_t n);
+/* Largest rate among columns [col, col + width) of a row, for drawing
+ * several CPUs in one cell. */
+double irq_cell(const struct irq_table *t, size_t row, size_t col,
+                size_t width);
+/* A heat map character for rate on a log scale up to max, ' ' for 0. */
+char irq_shade(double rate, double max);
+
+#endif /* IRQ_H */
@@ -0,0 +1,37 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+
+/*
+ * Network interface activity from /proc/net/dev
+ *
+ * net_collect() reads the file once per refresh and turns the counters
+ * of every interface into per second rates against the previous read.
+ */
+
+struct net_info {
+    char name[32];
+    /* Bytes and packets per second */
+    double rx_rate;
+    double tx_rate;
+    double rx_packets;
+    double tx_packets;
+    /* Dropped packets and errors per second */
+    double rx_drops;
+    double tx_drops;
+    double rx_errors;
+    double tx_errors;
+};
+
+/* Read /proc/net/dev. Returns the number of interfaces, or -1 when the
+ * file cannot be read. Rates are 0 on the first read. */
+int net_collect(void);
+/* The interfaces of the last net_collect(), in /proc/net/dev order */
+const struct net_info *net_get(size_t *count);
+/* Sum of every interface but loopback, whose traffic never leaves the
+ * host. Returns the number of interfaces summed. */
+size_t net_total(const struct net_info *nets, size_t count,
+                 struct net_info *total);
+
+#endif /* NET_H */
@@ -0,0 +1,28 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stddef.h>
+#include "proc.h"
+
+/*
+ * Hardware counters of the busiest tasks
+ *
+ * With a count set, perfctr_update() keeps one perf_event group per
+ * thread of the top tasks by CPU usage: a task-clock leader with cycles,
+ * instructions and cache misses as members. Groups of tasks that leave
+ * the top set are closed and groups of tasks that enter it are opened,
+ * so a refresh only pays for the changes plus one read per thread. The
+ * hardware members are skipped where the kernel has no PMU for them,
+ * and IPC and MPKI stay unset (negative) when their inputs are missing.
+ */
+
+/* Count the n busiest tasks; 0 closes every group (the default). */
+void perfctr_set_top(size_t n);
+size_t perfctr_get_top(void);
+/* Read the groups and fill ipc and mpki of the tasks in procs. */
+void perfctr_update(struct process_info *procs, size_t count);
+/* "hardware", "partial" or "software" once a group was opened, else
+ * NULL. */
+const char *perfctr_mode(void);
+
+#endif /* PERFCTR_H */
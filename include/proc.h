@@ -2,6 +2,7 @@
 #define PROC_H
 
 #include <stddef.h>
+#include <sys/types.h>
 
 struct cpu_stats {
     unsigned long long user;
@@ -24,6 +25,8 @@ struct cpu_stats {
 };
 
 struct cpu_core_stats {
+    /* N of the cpuN line; offline CPUs have no line */
+    unsigned int id;
     unsigned long long user;
     unsigned long long nice;
     unsigned long long system;
@@ -34,6 +37,23 @@ struct cpu_core_stats {
     unsigned long long steal;
 };
 
+/* Per second rates of /proc/vmstat counters. Page counts are in pages,
+ * scans and steals are split by who reclaimed: kswapd in the background
+ * or allocating tasks directly. */
+struct vm_rates {
+    /* 0 when /proc/vmstat could not be read */
+    int available;
+    double swap_in;
+    double swap_out;
+    double major_faults;
+    double scan_kswapd;
+    double scan_direct;
+    double steal_kswapd;
+    double steal_direct;
+    double alloc_stalls;
+    double oom_kills;
+};
+
 struct mem_stats {
     unsigned long long total;
     unsigned long long free;
@@ -42,6 +62,28 @@ struct mem_stats {
     unsigned long long cached;
     unsigned long long swap_total;
     unsigned long long swap_used;
+    /* read right after meminfo, rates since the previous call */
+    struct vm_rates vm;
+};
+
+/* One resource of /proc/pressure. The avg10 of the some and full lines
+ * are negative when the line is missing; the deltas are the stall
+ * microseconds since the previous read. */
+struct pressure_resource {
+    double some_avg10;
+    double full_avg10;
+    unsigned long long some_total;
+    unsigned long long full_total;
+    double some_delta;
+    double full_delta;
+};
+
+struct pressure_stats {
+    /* 0 when the kernel has no PSI or it is disabled */
+    int available;
+    struct pressure_resource cpu;
+    struct pressure_resource memory;
+    struct pressure_resource io;
 };
 
 struct misc_stats {
@@ -85,10 +127,40 @@ struct process_info {
     double cpu_usage;
     /* Total CPU time in seconds */
     double cpu_time;
+    /* Time spent runnable on a run queue since the last update as a
+     * percentage of the interval, and the average wait per timeslice in
+     * microseconds. Only set with set_wait_stats(). */
+    double wait_percent;
+    double wait_slice;
+    /* Instructions per cycle and cache misses per 1000 instructions
+     * since the last update, negative when not counted (see perfctr.h) */
+    double ipc;
+    double mpki;
+    /* Proportional, unique and proportional swap size in KB from
+     * smaps_rollup, -1 when not read (see smaps.h) */
+    long pss;
+    long uss;
+    long swap_pss;
     /* Bytes read from storage */
     unsigned long long read_bytes;
     /* Bytes written to storage */
     unsigned long long write_bytes;
+    /* Per-second rates since the previous read: storage bytes, read and
+     * write system calls, minor and major page faults */
+    double read_rate;
+    double write_rate;
+    double syscr_rate;
+    double syscw_rate;
+    double minflt_rate;
+    double majflt_rate;
+    /* Voluntary and involuntary context switches per second */
+    double vcsw_rate;
+    double ivcsw_rate;
+    /* Share of CFS bandwidth periods in which the task's cgroup was
+     * throttled and throttled milliseconds per second, negative when the
+     * cgroup has no CPU quota or was not read (see cgroup.h) */
+    double throttle_percent;
+    double throttle_ms;
     /* Process start time as seconds since the epoch */
     double start_timestamp;
     /* Process start time as HH:MM:SS */
@@ -102,10 +174,29 @@ struct process_info {
 int read_cpu_stats(struct cpu_stats *stats);
 size_t get_cpu_core_count(void);
 const struct cpu_core_stats *get_cpu_core_stats(void);
+/* /proc/meminfo and /proc/vmstat */
 int read_mem_stats(struct mem_stats *stats);
 size_t count_processes(void);
 size_t list_processes(struct process_info *buf, size_t max);
 int read_misc_stats(struct misc_stats *stats);
+/* /proc/pressure/{cpu,memory,io}. If the first read finds no PSI
+ * (ENOENT, or EOPNOTSUPP with psi=0 on the kernel command line) the files
+ * are not tried again; other failures leave available 0 for that call. */
+int read_pressure_stats(struct pressure_stats *stats);
+/* Parse the some and full lines of a pressure file into res, leaving
+ * the deltas alone. Returns 0 when a some line was found. */
+int parse_pressure(const char *buf, struct pressure_resource *res);
+/* Only the load averages, uptime and the running and total task counts
+ * of misc_stats, from two small files. The state counts are left alone. */
+int read_load_stats(struct misc_stats *stats);
+
+/* procfs location, "/proc" unless built with -DVTOP_PROC_ROOT=... Returns
+ * 0 on success. */
+int set_proc_root(const char *path);
+const char *get_proc_root(void);
+/* Read the file name below the procfs root whole, into a buffer that
+ * grows as needed and is NUL terminated. Returns the length or -1. */
+ssize_t read_proc_file(const char *name, char **buf, size_t *cap);
 
 /* optional filtering */
 void set_name_filter(const char *substr);
@@ -114,6 +205,12 @@ void set_pid_filter(const char *list);
 const char *get_name_filter(void);
 const char *get_user_filter(void);
 const char *get_pid_filter(void);
+/* Only list tasks whose pid is one of pids, e.g. the members of a
+ * cgroup. NULL turns this off; an empty list hides every task. */
+void set_member_filter(const int *pids, size_t count);
+/* Apply the filters above and the idle setting to an already read task,
+ * for snapshots that did not come from list_processes(). */
+int proc_visible(const struct process_info *p);
 
 /* comparison helpers for sorting */
 int cmp_proc_pid(const void *a, const void *b);
@@ -124,6 +221,12 @@ int cmp_proc_time(const void *a, const void *b);
 int cmp_proc_priority(const void *a, const void *b);
 int cmp_proc_user(const void *a, const void *b);
 int cmp_proc_start(const void *a, const void *b);
+int cmp_proc_wait(const void *a, const void *b);
+int cmp_proc_pss(const void *a, const void *b);
+int cmp_proc_io(const void *a, const void *b);
+int cmp_proc_faults(const void *a, const void *b);
+int cmp_proc_ctxsw(const void *a, const void *b);
+int cmp_proc_throttle(const void *a, const void *b);
 
 /* sort order control */
 void set_sort_descending(int desc);
@@ -137,6 +240,37 @@ int get_thread_mode(void);
 void set_show_idle(int on);
 int get_show_idle(void);
 
+/* Re-read status, statm, io and cmdline of a task only every stride
+ * scans, in turns across tasks, and reuse the previous values otherwise.
+ * stat is always read. 0 reads status once per task and skips the other
+ * files; the I/O and context switch rates are then 0. The default is 1. */
+void set_scan_stride(unsigned int stride);
+unsigned int get_scan_stride(void);
+
+/* Sample tasks whose CPU time did not change for idle scans in a row
+ * after 2, 4, 8... scans instead of every scan, reusing their last
+ * values in between, and read every task each sweep scans. Skipped
+ * tasks are still listed. idle == 0 turns this off (the default). */
+void set_sample_backoff(unsigned int idle, unsigned int sweep);
+unsigned int get_sample_backoff(void);
+
+/* Compute CPU usage from the nanosecond run time in schedstat over
+ * CLOCK_MONOTONIC time instead of from utime/stime ticks. Tasks without
+ * schedstat, and new tasks on their first scan, still use ticks. */
+void set_schedstat_mode(int on);
+int get_schedstat_mode(void);
+
+/* Read the run queue wait time and timeslice count from schedstat to
+ * fill wait_percent and wait_slice. Off by default. */
+void set_wait_stats(int on);
+int get_wait_stats(void);
+
+/* Context switch rates always come from status, which only counts the
+ * main thread of a process. With this on, processes with more than one
+ * thread sum the status files of their threads instead. Off by default. */
+void set_switch_stats(int on);
+int get_switch_stats(void);
+
 /* hide kernel threads */
 void set_hide_kthreads(int on);
 int get_hide_kthreads(void);
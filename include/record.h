@@ -0,0 +1,80 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include "snapshot.h"
+
+/*
+ * Binary recording format
+ *
+ * A recording starts with a fixed header followed by a stream of frames
+ * and ends with a seek index. Every frame holds the system summary and
+ * the task list. Numbers are zigzag varints holding the difference to
+ * the same value in the previous frame; tasks are matched by pid/tid.
+ * Every RECORD_KEYFRAME_INTERVAL frames a keyframe is written that does
+ * not depend on earlier data so replay can seek without decoding the
+ * whole file. Recordings that were cut short (for example by a crash)
+ * have no index and are rescanned when opened.
+ */
+
+#define RECORD_KEYFRAME_INTERVAL 60
+
+/* Start writing snapshots to path. Returns 0 on success. */
+int record_open(const char *path);
+/* Append a snapshot as the next frame. */
+int record_frame(const struct snapshot *s);
+/* Write the seek index and close the file. */
+void record_close(void);
+int record_active(void);
+
+struct recording;
+
+struct recording *recording_open(const char *path);
+void recording_close(struct recording *rec);
+size_t recording_frame_count(const struct recording *rec);
+/* Frame timestamp in seconds since the epoch. */
+double recording_frame_time(const struct recording *rec, size_t idx);
+int recording_is_keyframe(const struct recording *rec, size_t idx);
+/* Clock ticks per second on the recording host. */
+long recording_clk_tck(const struct recording *rec);
+/* Index of the last frame recorded at or before t (0 when t precedes
+ * the first frame). */
+size_t recording_find_time(const struct recording *rec, double t);
+
+/* Parse a time argument: "HH:MM:SS" is a time of day on the date of ref,
+ * "+S"/"-S" is relative to ref, a plain number below 1e9 counts seconds
+ * from the first frame and larger numbers are seconds since the epoch.
+ * Returns 0 on success. */
+int recording_parse_time(const struct recording *rec, const char *arg,
+                         double ref, double *out);
+
+/* Decoding state for walking through a recording. Several cursors can
+ * share one recording. */
+struct replay_cursor {
+    const struct recording *rec;
+    /* index of the frame held in snap, (size_t)-1 when empty */
+    size_t pos;
+    /* decoded frame; tasks are ordered by pid and tid */
+    struct snapshot snap;
+    struct process_info *scratch;
+    size_t scratch_cap;
+};
+
+void replay_cursor_init(struct replay_cursor *c, const struct recording *rec);
+/* Decode frame idx into c->snap. Returns 0 on success. */
+int replay_seek(struct replay_cursor *c, size_t idx);
+void replay_cursor_free(struct replay_cursor *c);
+
+/* Standalone keyframes carry one snapshot in the frame encoding for
+ * consumers other than recordings. */
+void record_field_counts(size_t *sys_n, size_t *task_n);
+/* Encode s into *data, growing it as needed. The tasks of s are sorted by
+ * pid and tid. Returns 0 on success. */
+int record_encode_keyframe(struct snapshot *s, unsigned char **data,
+                           size_t *len, size_t *cap);
+/* Decode a keyframe written with sys_n/task_n fields into c->snap. The
+ * cursor may be initialised without a recording. */
+int record_decode_keyframe(struct replay_cursor *c, const void *data,
+                           size_t len, size_t sys_n, size_t task_n);
+
+#endif /* RECORD_H */
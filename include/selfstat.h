@@ -0,0 +1,86 @@
+#ifndef SELFSTAT_H
+#define SELFSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Self instrumentation
+ *
+ * While enabled, vtop times the phases of every refresh with the
+ * monotonic clock and counts the files it opens and the read() calls it
+ * makes. Code brackets a phase with self_now() and self_add(); both cost
+ * nothing beyond a flag test while instrumentation is off.
+ */
+
+enum self_phase {
+    /* walking /proc directories, excluding the per-task work below */
+    SELF_ENUM,
+    /* open/read/close of /proc files */
+    SELF_READ,
+    /* turning file contents into task fields */
+    SELF_PARSE,
+    /* uid to user name lookups */
+    SELF_USER,
+    SELF_SORT,
+    SELF_FOREST,
+    /* drawing or printing */
+    SELF_RENDER,
+    SELF_PHASE_COUNT
+};
+
+struct self_stats {
+    uint64_t ns[SELF_PHASE_COUNT];
+    unsigned long opens;
+    unsigned long reads;
+    unsigned long tasks;
+};
+
+extern int self_enabled;
+extern struct self_stats self_cur;
+
+static inline uint64_t self_now(void) {
+    if (!self_enabled)
+        return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Charge the time since start (from self_now()) to a phase. */
+static inline void self_add(enum self_phase phase, uint64_t start) {
+    if (start)
+        self_cur.ns[phase] += self_now() - start;
+}
+
+/* Sum of all phase times, to be passed to self_add_excl() later. */
+static inline uint64_t self_mark(void) {
+    uint64_t t = 0;
+    for (int i = 0; i < SELF_PHASE_COUNT; i++)
+        t += self_cur.ns[i];
+    return t;
+}
+
+/* Like self_add() but leaves out time charged to other phases since
+ * mark was taken, for phases that enclose nested ones. */
+static inline void self_add_excl(enum self_phase phase, uint64_t start,
+                                 uint64_t mark) {
+    if (start) {
+        uint64_t nested = self_mark() - mark;
+        self_cur.ns[phase] += self_now() - start - nested;
+    }
+}
+
+static inline void self_count_open(void) { self_cur.opens++; }
+static inline void self_count_read(void) { self_cur.reads++; }
+static inline void self_count_task(void) { self_cur.tasks++; }
+
+void self_set_enabled(int on);
+/* Close the current refresh; its numbers become self_last(). */
+void self_end_refresh(void);
+const struct self_stats *self_last(void);
+/* One line summary of self_last(). */
+void self_format(char *buf, size_t size);
+
+#endif /* SELFSTAT_H */
@@ -0,0 +1,33 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+
+/* labels attached to per-process series */
+#define SERVE_LABEL_PID     0x1
+#define SERVE_LABEL_USER    0x2
+#define SERVE_LABEL_NAME    0x4
+#define SERVE_LABEL_CMDLINE 0x8
+
+struct serve_options {
+    /* HOST:PORT to listen on */
+    const char *addr;
+    /* tasks exported per ranking (CPU and RSS), 0 = none */
+    size_t top;
+    /* SERVE_LABEL_* mask; tasks sharing every label are summed */
+    unsigned int labels;
+    /* label values are cut to this many bytes */
+    size_t label_len;
+    /* upper bound on per-process series of one metric */
+    size_t max_series;
+};
+
+/* Parse a comma separated list of label names into a SERVE_LABEL_* mask.
+ * Returns 0 on success. */
+int serve_parse_labels(const char *list, unsigned int *mask);
+
+/* Collect every delay_ms and serve the last rendered OpenMetrics payload
+ * on /metrics until SIGINT or SIGTERM. Returns 0 on a clean shutdown. */
+int run_serve(unsigned int delay_ms, const struct serve_options *opt);
+
+#endif /* SERVE_H */
@@ -0,0 +1,38 @@
+#ifndef SHARE_H
+#define SHARE_H
+
+#include "snapshot.h"
+
+/*
+ * Snapshot sharing
+ *
+ * "vtop --daemon" collects once per interval and publishes every snapshot
+ * as a record keyframe in a POSIX shared memory segment guarded by a
+ * sequence lock. Readers copy the frame and retry when the sequence
+ * number changed underneath them, so the daemon never waits for viewers.
+ * When shared memory is not available the daemon serves the same frames
+ * on a Unix socket instead.
+ */
+
+#define SHARE_DEFAULT_NAME "vtop"
+
+/* Publish snapshots under name every delay_ms until SIGINT or SIGTERM.
+ * Returns 0 on a clean shutdown. */
+int run_daemon(const char *name, unsigned int delay_ms);
+/* Let the members of group (a name or gid) read the published snapshots,
+ * mode 0640 instead of 0600. Returns -1 for an unknown group. */
+int share_set_group(const char *group);
+/* Let every user read them, mode 0644. */
+void share_set_public(void);
+
+/* Attach to the daemon publishing under name. Fails when there is none or
+ * its last frame is stale. Returns 0 on success. */
+int share_attach(const char *name);
+int share_attached(void);
+void share_detach(void);
+/* Copy the latest published snapshot into s, keeping only the tasks that
+ * pass the local filters and at most max_entries of them. Returns 0 on
+ * success and -1 when the daemon went away. */
+int share_read(struct snapshot *s, size_t max_entries);
+
+#endif /* SHARE_H */
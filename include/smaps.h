@@ -0,0 +1,33 @@
+#ifndef SMAPS_H
+#define SMAPS_H
+
+#include <stddef.h>
+#include "proc.h"
+
+/*
+ * Proportional memory from smaps_rollup
+ *
+ * Reading /proc/PID/smaps_rollup walks every mapping of a process, which
+ * is far too slow for every refresh. Once enabled, a background thread
+ * reads it on its own cadence: the tasks on screen and the largest ones
+ * by RSS first, then the rest, least recently read first, a bounded
+ * number per pass. Refreshes only copy the cached values, so pss, uss
+ * and swap_pss can be up to one interval old, and are -1 until a
+ * process was read.
+ */
+
+/* Read each process at most every interval_ms (default 5000). */
+void smaps_set_interval(unsigned int interval_ms);
+unsigned int smaps_get_interval(void);
+/* Start sampling; the thread starts with the next smaps_update(). */
+void smaps_enable(void);
+int smaps_enabled(void);
+/* Fill pss, uss and swap_pss of procs from the cache and hand the
+ * processes to the thread. */
+void smaps_update(struct process_info *procs, size_t count);
+/* Read these processes first, e.g. the rows on screen. */
+void smaps_prioritize(const struct process_info *procs, size_t count);
+/* Stop the thread and free the cache. */
+void smaps_stop(void);
+
+#endif /* SMAPS_H */
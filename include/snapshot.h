@@ -0,0 +1,58 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "disk.h"
+#include "net.h"
+#include "proc.h"
+
+/* One refresh worth of system and task data. Snapshots are filled either
+ * by the live collector or by decoding a recording, so the batch printer
+ * and the ncurses UI do not care where the data came from. */
+struct snapshot {
+    /* Wall clock time of the sample in seconds since the epoch */
+    double timestamp;
+    struct cpu_stats cpu;
+    struct mem_stats mem;
+    struct misc_stats misc;
+    struct pressure_stats psi;
+    /* Overall busy percentage since the previous sample */
+    double cpu_usage;
+    /* Per-core busy percentages */
+    double *core_usage;
+    /* CPU number of each entry, from the cpuN line of /proc/stat */
+    unsigned int *core_id;
+    size_t core_count;
+    size_t core_cap;
+    /* Block devices from /proc/diskstats */
+    struct disk_info *disks;
+    size_t disk_count;
+    size_t disk_cap;
+    /* Network interfaces from /proc/net/dev */
+    struct net_info *nets;
+    size_t net_count;
+    size_t net_cap;
+    struct process_info *procs;
+    size_t count;
+    size_t proc_cap;
+};
+
+/* Read the current system state from /proc, or from the daemon when
+ * share_attach() succeeded. At most max_entries tasks are kept when
+ * max_entries is non-zero. */
+int snapshot_collect(struct snapshot *s, size_t max_entries);
+/* Read only the system-wide state and no tasks, for views that do not
+ * list them. The task state counts in misc keep their previous values. */
+int snapshot_collect_system(struct snapshot *s);
+
+int snapshot_reserve_procs(struct snapshot *s, size_t n);
+int snapshot_reserve_cores(struct snapshot *s, size_t n);
+int snapshot_reserve_disks(struct snapshot *s, size_t n);
+int snapshot_reserve_nets(struct snapshot *s, size_t n);
+
+/* Deep copy src into dst, growing dst's buffers as needed. */
+int snapshot_copy(struct snapshot *dst, const struct snapshot *src);
+
+void snapshot_free(struct snapshot *s);
+
+#endif /* SNAPSHOT_H */
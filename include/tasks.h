@@ -0,0 +1,122 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stddef.h>
+
+/*
+ * Per-task sample store
+ *
+ * list_processes() keeps the counters of every task it reads here so the
+ * next refresh can turn them into rates. Entries are keyed by pid and tid
+ * and carry the task start time, so a reused pid starts from scratch.
+ * Entries that were not seen during a scan are dropped when the scan
+ * ends, together with any history buffer they own.
+ *
+ * Entries also cache what was last read from the files that are not
+ * re-read on every scan (see set_scan_stride() in proc.h), and the stat
+ * fields of tasks that are sampled less often while idle (see
+ * set_sample_backoff()).
+ */
+struct task_sample {
+    int pid;
+    int tid;
+    /* start time in clock ticks after boot */
+    unsigned long long start;
+    unsigned long long utime;
+    unsigned long long stime;
+    /* schedstat run time, run queue wait and timeslices, and the
+     * CLOCK_MONOTONIC seconds they were read */
+    unsigned long long run_ns;
+    unsigned long long wait_ns;
+    unsigned long long slices;
+    double run_time;
+    /* CLOCK_BOOTTIME seconds of the last io read and the per-second
+     * rates since the one before; io_rate is read plus write */
+    double io_time;
+    float io_rate;
+    float read_rate;
+    float write_rate;
+    float syscr_rate;
+    float syscw_rate;
+    /* minor and major faults at the last stat read, its CLOCK_BOOTTIME
+     * seconds */
+    unsigned long long minflt;
+    unsigned long long majflt;
+    double fault_time;
+    /* voluntary and involuntary context switches at the last status
+     * read, its CLOCK_BOOTTIME seconds and the rates since the one
+     * before */
+    unsigned long long vcsw;
+    unsigned long long ivcsw;
+    double ctxsw_time;
+    float vcsw_rate;
+    float ivcsw_rate;
+    /* set once uid, shared, read/write bytes and cmdline were read */
+    int info_valid;
+    unsigned int uid;
+    unsigned long long shared_kb;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long syscr;
+    unsigned long long syscw;
+    /* owned by the store, NULL when empty */
+    char *cmdline;
+    /* last stat values, valid once stat_valid is set */
+    int stat_valid;
+    char comm[64];
+    char state;
+    int ppid;
+    int processor;
+    long priority;
+    long nice;
+    long rss;
+    unsigned long long vsize;
+    unsigned long long child_time;
+    /* inode and ctime of the task's /proc directory when the cache was
+     * last checked against it */
+    unsigned long long dir_ino;
+    long long dir_ctime;
+    /* consecutive samples without CPU time and the scan of the next one */
+    unsigned int idle_samples;
+    unsigned int next_sample;
+    /* scan in which the task was last seen */
+    unsigned int epoch;
+    /* history slot or -1 */
+    int hist;
+};
+
+enum task_metric {
+    TASK_METRIC_CPU,
+    TASK_METRIC_RSS,
+    TASK_METRIC_IO,
+    TASK_METRIC_COUNT
+};
+
+/* Start a scan. Returns the scan number. */
+unsigned int tasks_begin_scan(void);
+/* Find or create the entry for a task. created is set when the entry is
+ * new or belonged to an earlier task with the same pid/tid. The pointer
+ * is valid until the next call into the store. */
+struct task_sample *tasks_get(int pid, int tid, unsigned long long start,
+                              int *created);
+/* Find the entry of a task without knowing its start time and mark it
+ * seen. Returns NULL when there is none. */
+struct task_sample *tasks_peek(int pid, int tid);
+/* Replace the cached command line of t. */
+void tasks_set_cmdline(struct task_sample *t, const char *cmdline);
+/* Drop the entries that were not seen since tasks_begin_scan(). */
+void tasks_end_scan(void);
+size_t tasks_count(void);
+
+/* Keep the last samples values of each metric for up to max_tasks tasks.
+ * samples == 0 disables the history. Returns 0 on success. */
+int tasks_set_history(size_t samples, size_t max_tasks);
+size_t tasks_history_samples(void);
+/* Append one value per metric to the history of t. */
+void tasks_record(struct task_sample *t, const float values[TASK_METRIC_COUNT]);
+/* Copy up to max values of a metric, oldest first. Returns the number of
+ * values copied. */
+size_t tasks_history(int pid, int tid, enum task_metric metric,
+                     float *out, size_t max);
+
+#endif /* TASKS_H */
@@ -0,0 +1,24 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/*
+ * CPU topology from /sys/devices/system/cpu
+ *
+ * The socket, physical core and NUMA node of a CPU are read from sysfs
+ * the first time the CPU is asked for and kept, so drawing a grid of
+ * hundreds of CPUs costs no file reads after the first refresh.
+ */
+
+struct cpu_topology {
+    /* physical_package_id, -1 when unknown */
+    int package;
+    /* core_id, unique within the package; SMT siblings share it */
+    int core;
+    /* NUMA node, -1 without NUMA */
+    int node;
+};
+
+/* Topology of CPU cpu. Never NULL; unknown fields are -1. */
+const struct cpu_topology *topology_get(unsigned int cpu);
+
+#endif /* TOPOLOGY_H */
@@ -11,7 +11,13 @@ enum sort_field {
     SORT_USER,
     SORT_START,
     SORT_TIME,
-    SORT_PRI
+    SORT_PRI,
+    SORT_WAIT,
+    SORT_PSS,
+    SORT_IO,
+    SORT_FAULTS,
+    SORT_CTXSW,
+    SORT_THROTTLE
 };
 
 int run_ui(unsigned int delay_ms, enum sort_field sort,
@@ -34,10 +40,28 @@ const char *mem_unit_suffix(enum mem_unit unit);
 enum mem_unit next_mem_unit(enum mem_unit unit);
 
 #ifdef WITH_UI
+struct recording;
+
 void ui_set_show_full_cmd(int on);
 void ui_set_show_idle(int on);
-void ui_set_show_cores(int on);
+/* Per-core display: 0 off, 1 a grid, 2 a heat map. */
+void ui_set_show_cores(int mode);
+/* Group the per-core display by "none", "socket", "node" or "core".
+ * Returns -1 for any other name. */
+int ui_set_core_group(const char *name);
 void ui_set_hide_kthreads(int on);
+/* Drive the interface from a recording instead of /proc. */
+void ui_set_replay(struct recording *rec);
+void ui_set_show_self_stats(int on);
+/* Start in the cgroup view instead of the task list. */
+void ui_set_show_cgroups(int on);
+/* Start in the interrupt heat map instead of the task list. */
+void ui_set_show_irqs(int on);
+/* Start with the disk panel shown. */
+void ui_set_show_disks(int on);
+/* Network display: 0 off, 1 the summary line, 2 also the interface
+ * panel. */
+void ui_set_show_net(int mode);
 /* Load configuration from ~/.vtoprc if available. The delay and sort
  * parameters are updated with the loaded values. */
 int ui_load_config(unsigned int *delay_ms, enum sort_field *sort);
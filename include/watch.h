@@ -0,0 +1,43 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+
+/*
+ * Watch mode
+ *
+ * "vtop --watch PID[,PID]" samples only the given processes and their
+ * threads every few milliseconds, reading the run time the scheduler
+ * keeps in nanoseconds through file descriptors that stay open. Every
+ * report interval it prints, for each process (and each thread with -H),
+ * the distribution of CPU utilization over the samples: a histogram,
+ * p50, p99, the maximum and the longest stretch spent at 90% or more.
+ */
+
+#define WATCH_MAX_PIDS 16
+
+struct watch_options {
+    int pids[WATCH_MAX_PIDS];
+    size_t pid_count;
+    /* time between samples */
+    unsigned int sample_ms;
+    /* time between reports */
+    unsigned int report_ms;
+    /* reports to print, 0 = until interrupted */
+    unsigned int iterations;
+    /* report threads as well as processes */
+    int threads;
+    /* JSON lines instead of a table */
+    int jsonl;
+    /* also report the network interfaces */
+    int net;
+};
+
+/* Parse a comma separated pid list into opt. Returns 0 on success. */
+int watch_parse_pids(const char *list, struct watch_options *opt);
+
+/* Sample until every watched process exited, the iterations are done or
+ * SIGINT/SIGTERM arrives. Returns 0 on success. */
+int run_watch(const struct watch_options *opt);
+
+#endif /* WATCH_H */
@@ -0,0 +1,450 @@
+#include "analyze.h"
+#include "record.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_JOBS 64
+
+/* Totals for one task identity. Cumulative counters are kept as the
+ * first and last value seen, which lets partial results from different
+ * parts of the recording be merged without double counting. */
+struct task_agg {
+    int used;
+    int pid;
+    int tid;
+    long long start;
+    char user[32];
+    char name[256];
+    long long first_ms;
+    long long last_ms;
+    unsigned long long first_cpu;
+    unsigned long long last_cpu;
+    unsigned long long first_io;
+    unsigned long long last_io;
+    long peak_rss;
+};
+
+/* open addressing table keyed by tid and start time */
+struct agg_table {
+    struct task_agg *slots;
+    size_t cap;
+    size_t count;
+    int failed;
+};
+
+struct worker {
+    const struct recording *rec;
+    size_t begin;
+    size_t end;
+    struct agg_table table;
+    int failed;
+    int started;
+    pthread_t thread;
+};
+
+struct task_result {
+    const struct task_agg *agg;
+    double cpu_secs;
+    unsigned long long io;
+    double life;
+};
+
+struct comm_result {
+    const char *name;
+    size_t tasks;
+    double cpu_secs;
+    unsigned long long io;
+    long peak_rss;
+    long long first_ms;
+    long long last_ms;
+};
+
+static enum analyze_key sort_key;
+
+static size_t hash_id(int tid, long long start) {
+    unsigned long long h = (unsigned long long)(unsigned int)tid * 0x9e3779b97f4a7c15ULL;
+    h ^= (unsigned long long)start + 0x7f4a7c159e3779b9ULL + (h << 6) + (h >> 2);
+    return (size_t)h;
+}
+
+static int table_grow(struct agg_table *t) {
+    size_t cap = t->cap ? t->cap * 2 : 1024;
+    struct task_agg *slots = calloc(cap, sizeof(*slots));
+    if (!slots) {
+        t->failed = 1;
+        return -1;
+    }
+    for (size_t i = 0; i < t->cap; i++) {
+        if (!t->slots[i].used)
+            continue;
+        size_t h = hash_id(t->slots[i].tid, t->slots[i].start) & (cap - 1);
+        while (slots[h].used)
+            h = (h + 1) & (cap - 1);
+        slots[h] = t->slots[i];
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+    return 0;
+}
+
+/* Return the entry for tid/start, inserting an empty one when missing. */
+static struct task_agg *table_get(struct agg_table *t, int tid,
+                                  long long start) {
+    if ((t->count + 1) * 10 > t->cap * 7 && table_grow(t) != 0)
+        return NULL;
+    size_t h = hash_id(tid, start) & (t->cap - 1);
+    while (t->slots[h].used) {
+        if (t->slots[h].tid == tid && t->slots[h].start == start)
+            return &t->slots[h];
+        h = (h + 1) & (t->cap - 1);
+    }
+    t->slots[h].used = 1;
+    t->slots[h].tid = tid;
+    t->slots[h].start = start;
+    t->slots[h].first_ms = -1;
+    t->count++;
+    return &t->slots[h];
+}
+
+static void *analyze_worker(void *arg) {
+    struct worker *w = arg;
+    struct replay_cursor c;
+    replay_cursor_init(&c, w->rec);
+    for (size_t i = w->begin; i < w->end; i++) {
+        if (replay_seek(&c, i) != 0) {
+            w->failed = 1;
+            break;
+        }
+        long long ms = (long long)(c.snap.timestamp * 1000.0 + 0.5);
+        for (size_t j = 0; j < c.snap.count; j++) {
+            const struct process_info *p = &c.snap.procs[j];
+            struct task_agg *a = table_get(&w->table, p->tid,
+                                           (long long)p->start_timestamp);
+            if (!a) {
+                w->failed = 1;
+                break;
+            }
+            unsigned long long cpu = p->utime + p->stime;
+            unsigned long long io = p->read_bytes + p->write_bytes;
+            if (a->first_ms < 0) {
+                a->pid = p->pid;
+                memcpy(a->user, p->user, sizeof(a->user));
+                memcpy(a->name, p->name, sizeof(a->name));
+                a->first_ms = ms;
+                a->first_cpu = cpu;
+                a->first_io = io;
+            }
+            a->last_ms = ms;
+            a->last_cpu = cpu;
+            a->last_io = io;
+            if (p->rss > a->peak_rss)
+                a->peak_rss = p->rss;
+        }
+        if (w->failed)
+            break;
+    }
+    replay_cursor_free(&c);
+    return NULL;
+}
+
+static int merge_table(struct agg_table *dst, const struct agg_table *src) {
+    for (size_t i = 0; i < src->cap; i++) {
+        const struct task_agg *s = &src->slots[i];
+        if (!s->used)
+            continue;
+        struct task_agg *d = table_get(dst, s->tid, s->start);
+        if (!d)
+            return -1;
+        if (d->first_ms < 0) {
+            *d = *s;
+            continue;
+        }
+        if (s->first_ms < d->first_ms) {
+            d->first_ms = s->first_ms;
+            d->first_cpu = s->first_cpu;
+            d->first_io = s->first_io;
+        }
+        if (s->last_ms > d->last_ms) {
+            d->last_ms = s->last_ms;
+            d->last_cpu = s->last_cpu;
+            d->last_io = s->last_io;
+        }
+        if (s->peak_rss > d->peak_rss)
+            d->peak_rss = s->peak_rss;
+    }
+    return 0;
+}
+
+static int cmp_task_result(const void *a, const void *b) {
+    const struct task_result *ra = a;
+    const struct task_result *rb = b;
+    double va, vb;
+    switch (sort_key) {
+    case ANALYZE_BY_RSS:
+        va = (double)ra->agg->peak_rss;
+        vb = (double)rb->agg->peak_rss;
+        break;
+    case ANALYZE_BY_IO:
+        va = (double)ra->io;
+        vb = (double)rb->io;
+        break;
+    case ANALYZE_BY_CPU:
+    default:
+        va = ra->cpu_secs;
+        vb = rb->cpu_secs;
+        break;
+    }
+    if (va < vb)
+        return 1;
+    if (va > vb)
+        return -1;
+    return ra->agg->tid - rb->agg->tid;
+}
+
+static int cmp_result_name(const void *a, const void *b) {
+    const struct task_result *ra = a;
+    const struct task_result *rb = b;
+    return strcmp(ra->agg->name, rb->agg->name);
+}
+
+static int cmp_comm_result(const void *a, const void *b) {
+    const struct comm_result *ca = a;
+    const struct comm_result *cb = b;
+    double va, vb;
+    switch (sort_key) {
+    case ANALYZE_BY_RSS:
+        va = (double)ca->peak_rss;
+        vb = (double)cb->peak_rss;
+        break;
+    case ANALYZE_BY_IO:
+        va = (double)ca->io;
+        vb = (double)cb->io;
+        break;
+    case ANALYZE_BY_CPU:
+    default:
+        va = ca->cpu_secs;
+        vb = cb->cpu_secs;
+        break;
+    }
+    if (va < vb)
+        return 1;
+    if (va > vb)
+        return -1;
+    return strcmp(ca->name, cb->name);
+}
+
+static const char *key_name(enum analyze_key key) {
+    switch (key) {
+    case ANALYZE_BY_RSS: return "rss";
+    case ANALYZE_BY_IO: return "io";
+    case ANALYZE_BY_CPU:
+    default:
+        return "cpu";
+    }
+}
+
+static void format_time(double t, char *buf, size_t size) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    if (localtime_r(&tt, &tm))
+        strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+    else
+        snprintf(buf, size, "%.0f", t);
+}
+
+static void print_results(struct task_result *res, size_t n, size_t top) {
+    const char *unit = mem_unit_suffix(proc_unit);
+    size_t rows = top && top < n ? top : n;
+    qsort(res, n, sizeof(*res), cmp_task_result);
+    printf("Top %zu tasks by %s\n", rows, key_name(sort_key));
+    printf("PID      TID      USER     NAME                         CPU(s)  PEAK RSS(%s)      IO(%s)   LIFE(s) START\n",
+           unit, unit);
+    for (size_t i = 0; i < rows; i++) {
+        const struct task_agg *a = res[i].agg;
+        char start[32];
+        time_t st = (time_t)a->start;
+        struct tm tm;
+        if (localtime_r(&st, &tm))
+            strftime(start, sizeof(start), "%H:%M:%S", &tm);
+        else
+            strcpy(start, "??:??:??");
+        printf("%-8d %-8d %-8s %-25s %9.2f %12.1f %11.1f %9.0f %s\n",
+               a->pid, a->tid, a->user, a->name, res[i].cpu_secs,
+               scale_kb((unsigned long long)a->peak_rss, proc_unit),
+               scale_kb(res[i].io / 1024ULL, proc_unit),
+               res[i].life, start);
+    }
+
+    struct comm_result *comms = calloc(n ? n : 1, sizeof(*comms));
+    if (!comms)
+        return;
+    size_t ncomm = 0;
+    qsort(res, n, sizeof(*res), cmp_result_name);
+    for (size_t i = 0; i < n; i++) {
+        const struct task_agg *a = res[i].agg;
+        if (ncomm == 0 || strcmp(comms[ncomm - 1].name, a->name) != 0) {
+            comms[ncomm].name = a->name;
+            comms[ncomm].first_ms = a->first_ms;
+            comms[ncomm].last_ms = a->last_ms;
+            ncomm++;
+        }
+        struct comm_result *c = &comms[ncomm - 1];
+        c->tasks++;
+        c->cpu_secs += res[i].cpu_secs;
+        c->io += res[i].io;
+        if (a->peak_rss > c->peak_rss)
+            c->peak_rss = a->peak_rss;
+        if (a->first_ms < c->first_ms)
+            c->first_ms = a->first_ms;
+        if (a->last_ms > c->last_ms)
+            c->last_ms = a->last_ms;
+    }
+    qsort(comms, ncomm, sizeof(*comms), cmp_comm_result);
+    rows = top && top < ncomm ? top : ncomm;
+    printf("\nTop %zu commands by %s\n", rows, key_name(sort_key));
+    printf("COMMAND                   TASKS    CPU(s)  PEAK RSS(%s)      IO(%s)   LIFE(s)\n",
+           unit, unit);
+    for (size_t i = 0; i < rows; i++) {
+        printf("%-25s %5zu %9.2f %12.1f %11.1f %9.0f\n",
+               comms[i].name, comms[i].tasks, comms[i].cpu_secs,
+               scale_kb((unsigned long long)comms[i].peak_rss, proc_unit),
+               scale_kb(comms[i].io / 1024ULL, proc_unit),
+               (double)(comms[i].last_ms - comms[i].first_ms) / 1000.0);
+    }
+    free(comms);
+}
+
+int run_analyze(const char *path, const struct analyze_options *opt) {
+    struct recording *rec = recording_open(path);
+    if (!rec) {
+        fprintf(stderr, "vtop: cannot open recording %s\n", path);
+        return 1;
+    }
+    size_t frames = recording_frame_count(rec);
+    if (frames == 0) {
+        fprintf(stderr, "vtop: %s contains no frames\n", path);
+        recording_close(rec);
+        return 1;
+    }
+    double first = recording_frame_time(rec, 0);
+    double from = first;
+    double to = recording_frame_time(rec, frames - 1);
+    if ((opt->from && recording_parse_time(rec, opt->from, first, &from) != 0) ||
+        (opt->to && recording_parse_time(rec, opt->to, first, &to) != 0)) {
+        fprintf(stderr, "vtop: invalid time window\n");
+        recording_close(rec);
+        return 1;
+    }
+    size_t begin = recording_find_time(rec, from);
+    if (recording_frame_time(rec, begin) < from)
+        begin++;
+    size_t end = recording_find_time(rec, to) + 1;
+    if (recording_frame_time(rec, end - 1) > to || begin >= end) {
+        fprintf(stderr, "vtop: no frames between the given times\n");
+        recording_close(rec);
+        return 1;
+    }
+
+    int jobs = opt->jobs;
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+        jobs = 1;
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+    if ((size_t)jobs > end - begin)
+        jobs = (int)(end - begin);
+
+    /* Split the window at keyframes so every worker decodes its own
+     * frames exactly once. */
+    struct worker workers[MAX_JOBS];
+    memset(workers, 0, sizeof(workers));
+    int nworkers = 0;
+    size_t pos = begin;
+    for (int k = 1; k <= jobs && pos < end; k++) {
+        size_t stop = end;
+        if (k < jobs) {
+            stop = begin + (end - begin) * (size_t)k / (size_t)jobs;
+            while (stop < end && !recording_is_keyframe(rec, stop))
+                stop++;
+            if (stop <= pos)
+                continue;
+        }
+        workers[nworkers].rec = rec;
+        workers[nworkers].begin = pos;
+        workers[nworkers].end = stop;
+        nworkers++;
+        pos = stop;
+    }
+    for (int i = 1; i < nworkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, analyze_worker,
+                           &workers[i]) == 0)
+            workers[i].started = 1;
+        else
+            analyze_worker(&workers[i]);
+    }
+    analyze_worker(&workers[0]);
+    int failed = workers[0].failed || workers[0].table.failed;
+    for (int i = 1; i < nworkers; i++) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        failed |= workers[i].failed || workers[i].table.failed;
+        if (!failed && merge_table(&workers[0].table, &workers[i].table) != 0)
+            failed = 1;
+        free(workers[i].table.slots);
+    }
+    if (failed) {
+        fprintf(stderr, "vtop: error while decoding %s\n", path);
+        free(workers[0].table.slots);
+        recording_close(rec);
+        return 1;
+    }
+
+    struct agg_table *t = &workers[0].table;
+    struct task_result *res = calloc(t->count ? t->count : 1, sizeof(*res));
+    if (!res) {
+        free(t->slots);
+        recording_close(rec);
+        return 1;
+    }
+    double win_start = recording_frame_time(rec, begin);
+    double win_end = recording_frame_time(rec, end - 1);
+    long clk_tck = recording_clk_tck(rec);
+    size_t n = 0;
+    for (size_t i = 0; i < t->cap; i++) {
+        const struct task_agg *a = &t->slots[i];
+        if (!a->used)
+            continue;
+        /* tasks born inside the window are charged from zero */
+        int born = (double)a->start >= win_start;
+        unsigned long long cpu = a->last_cpu - (born ? 0 : a->first_cpu);
+        unsigned long long io = a->last_io - (born ? 0 : a->first_io);
+        double since = born ? (double)a->start : (double)a->first_ms / 1000.0;
+        res[n].agg = a;
+        res[n].cpu_secs = (double)cpu / (double)clk_tck;
+        res[n].io = io;
+        res[n].life = (double)a->last_ms / 1000.0 - since;
+        if (res[n].life < 0)
+            res[n].life = 0;
+        n++;
+    }
+
+    char b1[32], b2[32];
+    format_time(win_start, b1, sizeof(b1));
+    format_time(win_end, b2, sizeof(b2));
+    printf("window %s - %s  %.0fs  %zu frames  %zu tasks  %d threads\n\n",
+           b1, b2, win_end - win_start, end - begin, n, nworkers);
+    sort_key = opt->by;
+    print_results(res, n, opt->top);
+
+    free(res);
+    free(t->slots);
+    recording_close(rec);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include "budget.h"
+#include "proc.h"
+#include <sched.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+/* longest interval the budget may stretch to by default */
+#define MAX_STRETCH_MS 60000
+
+/* scan strides of the degradation levels, see set_scan_stride() */
+static const unsigned int level_stride[] = { 1, 4, 16, 0 };
+#define LEVEL_COUNT (sizeof(level_stride) / sizeof(level_stride[0]))
+
+static double budget_pct;
+static unsigned int max_stretch_ms = MAX_STRETCH_MS;
+static int level;
+/* CPU seconds at the previous call, negative before the first */
+static double last_cpu = -1.0;
+static double last_wall;
+static double last_usage;
+static unsigned int last_delay;
+
+int budget_set(double pct) {
+    if (pct < 0.0 || pct > 100.0)
+        return -1;
+    budget_pct = pct;
+    level = 0;
+    last_cpu = -1.0;
+    set_scan_stride(level_stride[0]);
+    return 0;
+}
+
+double budget_get(void) { return budget_pct; }
+
+void budget_set_max_delay(unsigned int ms) { max_stretch_ms = ms; }
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu_seconds(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0.0;
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+unsigned int budget_next_delay(unsigned int delay_ms) {
+    if (budget_pct <= 0.0)
+        return delay_ms;
+    double cpu = cpu_seconds();
+    double wall = wall_seconds();
+    if (last_cpu < 0.0) {
+        last_cpu = cpu;
+        last_wall = wall;
+        last_delay = delay_ms;
+        return delay_ms;
+    }
+    double used_ms = (cpu - last_cpu) * 1000.0;
+    last_usage = wall > last_wall ? (cpu - last_cpu) * 100.0 / (wall - last_wall) : 0.0;
+    last_cpu = cpu;
+    last_wall = wall;
+    /* the interval at which this cycle's work fits the budget */
+    double need_ms = used_ms * 100.0 / budget_pct;
+    /* only a cycle already at the last level stretches the interval; the
+     * others try the next level first */
+    int stretch = level + 1 == (int)LEVEL_COUNT;
+    if (need_ms > delay_ms && level + 1 < (int)LEVEL_COUNT) {
+        level++;
+        set_scan_stride(level_stride[level]);
+    } else if (need_ms < delay_ms * 0.4 && level > 0) {
+        /* the next level up costs more; come back only with room left */
+        level--;
+        set_scan_stride(level_stride[level]);
+    }
+    double ms = stretch && need_ms > delay_ms ? need_ms : delay_ms;
+    if (ms > max_stretch_ms)
+        ms = delay_ms > max_stretch_ms ? delay_ms : max_stretch_ms;
+    last_delay = (unsigned int)ms;
+    return last_delay;
+}
+
+void budget_format(char *buf, size_t size) {
+    if (last_cpu < 0.0) {
+        snprintf(buf, size, "budget %.1f%% measuring", budget_pct);
+        return;
+    }
+    unsigned int stride = level_stride[level];
+    char scan[32];
+    if (stride == 1)
+        snprintf(scan, sizeof(scan), "full");
+    else if (stride == 0)
+        snprintf(scan, sizeof(scan), "stat only");
+    else
+        snprintf(scan, sizeof(scan), "1/%u", stride);
+    snprintf(buf, size, "budget %.1f%% used %.1f%% scan %s interval %.2fs",
+             budget_pct, last_usage, scan, last_delay / 1000.0);
+}
+
+int budget_sched_idle(void) {
+    struct sched_param sp = { 0 };
+    return sched_setscheduler(0, SCHED_IDLE, &sp);
+}
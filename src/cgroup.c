@@ -0,0 +1,626 @@
+#define _GNU_SOURCE
+#include "cgroup.h"
+#include "proc.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* deeper cgroups are not listed */
+#define CGROUP_MAX_LEVEL 32
+
+static char root[PATH_MAX];
+static char filter[256];
+
+/* raw counters of one cgroup, kept sorted by path between collections */
+struct sample {
+    char path[256];
+    unsigned long long usage_usec;
+    unsigned long long rbytes;
+    unsigned long long wbytes;
+    unsigned long long rios;
+    unsigned long long wios;
+    int has_io;
+};
+
+static struct sample *prev;
+static size_t nprev;
+static struct sample *cur;
+static size_t cur_cap;
+static double prev_time;
+
+/* member pids of the filtered subtree */
+static int *members;
+static int no_members;
+static size_t nmembers;
+static size_t members_cap;
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int has_controllers(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", dir);
+    return access(path, R_OK) == 0;
+}
+
+int cgroup_set_root(const char *path) {
+    size_t n = strlen(path);
+    while (n > 1 && path[n - 1] == '/')
+        n--;
+    if (n == 0 || n >= sizeof(root))
+        return -1;
+    memcpy(root, path, n);
+    root[n] = '\0';
+    return 0;
+}
+
+const char *cgroup_get_root(void) {
+    if (!root[0]) {
+        if (!has_controllers("/sys/fs/cgroup") &&
+            has_controllers("/sys/fs/cgroup/unified"))
+            strcpy(root, "/sys/fs/cgroup/unified");
+        else
+            strcpy(root, "/sys/fs/cgroup");
+    }
+    return root;
+}
+
+/* Read a small cgroup file. Returns the length or -1. */
+static ssize_t read_small(const char *dir, const char *name, char *buf,
+                          size_t size) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+        return -1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* The value after "key " at the start of a line of buf. */
+static int stat_field(const char *buf, const char *key,
+                      unsigned long long *out) {
+    size_t len = strlen(key);
+    const char *p = buf;
+    while (p) {
+        if (strncmp(p, key, len) == 0 && p[len] == ' ') {
+            *out = strtoull(p + len + 1, NULL, 10);
+            return 0;
+        }
+        p = strchr(p, '\n');
+        if (p)
+            p++;
+    }
+    return -1;
+}
+
+/* Sum "key=N" over the device lines of io.stat. */
+static unsigned long long io_field(const char *buf, const char *key) {
+    unsigned long long sum = 0;
+    size_t len = strlen(key);
+    for (const char *p = strstr(buf, key); p; p = strstr(p + len, key)) {
+        if ((p == buf || p[-1] == ' ') && p[len] == '=')
+            sum += strtoull(p + len + 1, NULL, 10);
+    }
+    return sum;
+}
+
+static struct cgroup_info *add_item(struct cgroup_list *list) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        struct cgroup_info *items = realloc(list->items, cap * sizeof(*items));
+        if (!items)
+            return NULL;
+        list->items = items;
+        list->cap = cap;
+    }
+    /* the raw counters line up with the items */
+    if (list->count == cur_cap) {
+        size_t cap = cur_cap ? cur_cap * 2 : 64;
+        struct sample *tmp = realloc(cur, cap * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        cur = tmp;
+        cur_cap = cap;
+    }
+    return &list->items[list->count];
+}
+
+static void read_cgroup(struct cgroup_list *list, const char *dir,
+                        const char *rel, int level) {
+    struct cgroup_info *c = add_item(list);
+    if (!c)
+        return;
+    struct sample *s = &cur[list->count];
+    char buf[4096];
+    memset(c, 0, sizeof(*c));
+    memset(s, 0, sizeof(*s));
+    snprintf(c->path, sizeof(c->path), "%s", rel);
+    memcpy(s->path, c->path, sizeof(s->path));
+    c->level = level;
+    c->memory = c->anon = c->file = -1;
+    c->read_rate = c->write_rate = c->rios_rate = c->wios_rate = -1.0;
+    if (read_small(dir, "cpu.stat", buf, sizeof(buf)) >= 0)
+        stat_field(buf, "usage_usec", &s->usage_usec);
+    if (read_small(dir, "memory.current", buf, sizeof(buf)) >= 0)
+        c->memory = (long long)(strtoull(buf, NULL, 10) / 1024);
+    if (read_small(dir, "memory.stat", buf, sizeof(buf)) >= 0) {
+        unsigned long long v;
+        if (stat_field(buf, "anon", &v) == 0)
+            c->anon = (long long)(v / 1024);
+        if (stat_field(buf, "file", &v) == 0)
+            c->file = (long long)(v / 1024);
+    }
+    struct pressure_resource psi;
+    c->cpu_pressure = read_small(dir, "cpu.pressure", buf, sizeof(buf)) >= 0 &&
+                      parse_pressure(buf, &psi) == 0 ? psi.some_avg10 : -1.0;
+    c->memory_pressure = read_small(dir, "memory.pressure", buf,
+                                    sizeof(buf)) >= 0 &&
+                         parse_pressure(buf, &psi) == 0 ? psi.some_avg10 : -1.0;
+    c->io_pressure = read_small(dir, "io.pressure", buf, sizeof(buf)) >= 0 &&
+                     parse_pressure(buf, &psi) == 0 ? psi.some_avg10 : -1.0;
+    if (read_small(dir, "io.stat", buf, sizeof(buf)) >= 0) {
+        s->has_io = 1;
+        s->rbytes = io_field(buf, "rbytes");
+        s->wbytes = io_field(buf, "wbytes");
+        s->rios = io_field(buf, "rios");
+        s->wios = io_field(buf, "wios");
+    }
+    list->count++;
+}
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void walk(struct cgroup_list *list, const char *dir, const char *rel,
+                 int level) {
+    read_cgroup(list, dir, rel, level);
+    if (level >= CGROUP_MAX_LEVEL)
+        return;
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+        if (ent->d_type != DT_DIR) {
+            struct stat st;
+            char path[PATH_MAX];
+            if (ent->d_type != DT_UNKNOWN ||
+                snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >=
+                    (int)sizeof(path) ||
+                stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+                continue;
+        }
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 16;
+            char **tmp = realloc(names, ncap * sizeof(*tmp));
+            if (!tmp)
+                break;
+            names = tmp;
+            cap = ncap;
+        }
+        if ((names[n] = strdup(ent->d_name)) != NULL)
+            n++;
+    }
+    closedir(d);
+    if (n > 1)
+        qsort(names, n, sizeof(*names), cmp_name);
+    for (size_t i = 0; i < n; i++) {
+        char cdir[PATH_MAX];
+        char crel[256];
+        if (snprintf(cdir, sizeof(cdir), "%s/%s", dir, names[i]) <
+                (int)sizeof(cdir) &&
+            snprintf(crel, sizeof(crel), "%s/%s", level ? rel : "",
+                     names[i]) < (int)sizeof(crel))
+            walk(list, cdir, crel, level + 1);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static int cmp_sample(const void *a, const void *b) {
+    return strcmp(((const struct sample *)a)->path,
+                  ((const struct sample *)b)->path);
+}
+
+/* Per-second rate of a counter, 0 when it went backwards. */
+static double rate(unsigned long long now, unsigned long long before,
+                   double span) {
+    return now >= before ? (double)(now - before) / span : 0.0;
+}
+
+int cgroup_collect(struct cgroup_list *list) {
+    const char *dir = cgroup_get_root();
+    list->count = 0;
+    if (!has_controllers(dir))
+        return -1;
+    double now = mono_seconds();
+    walk(list, dir, "/", 0);
+    double span = prev_time > 0.0 ? now - prev_time : 0.0;
+    list->elapsed = span;
+    double scale = 100.0;
+    if (!get_cpu_irix_mode()) {
+        size_t ncpu = get_cpu_core_count();
+        if (ncpu == 0) {
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            ncpu = n > 0 ? (size_t)n : 1;
+        }
+        scale /= (double)ncpu;
+    }
+    for (size_t i = 0; i < list->count; i++) {
+        struct cgroup_info *c = &list->items[i];
+        const struct sample *s = &cur[i];
+        const struct sample *p = span > 0.0 && nprev
+            ? bsearch(s, prev, nprev, sizeof(*prev), cmp_sample) : NULL;
+        if (!p) {
+            if (!s->has_io)
+                continue;
+            c->read_rate = c->write_rate = c->rios_rate = c->wios_rate = 0.0;
+            continue;
+        }
+        c->cpu_usage = rate(s->usage_usec, p->usage_usec, span) / 1e6 * scale;
+        if (s->has_io && p->has_io) {
+            c->read_rate = rate(s->rbytes, p->rbytes, span);
+            c->write_rate = rate(s->wbytes, p->wbytes, span);
+            c->rios_rate = rate(s->rios, p->rios, span);
+            c->wios_rate = rate(s->wios, p->wios, span);
+        }
+    }
+    /* keep this collection's counters, by path, for the next one */
+    struct sample *tmp = realloc(prev, (list->count ? list->count : 1) *
+                                           sizeof(*prev));
+    if (tmp) {
+        prev = tmp;
+        memcpy(prev, cur, list->count * sizeof(*prev));
+        nprev = list->count;
+        qsort(prev, nprev, sizeof(*prev), cmp_sample);
+        prev_time = now;
+    }
+    return 0;
+}
+
+void cgroup_list_free(struct cgroup_list *list) {
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+void cgroup_set_filter(const char *path) {
+    if (path && *path && strcmp(path, "/") != 0) {
+        /* relative to the root with one leading slash */
+        while (*path == '/')
+            path++;
+        snprintf(filter, sizeof(filter), "/%s", path);
+        size_t n = strlen(filter);
+        while (n > 1 && filter[n - 1] == '/')
+            filter[--n] = '\0';
+    } else if (path && *path) {
+        strcpy(filter, "/");
+    } else {
+        filter[0] = '\0';
+        set_member_filter(NULL, 0);
+    }
+}
+
+const char *cgroup_get_filter(void) { return filter; }
+
+static void add_members(const char *dir, int level) {
+    char path[PATH_MAX];
+    FILE *fp = NULL;
+    if (snprintf(path, sizeof(path), "%s/cgroup.procs", dir) <
+        (int)sizeof(path))
+        fp = fopen(path, "re");
+    int pid;
+    while (fp && fscanf(fp, "%d", &pid) == 1) {
+        if (nmembers == members_cap) {
+            size_t cap = members_cap ? members_cap * 2 : 256;
+            int *tmp = realloc(members, cap * sizeof(*tmp));
+            if (!tmp)
+                break;
+            members = tmp;
+            members_cap = cap;
+        }
+        members[nmembers++] = pid;
+    }
+    if (fp)
+        fclose(fp);
+    if (level >= CGROUP_MAX_LEVEL)
+        return;
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' ||
+            (ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN) ||
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >=
+                (int)sizeof(path))
+            continue;
+        struct stat st;
+        if (ent->d_type == DT_UNKNOWN &&
+            (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)))
+            continue;
+        add_members(path, level + 1);
+    }
+    closedir(d);
+}
+
+void cgroup_apply_filter(void) {
+    if (!filter[0])
+        return;
+    char dir[PATH_MAX];
+    nmembers = 0;
+    if (snprintf(dir, sizeof(dir), "%s%s", cgroup_get_root(),
+                 strcmp(filter, "/") == 0 ? "" : filter) < (int)sizeof(dir))
+        add_members(dir, 0);
+    /* an empty cgroup still filters, down to nothing */
+    set_member_filter(members ? members : &no_members, nmembers);
+}
+
+/* ---- throttling ---- */
+
+struct tgroup {
+    char path[256];
+    /* index of the parent, -1 for the root */
+    int parent;
+    int used;
+    /* referenced by a task in this update */
+    int live;
+    int has_quota;
+    int primed;
+    unsigned long long periods;
+    unsigned long long throttled;
+    unsigned long long throttled_usec;
+    double percent;
+    double ms;
+    int active;
+};
+
+/* a process and its cgroup, sorted by pid */
+struct tmember {
+    int pid;
+    double start;
+    int group;
+};
+
+static int throttle_on;
+static struct tgroup *tgroups;
+static size_t ntgroups;
+static struct tmember *tmembers;
+static size_t ntmembers;
+static size_t tmembers_cap;
+static struct tmember *tspare;
+static size_t tspare_cap;
+static double throttle_time;
+static struct cgroup_throttle_summary tsummary;
+
+void cgroup_set_throttle(int on) { throttle_on = on != 0; }
+int cgroup_get_throttle(void) { return throttle_on; }
+
+/* Find or add the group for path and its ancestors. Returns the index
+ * or -1. */
+static int intern_group(const char *path) {
+    int free_slot = -1;
+    for (size_t i = 0; i < ntgroups; i++) {
+        if (!tgroups[i].used) {
+            if (free_slot < 0)
+                free_slot = (int)i;
+        } else if (strcmp(tgroups[i].path, path) == 0) {
+            return (int)i;
+        }
+    }
+    int parent = -1;
+    const char *slash = strrchr(path, '/');
+    if (slash && slash != path) {
+        char up[256];
+        snprintf(up, sizeof(up), "%.*s", (int)(slash - path), path);
+        parent = intern_group(up);
+    } else if (strcmp(path, "/") != 0) {
+        parent = intern_group("/");
+    }
+    /* the parent may have taken the free slot */
+    if (free_slot >= 0 && tgroups[free_slot].used)
+        free_slot = -1;
+    if (free_slot < 0) {
+        struct tgroup *tmp = realloc(tgroups, (ntgroups + 1) * sizeof(*tmp));
+        if (!tmp)
+            return -1;
+        tgroups = tmp;
+        free_slot = (int)ntgroups++;
+    }
+    struct tgroup *g = &tgroups[free_slot];
+    memset(g, 0, sizeof(*g));
+    snprintf(g->path, sizeof(g->path), "%s", path);
+    g->parent = parent;
+    g->used = 1;
+    g->percent = g->ms = -1.0;
+    return free_slot;
+}
+
+/* The cgroup v2 path of a process, from its "0::" line. */
+static int read_task_group(int pid) {
+    char path[512];
+    char buf[4096];
+    snprintf(path, sizeof(path), "%s/%d/cgroup", get_proc_root(), pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    char *line = strncmp(buf, "0::", 3) == 0 ? buf : strstr(buf, "\n0::");
+    if (!line)
+        return -1;
+    line += line == buf ? 3 : 4;
+    line[strcspn(line, "\n")] = '\0';
+    /* a process that exited while being read */
+    if (line[0] != '/')
+        return -1;
+    return intern_group(line);
+}
+
+static void read_group_stat(struct tgroup *g, double span) {
+    char dir[PATH_MAX];
+    char buf[4096];
+    unsigned long long periods, throttled, usec = 0;
+    g->percent = g->ms = -1.0;
+    g->active = 0;
+    snprintf(dir, sizeof(dir), "%s%s", cgroup_get_root(),
+             strcmp(g->path, "/") == 0 ? "" : g->path);
+    /* nr_periods only shows up with the cpu controller */
+    if (read_small(dir, "cpu.stat", buf, sizeof(buf)) < 0 ||
+        stat_field(buf, "nr_periods", &periods) != 0 ||
+        stat_field(buf, "nr_throttled", &throttled) != 0) {
+        g->has_quota = 0;
+        g->primed = 0;
+        return;
+    }
+    stat_field(buf, "throttled_usec", &usec);
+    /* without a quota there are no periods */
+    g->has_quota = periods > 0;
+    if (g->primed && span > 0.0 && periods >= g->periods) {
+        unsigned long long dp = periods - g->periods;
+        unsigned long long dt = throttled >= g->throttled
+                                ? throttled - g->throttled : 0;
+        g->percent = dp ? 100.0 * (double)dt / (double)dp : 0.0;
+        g->ms = rate(usec, g->throttled_usec, span) / 1000.0;
+        g->active = dt > 0;
+    }
+    g->periods = periods;
+    g->throttled = throttled;
+    g->throttled_usec = usec;
+    g->primed = 1;
+}
+
+static int cmp_tmember(const void *a, const void *b) {
+    const struct tmember *ma = a;
+    const struct tmember *mb = b;
+    return (ma->pid > mb->pid) - (ma->pid < mb->pid);
+}
+
+static const struct tmember *find_tmember(int pid) {
+    struct tmember key = { pid, 0.0, -1 };
+    return bsearch(&key, tmembers, ntmembers, sizeof(*tmembers),
+                   cmp_tmember);
+}
+
+void cgroup_throttle_update(struct process_info *procs, size_t count) {
+    if (!throttle_on)
+        return;
+    if (count > tspare_cap) {
+        struct tmember *tmp = realloc(tspare, count * sizeof(*tmp));
+        if (!tmp)
+            return;
+        tspare = tmp;
+        tspare_cap = count;
+    }
+    /* one member per process; threads share their process's cgroup */
+    size_t n = 0;
+    int sorted = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (n > 0 && tspare[n - 1].pid == procs[i].pid)
+            continue;
+        if (n > 0 && tspare[n - 1].pid > procs[i].pid)
+            sorted = 0;
+        tspare[n].pid = procs[i].pid;
+        tspare[n].start = procs[i].start_timestamp;
+        tspare[n].group = -2;
+        n++;
+    }
+    if (!sorted) {
+        qsort(tspare, n, sizeof(*tspare), cmp_tmember);
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (m == 0 || tspare[m - 1].pid != tspare[i].pid)
+                tspare[m++] = tspare[i];
+        }
+        n = m;
+    }
+    /* a process keeps its cgroup, a reused pid is read again */
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        while (j < ntmembers && tmembers[j].pid < tspare[i].pid)
+            j++;
+        if (j < ntmembers && tmembers[j].pid == tspare[i].pid &&
+            tmembers[j].start == tspare[i].start)
+            tspare[i].group = tmembers[j].group;
+    }
+    for (size_t i = 0; i < ntgroups; i++)
+        tgroups[i].live = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (tspare[i].group == -2)
+            tspare[i].group = read_task_group(tspare[i].pid);
+        for (int g = tspare[i].group; g >= 0 && !tgroups[g].live;
+             g = tgroups[g].parent)
+            tgroups[g].live = 1;
+    }
+    struct tmember *old = tmembers;
+    size_t old_cap = tmembers_cap;
+    tmembers = tspare;
+    tmembers_cap = tspare_cap;
+    ntmembers = n;
+    tspare = old;
+    tspare_cap = old_cap;
+
+    double now = mono_seconds();
+    double span = throttle_time > 0.0 ? now - throttle_time : 0.0;
+    throttle_time = now;
+    memset(&tsummary, 0, sizeof(tsummary));
+    for (size_t i = 0; i < ntgroups; i++) {
+        struct tgroup *g = &tgroups[i];
+        if (!g->used)
+            continue;
+        /* no process left below it */
+        if (!g->live) {
+            g->used = 0;
+            continue;
+        }
+        read_group_stat(g, span);
+        if (!g->has_quota)
+            continue;
+        tsummary.limited++;
+        if (g->active)
+            tsummary.throttled++;
+        if (g->percent > tsummary.worst_percent) {
+            tsummary.worst_percent = g->percent;
+            tsummary.worst_ms = g->ms;
+            memcpy(tsummary.worst, g->path, sizeof(tsummary.worst));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        const struct tmember *m = find_tmember(procs[i].pid);
+        procs[i].throttle_percent = -1.0;
+        procs[i].throttle_ms = -1.0;
+        for (int g = m ? m->group : -1; g >= 0; g = tgroups[g].parent) {
+            const struct tgroup *tg = &tgroups[g];
+            if (tg->has_quota && tg->percent > procs[i].throttle_percent) {
+                procs[i].throttle_percent = tg->percent;
+                procs[i].throttle_ms = tg->ms;
+            }
+        }
+    }
+}
+
+void cgroup_throttle_summary(struct cgroup_throttle_summary *out) {
+    *out = tsummary;
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "disk.h"
+#include "proc.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* raw counters of one device, in /proc/diskstats order */
+struct sample {
+    char name[32];
+    unsigned long long reads;
+    unsigned long long read_sectors;
+    unsigned long long read_ms;
+    unsigned long long writes;
+    unsigned long long write_sectors;
+    unsigned long long write_ms;
+    unsigned long long io_ms;
+};
+
+static int all;
+static struct sample *prev;
+static size_t nprev;
+static size_t prev_cap;
+static struct sample *cur;
+static size_t cur_cap;
+static double prev_time;
+static struct disk_info *list;
+static size_t nlist;
+static size_t list_cap;
+static char *buf;
+static size_t buf_cap;
+
+void disk_set_all(int on) { all = on != 0; }
+int disk_get_all(void) { return all; }
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Whether name is a partition of disk, by the kernel's naming: sda1,
+ * but nvme0n1p1 when the disk name ends in a digit. */
+static int is_partition(const char *name, const char *disk) {
+    size_t len = strlen(disk);
+    if (len == 0 || strncmp(name, disk, len) != 0)
+        return 0;
+    const char *p = name + len;
+    if (isdigit((unsigned char)disk[len - 1]) && *p++ != 'p')
+        return 0;
+    if (!isdigit((unsigned char)*p))
+        return 0;
+    while (isdigit((unsigned char)*p))
+        p++;
+    return *p == '\0';
+}
+
+static int is_virtual(const char *name) {
+    return strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0;
+}
+
+static const struct sample *find_prev(const struct sample *s, size_t i) {
+    /* devices rarely come and go, so the same slot usually matches */
+    if (i < nprev && strcmp(prev[i].name, s->name) == 0)
+        return &prev[i];
+    for (size_t j = 0; j < nprev; j++) {
+        if (strcmp(prev[j].name, s->name) == 0)
+            return &prev[j];
+    }
+    return NULL;
+}
+
+static double delta(unsigned long long now, unsigned long long before) {
+    return now >= before ? (double)(now - before) : 0.0;
+}
+
+static void fill_rates(struct disk_info *d, const struct sample *s,
+                       const struct sample *old, double elapsed) {
+    memset(d, 0, sizeof(*d));
+    memcpy(d->name, s->name, sizeof(d->name));
+    if (!old || elapsed <= 0.0)
+        return;
+    double reads = delta(s->reads, old->reads);
+    double writes = delta(s->writes, old->writes);
+    d->read_iops = reads / elapsed;
+    d->write_iops = writes / elapsed;
+    /* diskstats counts 512 byte sectors whatever the device uses */
+    d->read_rate = delta(s->read_sectors, old->read_sectors) * 512.0 / elapsed;
+    d->write_rate = delta(s->write_sectors, old->write_sectors) * 512.0 / elapsed;
+    if (reads + writes > 0.0)
+        d->await = (delta(s->read_ms, old->read_ms) +
+                    delta(s->write_ms, old->write_ms)) / (reads + writes);
+    d->util = delta(s->io_ms, old->io_ms) / (elapsed * 10.0);
+    if (d->util > 100.0)
+        d->util = 100.0;
+}
+
+int disk_collect(void) {
+    nlist = 0;
+    if (read_proc_file("diskstats", &buf, &buf_cap) < 0)
+        return -1;
+    double now = mono_seconds();
+    double elapsed = prev_time > 0.0 ? now - prev_time : 0.0;
+    size_t n = 0;
+    char disk[32] = "";
+    for (char *line = buf; line && *line;) {
+        char *nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+        if (n == cur_cap) {
+            size_t cap = cur_cap ? cur_cap * 2 : 32;
+            struct sample *tmp = realloc(cur, cap * sizeof(*tmp));
+            if (!tmp)
+                break;
+            cur = tmp;
+            cur_cap = cap;
+        }
+        struct sample *s = &cur[n];
+        unsigned int major, minor;
+        unsigned long long merged;
+        if (sscanf(line, "%u %u %31s %llu %llu %llu %llu %llu %llu %llu %llu %*u %llu",
+                   &major, &minor, s->name, &s->reads, &merged,
+                   &s->read_sectors, &s->read_ms, &s->writes, &merged,
+                   &s->write_sectors, &s->write_ms, &s->io_ms) == 12) {
+            /* partitions follow their disk */
+            int part = is_partition(s->name, disk);
+            if (!part)
+                memcpy(disk, s->name, sizeof(disk));
+            if (all || (!part && !is_virtual(s->name))) {
+                if (nlist == list_cap) {
+                    size_t cap = list_cap ? list_cap * 2 : 16;
+                    struct disk_info *tmp = realloc(list, cap * sizeof(*tmp));
+                    if (tmp) {
+                        list = tmp;
+                        list_cap = cap;
+                    }
+                }
+                if (nlist < list_cap)
+                    fill_rates(&list[nlist++], s, find_prev(s, n), elapsed);
+            }
+            n++;
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    struct sample *tmp = prev;
+    size_t tmp_cap = prev_cap;
+    prev = cur;
+    prev_cap = cur_cap;
+    nprev = n;
+    cur = tmp;
+    cur_cap = tmp_cap;
+    prev_time = now;
+    return (int)nlist;
+}
+
+const struct disk_info *disk_get(size_t *count) {
+    *count = nlist;
+    return list;
+}
@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include "irq.h"
+#include "proc.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Both files have a header line of CPU columns and then one line per
+ * source: a label, a colon, one counter per column and, in interrupts,
+ * the chip and device. */
+struct state {
+    const char *file;
+    int hard;
+    struct irq_table t;
+    /* counters of the last two reads, rows of t.ncpu columns */
+    unsigned long long *cur;
+    unsigned long long *prev;
+    size_t cell_cap;
+    char (*prev_names)[32];
+    size_t prev_rows;
+    size_t row_cap;
+    int *prev_cpu_ids;
+    size_t prev_ncpu;
+    size_t cpu_cap;
+    double prev_time;
+    char *buf;
+    size_t buf_cap;
+};
+
+static struct state states[IRQ_KINDS] = {
+    [IRQ_SOFT] = { .file = "softirqs" },
+    [IRQ_HARD] = { .file = "interrupts", .hard = 1 },
+};
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int grow(void *ptr, size_t size) {
+    void **p = ptr;
+    void *tmp = realloc(*p, size);
+    if (!tmp)
+        return -1;
+    *p = tmp;
+    return 0;
+}
+
+static int ensure_cpus(struct state *st, size_t n) {
+    if (n <= st->cpu_cap)
+        return 0;
+    size_t cap = st->cpu_cap ? st->cpu_cap * 2 : 64;
+    while (cap < n)
+        cap *= 2;
+    if (grow(&st->t.cpu_ids, cap * sizeof(int)) < 0 ||
+        grow(&st->prev_cpu_ids, cap * sizeof(int)) < 0)
+        return -1;
+    st->cpu_cap = cap;
+    return 0;
+}
+
+static int ensure_rows(struct state *st, size_t n) {
+    if (n <= st->row_cap)
+        return 0;
+    size_t cap = st->row_cap ? st->row_cap * 2 : 32;
+    while (cap < n)
+        cap *= 2;
+    if (grow(&st->t.names, cap * sizeof(*st->t.names)) < 0 ||
+        grow(&st->prev_names, cap * sizeof(*st->prev_names)) < 0 ||
+        grow(&st->t.totals, cap * sizeof(double)) < 0 ||
+        grow(&st->t.order, cap * sizeof(size_t)) < 0)
+        return -1;
+    st->row_cap = cap;
+    return 0;
+}
+
+static int ensure_cells(struct state *st, size_t n) {
+    if (n <= st->cell_cap)
+        return 0;
+    size_t cap = st->cell_cap ? st->cell_cap * 2 : 4096;
+    while (cap < n)
+        cap *= 2;
+    if (grow(&st->cur, cap * sizeof(unsigned long long)) < 0 ||
+        grow(&st->prev, cap * sizeof(unsigned long long)) < 0 ||
+        grow(&st->t.rates, cap * sizeof(double)) < 0)
+        return -1;
+    st->cell_cap = cap;
+    return 0;
+}
+
+/* "           CPU0       CPU1       CPU4 ..." */
+static size_t parse_header(struct state *st, const char *line) {
+    size_t n = 0;
+    for (const char *p = line; (p = strstr(p, "CPU")) != NULL;) {
+        p += 3;
+        if (ensure_cpus(st, n + 1) < 0)
+            break;
+        int id = 0;
+        while (isdigit((unsigned char)*p))
+            id = id * 10 + (*p++ - '0');
+        st->t.cpu_ids[n++] = id;
+    }
+    return n;
+}
+
+/* n counters into out; NULL when the line has fewer, like the ERR and
+ * MIS totals of interrupts. sscanf would be the bulk of the cost with a
+ * few hundred columns. */
+static const char *parse_counts(const char *p, unsigned long long *out,
+                                size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        while (*p == ' ')
+            p++;
+        if (!isdigit((unsigned char)*p))
+            return NULL;
+        unsigned long long v = 0;
+        while (isdigit((unsigned char)*p))
+            v = v * 10 + (unsigned long long)(*p++ - '0');
+        out[i] = v;
+    }
+    return p;
+}
+
+/* Numbered interrupts are named by the last word of the description,
+ * which is the device ("nvme0q3", "eth0-TxRx-2"). */
+static void name_row(char *name, const char *label, const char *rest,
+                     int hard) {
+    if (!hard || !isdigit((unsigned char)*label)) {
+        snprintf(name, 32, "%s", label);
+        return;
+    }
+    const char *end = rest + strlen(rest);
+    while (end > rest && end[-1] == ' ')
+        end--;
+    const char *dev = end;
+    while (dev > rest && dev[-1] != ' ')
+        dev--;
+    if (dev == end)
+        snprintf(name, 32, "%s", label);
+    else
+        snprintf(name, 32, "%s %.*s", label, (int)(end - dev), dev);
+}
+
+static long find_prev(const struct state *st, const char *name, size_t i) {
+    /* lines only move when an interrupt is requested or freed */
+    if (i < st->prev_rows && strcmp(st->prev_names[i], name) == 0)
+        return (long)i;
+    for (size_t j = 0; j < st->prev_rows; j++) {
+        if (strcmp(st->prev_names[j], name) == 0)
+            return (long)j;
+    }
+    return -1;
+}
+
+static const double *sort_totals;
+
+static int cmp_total(const void *a, const void *b) {
+    double x = sort_totals[*(const size_t *)a];
+    double y = sort_totals[*(const size_t *)b];
+    if (x != y)
+        return x < y ? 1 : -1;
+    return *(const size_t *)a < *(const size_t *)b ? -1 : 1;
+}
+
+static void fill_rates(struct state *st, double elapsed) {
+    struct irq_table *t = &st->t;
+    size_t ncpu = t->ncpu;
+    int same = elapsed > 0.0 && st->prev_ncpu == ncpu &&
+               memcmp(st->prev_cpu_ids, t->cpu_ids, ncpu * sizeof(int)) == 0;
+    double inv = elapsed > 0.0 ? 1.0 / elapsed : 0.0;
+    t->max = 0.0;
+    for (size_t r = 0; r < t->nrows; r++) {
+        double *out = t->rates + r * ncpu;
+        long pr = same ? find_prev(st, t->names[r], r) : -1;
+        double sum = 0.0;
+        if (pr < 0) {
+            memset(out, 0, ncpu * sizeof(double));
+        } else {
+            const unsigned long long *c = st->cur + r * ncpu;
+            const unsigned long long *p = st->prev + (size_t)pr * ncpu;
+            for (size_t i = 0; i < ncpu; i++) {
+                unsigned long long d = c[i] >= p[i] ? c[i] - p[i] : 0;
+                out[i] = (double)d * inv;
+                sum += out[i];
+            }
+            for (size_t i = 0; i < ncpu; i++) {
+                if (out[i] > t->max)
+                    t->max = out[i];
+            }
+        }
+        t->totals[r] = sum;
+        t->order[r] = r;
+    }
+    sort_totals = t->totals;
+    qsort(t->order, t->nrows, sizeof(size_t), cmp_total);
+}
+
+static int collect_one(struct state *st) {
+    struct irq_table *t = &st->t;
+    if (read_proc_file(st->file, &st->buf, &st->buf_cap) < 0) {
+        t->nrows = 0;
+        return -1;
+    }
+    double now = mono_seconds();
+    double elapsed = st->prev_time > 0.0 ? now - st->prev_time : 0.0;
+
+    /* the last read becomes the previous one */
+    unsigned long long *cells = st->prev;
+    st->prev = st->cur;
+    st->cur = cells;
+    char (*names)[32] = st->prev_names;
+    st->prev_names = t->names;
+    t->names = names;
+    int *ids = st->prev_cpu_ids;
+    st->prev_cpu_ids = t->cpu_ids;
+    t->cpu_ids = ids;
+    st->prev_rows = t->nrows;
+    st->prev_ncpu = t->ncpu;
+    t->nrows = 0;
+
+    char *line = st->buf;
+    char *nl = strchr(line, '\n');
+    if (nl)
+        *nl = '\0';
+    t->ncpu = parse_header(st, line);
+    line = nl ? nl + 1 : NULL;
+    while (line && *line && t->ncpu > 0) {
+        nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+        char *label = line;
+        while (*label == ' ')
+            label++;
+        char *colon = strchr(label, ':');
+        line = nl ? nl + 1 : NULL;
+        if (!colon)
+            continue;
+        *colon = '\0';
+        if (strcmp(label, "ERR") == 0 || strcmp(label, "MIS") == 0)
+            continue;
+        size_t r = t->nrows;
+        if (ensure_rows(st, r + 1) < 0 ||
+            ensure_cells(st, (r + 1) * t->ncpu) < 0)
+            break;
+        const char *rest = parse_counts(colon + 1, st->cur + r * t->ncpu,
+                                        t->ncpu);
+        if (!rest)
+            continue;
+        name_row(t->names[r], label, rest, st->hard);
+        t->nrows++;
+    }
+    fill_rates(st, elapsed);
+    st->prev_time = now;
+    return 0;
+}
+
+int irq_collect(void) {
+    int ok = 0;
+    for (int k = 0; k < IRQ_KINDS; k++) {
+        if (collect_one(&states[k]) == 0)
+            ok = 1;
+    }
+    return ok ? 0 : -1;
+}
+
+const struct irq_table *irq_get(enum irq_kind kind) {
+    return &states[kind].t;
+}
+
+size_t irq_top(struct irq_hot *out, size_t n) {
+    size_t found = 0;
+    if (n == 0)
+        return 0;
+    for (int k = 0; k < IRQ_KINDS; k++) {
+        const struct irq_table *t = &states[k].t;
+        size_t cells = t->nrows * t->ncpu;
+        for (size_t i = 0; i < cells; i++) {
+            double rate = t->rates[i];
+            if (rate <= 0.0 || (found == n && rate <= out[n - 1].rate))
+                continue;
+            size_t j = found < n ? found++ : n - 1;
+            while (j > 0 && out[j - 1].rate < rate) {
+                out[j] = out[j - 1];
+                j--;
+            }
+            out[j].kind = (enum irq_kind)k;
+            out[j].row = i / t->ncpu;
+            out[j].col = i % t->ncpu;
+            out[j].rate = rate;
+        }
+    }
+    return found;
+}
+
+double irq_cell(const struct irq_table *t, size_t row, size_t col,
+                size_t width) {
+    const double *r = t->rates + row * t->ncpu;
+    double max = 0.0;
+    for (size_t i = col; i < col + width && i < t->ncpu; i++) {
+        if (r[i] > max)
+            max = r[i];
+    }
+    return max;
+}
+
+char irq_shade(double rate, double max) {
+    static const char levels[] = " .:-=+*#%@";
+    if (rate <= 0.0 || max <= 0.0)
+        return levels[0];
+    /* log scale: a timer tick and a saturated NIC queue differ by orders
+     * of magnitude and both should show */
+    int level = 1 + (int)(log1p(rate) / log1p(max) * 8.0);
+    if (level > 9)
+        level = 9;
+    return levels[level];
+}
@@ -4,14 +4,53 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <signal.h>
 #include "version.h"
 #include "ui.h"
 #include "proc.h"
 #include "control.h"
+#include "snapshot.h"
+#include "perfctr.h"
+#include "smaps.h"
+#include "cgroup.h"
+#include "disk.h"
+#include "net.h"
+#include "irq.h"
+#include "record.h"
+#include "analyze.h"
+#include "tasks.h"
+#include "serve.h"
+#include "share.h"
+#include "selfstat.h"
+#include "budget.h"
+#include "watch.h"
 
 /* maximum number of process entries to display (0 = unlimited) */
 static size_t max_entries;
 
+/* print vtop's own cost after every batch frame */
+static int self_stats;
+
+/* print the cgroup tree instead of tasks */
+static int cgroup_view;
+
+/* print the block devices under the summary */
+static int disk_view;
+
+/* print the network interfaces under the summary */
+static int net_view;
+
+/* print the interrupt heat map instead of tasks */
+static int irq_view;
+
+/* set by SIGINT/SIGTERM so batch and record loops can finish cleanly */
+static volatile sig_atomic_t stop_requested;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
 static enum mem_unit parse_unit(const char *arg) {
     if (!arg || !*arg)
         return MEM_UNIT_K;
@@ -28,10 +67,11 @@ static enum mem_unit parse_unit(const char *arg) {
 }
 
 static void usage(const char *prog) {
-    printf("Usage: %s [-d seconds] [-S] [-a] [-i] [--accum] [-s column] [-E unit] [-e unit] [-b iter] [-n iter] [-m max] [-p pid,...] [-C string] [-u user] [-U user] [-w cols]\n", prog);
+    printf("Usage: %s [-d seconds] [-S] [-a] [-i] [--accum] [-s column] [-E unit] [-e unit] [-b iter] [-n iter] [-m max] [-p pid,...] [-C string] [-u user] [-U user] [-w cols] [--record file] [--replay file] [--analyze file] [--serve addr]\n", prog);
     printf("  -d, --delay SECS   Refresh delay in seconds (default 3)\n");
     printf("  -S, --secure       Disable signaling and renicing tasks\n");
-    printf("  -s, --sort  COL    Sort column: pid,cpu,mem,vsize,user,start,time,pri (default pid)\n");
+    printf("  -s, --sort  COL    Sort column: pid,cpu,mem,vsize,user,start,time,pri,\n"
+           "                    wait,pss,io,faults,ctxsw,throttle (default pid)\n");
     printf("  -E, --scale-summary-mem UNIT  Memory units for summary (k,m,g,t,p,e)\n");
     printf("  -e, --scale-task-mem UNIT     Memory units for processes (k,m,g,t,p,e)\n");
     printf("  -b, --batch ITER   Batch mode iterations (0=loop forever)\n");
@@ -48,21 +88,318 @@ static void usage(const char *prog) {
     printf("      --hide-kthreads Hide kernel threads\n");
     printf("  -H, --threads     Show individual threads instead of processes\n");
     printf("      --irix        Do not scale CPU%% by number of CPUs\n");
+    printf("      --schedstat   Compute CPU%% from schedstat nanoseconds\n");
+    printf("      --wait        Show run queue wait (WAIT%%, AVGWAIT) from schedstat\n");
+    printf("      --ctxsw       Show context switch rates (VCSW/s, IVCSW/s) summed over\n"
+           "                    all threads of a process\n");
+    printf("      --perf N      Count IPC and cache misses (MPKI) of the N busiest tasks\n");
+    printf("      --pss SECS    Read PSS, USS and swap PSS from smaps_rollup every SECS\n"
+           "                    in the background (default 5 with -s pss)\n");
+    printf("      --throttle    Show how often the cgroup of each task was throttled by\n"
+           "                    its CPU quota (THROTTLE%%, THRMS/s)\n");
+    printf("      --cgroups     Show the cgroup v2 tree with CPU, memory and I/O per\n"
+           "                    cgroup instead of tasks\n");
+    printf("      --cgroup PATH Show only the processes of cgroup PATH and below\n");
+    printf("      --cgroup-root DIR  cgroup v2 mount point (default %s)\n",
+           cgroup_get_root());
+    printf("      --disks       Show IOPS, throughput, latency and utilization per disk\n");
+    printf("      --all-disks   Also list partitions and loop and RAM disks\n");
+    printf("      --net         Show traffic, packets, drops and errors per interface\n");
+    printf("      --irq         Show softirqs and interrupts per CPU as a heat map\n"
+           "                    instead of tasks\n");
     printf("      --per-cpu     Show per-core CPU usage\n");
+    printf("      --cpu-group KEY  Group the per-core display by socket, node\n"
+           "                    or core (SMT siblings together)\n");
     printf("      --accum       Include child CPU time in TIME column\n");
+    printf("      --record FILE Write snapshots to a binary recording\n");
+    printf("      --replay FILE Replay a recording instead of reading /proc\n");
+    printf("      --analyze FILE Print the top consumers of a recording\n");
+    printf("      --from TIME   Start of the analysis window\n");
+    printf("      --to TIME     End of the analysis window\n");
+    printf("      --top N       Rows per analysis table (default 20)\n");
+    printf("      --by KEY      Rank analysis by cpu, rss or io (default cpu)\n");
+    printf("      --jobs N      Analysis threads (default one per CPU)\n");
+    printf("      --history N[xT] Keep N samples for up to T tasks (0 disables)\n");
+    printf("      --serve ADDR  Serve OpenMetrics on HOST:PORT/metrics\n");
+    printf("      --metrics-top N  Tasks exported per CPU and RSS ranking (default 10)\n");
+    printf("      --metrics-labels LIST  Task labels: pid,user,name,cmdline\n");
+    printf("      --metrics-max-series N  Cap on exported task series (default 20)\n");
+    printf("      --metrics-label-len N  Truncate label values (default 64)\n");
+    printf("      --self-stats  Show vtop's own per-phase cost and file accesses\n");
+    printf("      --daemon      Collect once and publish snapshots to viewers\n");
+    printf("      --share NAME  Name of the published snapshots (default vtop)\n");
+    printf("      --no-share    Always read /proc even when a daemon runs\n");
+    printf("      --share-group GROUP  Let GROUP read the published snapshots\n");
+    printf("      --share-public  Let every user read the published snapshots\n");
+    printf("      --cpu-budget PCT  Keep vtop's own CPU usage under PCT%% of a CPU\n");
+    printf("      --sched-idle  Run at SCHED_IDLE priority\n");
+    printf("      --adaptive K[/S] Sample tasks idle for K refreshes less often,\n"
+           "                    reading all of them every S refreshes (default 32)\n");
+    printf("      --watch PIDS  Sample these processes every few ms and report\n"
+           "                    utilization percentiles every -d interval\n");
+    printf("      --watch-interval MS  Sample interval of --watch (default 5)\n");
+    printf("      --jsonl       Write JSON lines (watch mode)\n");
+    printf("      --proc-root DIR  Read procfs from DIR instead of %s\n", get_proc_root());
 #ifdef WITH_UI
     printf("      --list-fields  Print column names and exit\n");
 #endif
     printf("  -V, --version     Print vtop version and exit\n");
 }
 
+/* A counter ratio, or "-" when it was not counted */
+static void print_ratio(double v, int width) {
+    if (v < 0.0)
+        printf(" %*s", width, "-");
+    else
+        printf(" %*.2f", width, v);
+}
+
+/* An smaps size in the process unit, or "-" when it was not read */
+static void print_kb(long kb) {
+    if (kb < 0)
+        printf(" %8s", "-");
+    else
+        printf(" %8.1f", scale_kb((unsigned long long)kb, proc_unit));
+}
+
+/* The some and full avg10 of a pressure resource and its stall time in
+ * the last interval */
+static void print_pressure(const char *name, const struct pressure_resource *r) {
+    printf("  %s some %.2f", name, r->some_avg10);
+    if (r->full_avg10 < 0.0)
+        printf(" full -");
+    else
+        printf(" full %.2f", r->full_avg10);
+    printf(" +%.0fms", r->some_delta / 1000.0);
+}
+
+/* A cgroup size in the process unit, or "-" when the file is missing */
+static void print_cgroup_kb(long long kb) {
+    if (kb < 0)
+        printf(" %8s", "-");
+    else
+        printf(" %8.1f", scale_kb((unsigned long long)kb, proc_unit));
+}
+
+static void print_cgroups(const struct cgroup_list *list) {
+    printf("    CPU%%      MEM     ANON     FILE    READ/s  WRITE/s   RIOPS   WIOPS CPUPSI MEMPSI  IOPSI  CGROUP\n");
+    for (size_t i = 0; i < list->count; i++) {
+        const struct cgroup_info *c = &list->items[i];
+        const char *name = c->level ? strrchr(c->path, '/') + 1 : c->path;
+        printf("%8.2f", c->cpu_usage);
+        print_cgroup_kb(c->memory);
+        print_cgroup_kb(c->anon);
+        print_cgroup_kb(c->file);
+        if (c->read_rate < 0.0)
+            printf(" %9s %8s %7s %7s", "-", "-", "-", "-");
+        else
+            printf(" %9.1f %8.1f %7.0f %7.0f",
+                   scale_kb((unsigned long long)(c->read_rate / 1024.0), proc_unit),
+                   scale_kb((unsigned long long)(c->write_rate / 1024.0), proc_unit),
+                   c->rios_rate, c->wios_rate);
+        print_ratio(c->cpu_pressure, 6);
+        print_ratio(c->memory_pressure, 6);
+        print_ratio(c->io_pressure, 6);
+        printf("  %*s%s\n", 2 * c->level, "", name);
+    }
+    fflush(stdout);
+}
+
+static void print_disks(const struct snapshot *s) {
+    printf("%-12s %8s %8s %9s %8s %7s %6s\n", "DEVICE", "R/s", "W/s",
+           "READ/s", "WRITE/s", "AWAIT", "UTIL%");
+    for (size_t i = 0; i < s->disk_count; i++) {
+        const struct disk_info *d = &s->disks[i];
+        printf("%-12s %8.1f %8.1f %9.1f %8.1f %7.2f %6.1f\n", d->name,
+               d->read_iops, d->write_iops,
+               scale_kb((unsigned long long)(d->read_rate / 1024.0), proc_unit),
+               scale_kb((unsigned long long)(d->write_rate / 1024.0), proc_unit),
+               d->await, d->util);
+    }
+}
+
+static void print_nets(const struct snapshot *s) {
+    printf("%-12s %9s %9s %8s %8s %7s %7s %7s %7s\n", "IFACE", "RX/s", "TX/s",
+           "RXPKT/s", "TXPKT/s", "RXDRP/s", "TXDRP/s", "RXERR/s", "TXERR/s");
+    for (size_t i = 0; i < s->net_count; i++) {
+        const struct net_info *n = &s->nets[i];
+        printf("%-12s %9.1f %9.1f %8.0f %8.0f %7.0f %7.0f %7.0f %7.0f\n",
+               n->name,
+               scale_kb((unsigned long long)(n->rx_rate / 1024.0), proc_unit),
+               scale_kb((unsigned long long)(n->tx_rate / 1024.0), proc_unit),
+               n->rx_packets, n->tx_packets, n->rx_drops, n->tx_drops,
+               n->rx_errors, n->tx_errors);
+    }
+}
+
+static void print_irq_table(const struct irq_table *t, enum irq_kind kind,
+                            const char *title, double max) {
+    if (t->nrows == 0)
+        return;
+    printf("%-20s %9s %6s %9s  cpu%d-%d\n", title, "TOTAL/s", "PEAK", "PEAK/s",
+           t->cpu_ids[0], t->cpu_ids[t->ncpu - 1]);
+    for (size_t i = 0; i < t->nrows; i++) {
+        /* softirqs in kernel order, idle interrupts left out */
+        size_t r = kind == IRQ_SOFT ? i : t->order[i];
+        if (kind == IRQ_HARD && t->totals[r] <= 0.0)
+            break;
+        const double *rates = t->rates + r * t->ncpu;
+        size_t peak = 0;
+        for (size_t c = 1; c < t->ncpu; c++) {
+            if (rates[c] > rates[peak])
+                peak = c;
+        }
+        printf("%-20.20s %9.0f %6d %9.0f  ", t->names[r], t->totals[r],
+               t->cpu_ids[peak], rates[peak]);
+        for (size_t c = 0; c < t->ncpu; c++)
+            putchar(irq_shade(rates[c], max));
+        putchar('\n');
+    }
+}
+
+/* One heat map character per CPU on a log scale, " .:-=+*#%@" */
+static void print_irqs(void) {
+    const struct irq_table *soft = irq_get(IRQ_SOFT);
+    const struct irq_table *hard = irq_get(IRQ_HARD);
+    double max = soft->max > hard->max ? soft->max : hard->max;
+    print_irq_table(soft, IRQ_SOFT, "SOFTIRQ", max);
+    print_irq_table(hard, IRQ_HARD, "IRQ", max);
+    struct irq_hot hot[5];
+    size_t nhot = irq_top(hot, 5);
+    if (nhot) {
+        printf("hot");
+        for (size_t i = 0; i < nhot; i++) {
+            const struct irq_table *t = irq_get(hot[i].kind);
+            printf("  %s cpu%d %.0f/s", t->names[hot[i].row],
+                   t->cpu_ids[hot[i].col], hot[i].rate);
+        }
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+static void print_summary(const struct snapshot *s, double interval) {
+    const struct cpu_stats *cs = &s->cpu;
+    const struct mem_stats *ms = &s->mem;
+    const struct misc_stats *misc = &s->misc;
+    double mem_usage = 0.0;
+    if (ms->total > 0)
+        mem_usage = 100.0 * (double)(ms->total - ms->available) /
+                    (double)ms->total;
+    double swap_usage = 0.0;
+    if (ms->swap_total > 0)
+        swap_usage = 100.0 * (double)ms->swap_used / (double)ms->swap_total;
+    double swap_used = scale_kb(ms->swap_used, summary_unit);
+    double swap_total = scale_kb(ms->swap_total, summary_unit);
+    printf("load %.2f %.2f %.2f  up %.0fs  tasks %d total, %d running, %d sleeping, %d stopped, %d zombie  cpu %5.1f%% us %.1f%% sy %.1f%% id %.1f%%  mem %5.1f%%  swap %.0f/%.0f%s %.1f%%  intv %.1fs\n",
+           misc->load1, misc->load5, misc->load15, misc->uptime,
+           misc->total_tasks, misc->running_tasks, misc->sleeping_tasks,
+           misc->stopped_tasks, misc->zombie_tasks,
+           s->cpu_usage, cs->user_percent, cs->system_percent,
+           cs->idle_percent, mem_usage, swap_used, swap_total,
+           mem_unit_suffix(summary_unit), swap_usage, interval);
+    if (s->psi.available) {
+        printf("pressure");
+        print_pressure("cpu", &s->psi.cpu);
+        print_pressure("memory", &s->psi.memory);
+        print_pressure("io", &s->psi.io);
+        putchar('\n');
+    }
+    const struct vm_rates *vm = &ms->vm;
+    if (vm->available)
+        printf("vm swap in %.0f out %.0f pg/s  majflt %.0f/s  scan kswapd %.0f "
+               "direct %.0f pg/s  steal kswapd %.0f direct %.0f pg/s  "
+               "allocstall %.1f/s  oom_kill %.1f/s\n",
+               vm->swap_in, vm->swap_out, vm->major_faults, vm->scan_kswapd,
+               vm->scan_direct, vm->steal_kswapd, vm->steal_direct,
+               vm->alloc_stalls, vm->oom_kills);
+    struct net_info net;
+    size_t ifaces = net_total(s->nets, s->net_count, &net);
+    if (ifaces) {
+        const char *unit = mem_unit_suffix(summary_unit);
+        printf("net rx %.1f%s/s %.0f pkt/s  tx %.1f%s/s %.0f pkt/s  "
+               "drop %.0f/s  err %.0f/s  %zu interface%s\n",
+               scale_kb((unsigned long long)(net.rx_rate / 1024.0), summary_unit),
+               unit, net.rx_packets,
+               scale_kb((unsigned long long)(net.tx_rate / 1024.0), summary_unit),
+               unit, net.tx_packets, net.rx_drops + net.tx_drops,
+               net.rx_errors + net.tx_errors, ifaces, ifaces == 1 ? "" : "s");
+    }
+    if (cgroup_get_throttle()) {
+        struct cgroup_throttle_summary ts;
+        cgroup_throttle_summary(&ts);
+        printf("throttle %zu of %zu limited cgroups", ts.throttled, ts.limited);
+        if (ts.worst[0])
+            printf(", worst %s %.1f%% of periods %.1fms/s", ts.worst,
+                   ts.worst_percent, ts.worst_ms);
+        putchar('\n');
+    }
+    if (disk_view)
+        print_disks(s);
+    if (net_view)
+        print_nets(s);
+}
+
+static void print_batch(const struct snapshot *s, size_t count,
+                        double interval) {
+    const struct process_info *procs = s->procs;
+    print_summary(s, interval);
+    int wait = get_wait_stats();
+    int perf = perfctr_get_top() > 0;
+    int pss = smaps_enabled();
+    int ctxsw = get_switch_stats();
+    int throttle = cgroup_get_throttle();
+    printf("PID      CPU  USER     NAME                     STATE PRI  NICE  VSIZE    RSS   SHR  RSS%%  CPU%%   TIME     START     READ/s  WRITE/s SYSCR/s SYSCW/s MINFLT/s MAJFLT/s%s%s%s%s%s\n",
+           ctxsw ? "  VCSW/s IVCSW/s" : "",
+           throttle ? " THROTTLE%  THRMS/s" : "",
+           wait ? "     WAIT%  AVGWAIT" : "", perf ? "    IPC   MPKI" : "",
+           pss ? "      PSS      USS  SWAPPSS" : "");
+    for (size_t i = 0; i < count; i++) {
+        double vsz = procs[i].vsize / 1024.0; /* bytes to KB */
+        vsz = scale_kb((unsigned long long)vsz, proc_unit);
+        double rss = scale_kb((unsigned long long)procs[i].rss, proc_unit);
+        double shr = scale_kb(procs[i].shared, proc_unit);
+        printf("%-8d %3d %-8s %-25s %c %4ld %5ld %8.1f %5.1f %5.1f %6.2f %6.2f %8.0f %-8s",
+               procs[i].pid, procs[i].cpu, procs[i].user, procs[i].name, procs[i].state,
+               procs[i].priority, procs[i].nice, vsz, rss, shr,
+               procs[i].rss_percent, procs[i].cpu_usage,
+               procs[i].cpu_time, procs[i].start_time);
+        printf(" %9.1f %8.1f %7.0f %7.0f %8.0f %8.0f",
+               scale_kb((unsigned long long)(procs[i].read_rate / 1024.0), proc_unit),
+               scale_kb((unsigned long long)(procs[i].write_rate / 1024.0), proc_unit),
+               procs[i].syscr_rate, procs[i].syscw_rate,
+               procs[i].minflt_rate, procs[i].majflt_rate);
+        if (ctxsw)
+            printf(" %7.0f %7.0f", procs[i].vcsw_rate, procs[i].ivcsw_rate);
+        if (throttle) {
+            print_ratio(procs[i].throttle_percent, 9);
+            print_ratio(procs[i].throttle_ms, 8);
+        }
+        if (wait)
+            printf(" %9.2f %8.1f", procs[i].wait_percent, procs[i].wait_slice);
+        if (perf) {
+            print_ratio(procs[i].ipc, 6);
+            print_ratio(procs[i].mpki, 6);
+        }
+        if (pss) {
+            print_kb(procs[i].pss);
+            print_kb(procs[i].uss);
+            print_kb(procs[i].swap_pss);
+        }
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+/* Print snapshots as plain text. Snapshots come from /proc or, when
+ * replay is set, from a recording. With quiet set nothing is printed,
+ * which is used to record without a terminal. */
 static int run_batch(unsigned int delay_ms, enum sort_field sort,
-                     unsigned int iterations) {
-    struct process_info *procs = NULL;
-    size_t proc_cap = 0;
-    struct cpu_stats cs;
-    struct mem_stats ms;
-    struct misc_stats misc;
+                     unsigned int iterations, struct recording *replay,
+                     int quiet) {
+    struct snapshot snap = {0};
+    struct cgroup_list cgroups = {0};
+    struct replay_cursor cursor;
     int (*compare)(const void *, const void *) = cmp_proc_pid;
     switch (sort) {
     case SORT_CPU:
@@ -93,65 +430,116 @@ static int run_batch(unsigned int delay_ms, enum sort_field sort,
         compare = cmp_proc_priority;
         set_sort_descending(0);
         break;
+    case SORT_WAIT:
+        compare = cmp_proc_wait;
+        set_sort_descending(1);
+        set_wait_stats(1);
+        break;
+    case SORT_PSS:
+        compare = cmp_proc_pss;
+        set_sort_descending(1);
+        smaps_enable();
+        break;
+    case SORT_IO:
+        compare = cmp_proc_io;
+        set_sort_descending(1);
+        break;
+    case SORT_FAULTS:
+        compare = cmp_proc_faults;
+        set_sort_descending(1);
+        break;
+    case SORT_CTXSW:
+        compare = cmp_proc_ctxsw;
+        set_sort_descending(1);
+        set_switch_stats(1);
+        break;
+    case SORT_THROTTLE:
+        compare = cmp_proc_throttle;
+        set_sort_descending(1);
+        cgroup_set_throttle(1);
+        break;
     default:
         compare = cmp_proc_pid;
         set_sort_descending(0);
         break;
     }
+    if (replay)
+        replay_cursor_init(&cursor, replay);
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
     unsigned int iter = 0;
-    while (iterations == 0 || iter < iterations) {
-        if (read_cpu_stats(&cs) != 0)
-            memset(&cs, 0, sizeof(cs));
-        if (read_mem_stats(&ms) != 0)
-            memset(&ms, 0, sizeof(ms));
-        read_misc_stats(&misc);
-        size_t need = count_processes();
-        if (max_entries && need > max_entries)
-            need = max_entries;
-        if (need > proc_cap) {
-            struct process_info *tmp = realloc(procs, need * sizeof(*procs));
-            if (tmp) {
-                procs = tmp;
-                proc_cap = need;
+    double prev_time = 0.0;
+    while ((iterations == 0 || iter < iterations) && !stop_requested) {
+        double interval = delay_ms / 1000.0;
+        if (replay) {
+            if (replay_seek(&cursor, iter) != 0)
+                break;
+            snapshot_copy(&snap, &cursor.snap);
+            interval = iter > 0 ? snap.timestamp - prev_time : 0.0;
+            prev_time = snap.timestamp;
+        } else if (cgroup_view && !record_active()) {
+            /* the cgroup files hold the totals, tasks are not read */
+            snapshot_collect_system(&snap);
+            if (cgroup_collect(&cgroups) != 0) {
+                fprintf(stderr, "vtop: no cgroup v2 hierarchy at %s\n",
+                        cgroup_get_root());
+                break;
+            }
+        } else if (irq_view && !record_active()) {
+            snapshot_collect_system(&snap);
+            if (irq_collect() != 0) {
+                fprintf(stderr, "vtop: cannot read /proc/interrupts\n");
+                break;
             }
+        } else {
+            snapshot_collect(&snap, max_entries);
+            if (record_active())
+                record_frame(&snap);
+            const char *mode = perfctr_mode();
+            if (iter == 0 && mode && strcmp(mode, "hardware") != 0)
+                fprintf(stderr, "vtop: %s perf counters only, IPC or MPKI "
+                        "will show -\n", mode);
+        }
+        if (!quiet && cgroup_view && !replay) {
+            print_summary(&snap, interval);
+            print_cgroups(&cgroups);
+        } else if (!quiet && irq_view && !replay) {
+            print_summary(&snap, interval);
+            print_irqs();
+        } else if (!quiet) {
+            size_t count = snap.count;
+            if (max_entries && count > max_entries)
+                count = max_entries;
+            uint64_t t = self_now();
+            qsort(snap.procs, count, sizeof(struct process_info), compare);
+            self_add(SELF_SORT, t);
+            t = self_now();
+            print_batch(&snap, count, interval);
+            self_add(SELF_RENDER, t);
+        }
+        self_end_refresh();
+        if (self_stats) {
+            char sbuf[256];
+            self_format(sbuf, sizeof(sbuf));
+            if (quiet)
+                fprintf(stderr, "%s\n", sbuf);
+            else
+                printf("%s\n", sbuf);
         }
-        size_t count = list_processes(procs, proc_cap);
-        if (max_entries && count > max_entries)
-            count = max_entries;
-        qsort(procs, count, sizeof(struct process_info), compare);
-        double mem_usage = 0.0;
-        if (ms.total > 0)
-            mem_usage = 100.0 * (double)(ms.total - ms.available) /
-                        (double)ms.total;
-        double swap_usage = 0.0;
-        if (ms.swap_total > 0)
-            swap_usage = 100.0 * (double)ms.swap_used / (double)ms.swap_total;
-        double swap_used = scale_kb(ms.swap_used, summary_unit);
-        double swap_total = scale_kb(ms.swap_total, summary_unit);
-        printf("load %.2f %.2f %.2f  up %.0fs  tasks %d total, %d running, %d sleeping, %d stopped, %d zombie  cpu %5.1f%% us %.1f%% sy %.1f%% id %.1f%%  mem %5.1f%%  swap %.0f/%.0f%s %.1f%%  intv %.1fs\n",
-               misc.load1, misc.load5, misc.load15, misc.uptime,
-               misc.total_tasks, misc.running_tasks, misc.sleeping_tasks,
-               misc.stopped_tasks, misc.zombie_tasks,
-               100.0 - cs.idle_percent, cs.user_percent, cs.system_percent,
-               cs.idle_percent, mem_usage, swap_used, swap_total,
-               mem_unit_suffix(summary_unit), swap_usage, delay_ms / 1000.0);
-        printf("PID      CPU  USER     NAME                     STATE PRI  NICE  VSIZE    RSS   SHR  RSS%%  CPU%%   TIME     START\n");
-        for (size_t i = 0; i < count; i++) {
-            double vsz = procs[i].vsize / 1024.0; /* bytes to KB */
-            vsz = scale_kb((unsigned long long)vsz, proc_unit);
-            double rss = scale_kb((unsigned long long)procs[i].rss, proc_unit);
-            double shr = scale_kb(procs[i].shared, proc_unit);
-            printf("%-8d %3d %-8s %-25s %c %4ld %5ld %8.1f %5.1f %5.1f %6.2f %6.2f %8.0f %-8s\n",
-                   procs[i].pid, procs[i].cpu, procs[i].user, procs[i].name, procs[i].state,
-                   procs[i].priority, procs[i].nice, vsz, rss, shr,
-                   procs[i].rss_percent, procs[i].cpu_usage,
-                   procs[i].cpu_time, procs[i].start_time);
+        if (self_stats && budget_get() > 0.0 && !replay) {
+            char bbuf[128];
+            budget_format(bbuf, sizeof(bbuf));
+            fprintf(quiet ? stderr : stdout, "%s\n", bbuf);
         }
-        fflush(stdout);
-        usleep(delay_ms * 1000);
         iter++;
+        if (!replay && !stop_requested &&
+            (iterations == 0 || iter < iterations))
+            usleep(budget_next_delay(delay_ms) * 1000);
     }
-    free(procs);
+    if (replay)
+        replay_cursor_free(&cursor);
+    cgroup_list_free(&cgroups);
+    snapshot_free(&snap);
     return 0;
 }
 
@@ -188,6 +576,47 @@ int main(int argc, char *argv[]) {
         {"accum", no_argument, NULL, 1},
         {"irix", no_argument, NULL, 3},
         {"state", required_argument, NULL, 4},
+        {"record", required_argument, NULL, 6},
+        {"replay", required_argument, NULL, 7},
+        {"analyze", required_argument, NULL, 8},
+        {"from", required_argument, NULL, 9},
+        {"to", required_argument, NULL, 10},
+        {"top", required_argument, NULL, 11},
+        {"by", required_argument, NULL, 12},
+        {"jobs", required_argument, NULL, 13},
+        {"history", required_argument, NULL, 14},
+        {"serve", required_argument, NULL, 15},
+        {"metrics-top", required_argument, NULL, 16},
+        {"metrics-labels", required_argument, NULL, 17},
+        {"metrics-max-series", required_argument, NULL, 18},
+        {"metrics-label-len", required_argument, NULL, 19},
+        {"self-stats", no_argument, NULL, 23},
+        {"daemon", no_argument, NULL, 20},
+        {"share", required_argument, NULL, 21},
+        {"no-share", no_argument, NULL, 22},
+        {"proc-root", required_argument, NULL, 24},
+        {"cpu-budget", required_argument, NULL, 25},
+        {"sched-idle", no_argument, NULL, 26},
+        {"adaptive", required_argument, NULL, 27},
+        {"watch", required_argument, NULL, 28},
+        {"watch-interval", required_argument, NULL, 29},
+        {"jsonl", no_argument, NULL, 30},
+        {"schedstat", no_argument, NULL, 31},
+        {"wait", no_argument, NULL, 32},
+        {"perf", required_argument, NULL, 33},
+        {"ctxsw", no_argument, NULL, 35},
+        {"pss", required_argument, NULL, 34},
+        {"cgroups", no_argument, NULL, 36},
+        {"cgroup", required_argument, NULL, 37},
+        {"cgroup-root", required_argument, NULL, 38},
+        {"throttle", no_argument, NULL, 39},
+        {"disks", no_argument, NULL, 40},
+        {"all-disks", no_argument, NULL, 41},
+        {"net", no_argument, NULL, 42},
+        {"irq", no_argument, NULL, 43},
+        {"cpu-group", required_argument, NULL, 44},
+        {"share-group", required_argument, NULL, 45},
+        {"share-public", no_argument, NULL, 46},
         {"version", no_argument, NULL, 'V'},
         {"help", no_argument, NULL, 'h'},
         {NULL, 0, NULL, 0}
@@ -197,6 +626,17 @@ int main(int argc, char *argv[]) {
     int batch = 0;
     unsigned int iterations = 0;
     int columns = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *analyze_path = NULL;
+    struct analyze_options aopt = { NULL, NULL, 20, ANALYZE_BY_CPU, 0 };
+    int daemon_mode = 0;
+    int use_share = 1;
+    const char *share_name = SHARE_DEFAULT_NAME;
+    struct serve_options sopt = {
+        NULL, 10, SERVE_LABEL_PID | SERVE_LABEL_USER | SERVE_LABEL_NAME, 64, 20
+    };
+    struct watch_options wopt = { {0}, 0, 5, 0, 0, 0, 0, 0 };
     while ((opt = getopt_long(argc, argv, "d:Ss:E:e:b:n:m:p:C:u:U:w:aiHVh", long_opts, &idx)) != -1) {
         switch (opt) {
         case 'd':
@@ -228,6 +668,214 @@ int main(int argc, char *argv[]) {
             ui_set_hide_kthreads(1);
 #endif
             break;
+        case 6:
+            record_path = optarg;
+            break;
+        case 7:
+            replay_path = optarg;
+            break;
+        case 8:
+            analyze_path = optarg;
+            break;
+        case 9:
+            aopt.from = optarg;
+            break;
+        case 10:
+            aopt.to = optarg;
+            break;
+        case 11:
+            aopt.top = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 12:
+            if (strcmp(optarg, "rss") == 0 || strcmp(optarg, "mem") == 0)
+                aopt.by = ANALYZE_BY_RSS;
+            else if (strcmp(optarg, "io") == 0)
+                aopt.by = ANALYZE_BY_IO;
+            else if (strcmp(optarg, "cpu") == 0)
+                aopt.by = ANALYZE_BY_CPU;
+            else {
+                fprintf(stderr, "Invalid analysis key: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 13:
+            aopt.jobs = atoi(optarg);
+            break;
+        case 14: {
+            char *end;
+            unsigned long samples = strtoul(optarg, &end, 10);
+            unsigned long ntasks = 1024;
+            if (*end == 'x' || *end == 'X')
+                ntasks = strtoul(end + 1, &end, 10);
+            if (*end != '\0') {
+                fprintf(stderr, "Invalid history: %s\n", optarg);
+                return 1;
+            }
+            tasks_set_history(samples, ntasks);
+            break;
+        }
+        case 15:
+            sopt.addr = optarg;
+            break;
+        case 16:
+            sopt.top = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 17:
+            if (serve_parse_labels(optarg, &sopt.labels) != 0) {
+                fprintf(stderr, "Invalid metrics labels: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 18:
+            sopt.max_series = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 19:
+            sopt.label_len = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 20:
+            daemon_mode = 1;
+            break;
+        case 21:
+            share_name = optarg;
+            break;
+        case 22:
+            use_share = 0;
+            break;
+        case 23:
+            self_stats = 1;
+            self_set_enabled(1);
+#ifdef WITH_UI
+            ui_set_show_self_stats(1);
+#endif
+            break;
+        case 24:
+            if (set_proc_root(optarg) != 0) {
+                fprintf(stderr, "Invalid procfs root: %s\n", optarg);
+                return 1;
+            }
+            /* a daemon publishes the default root, not this one */
+            use_share = 0;
+            break;
+        case 25:
+            if (budget_set(strtod(optarg, NULL)) != 0) {
+                fprintf(stderr, "Invalid CPU budget: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 26:
+            if (budget_sched_idle() != 0) {
+                perror("sched_setscheduler");
+                return 1;
+            }
+            break;
+        case 27: {
+            char *end;
+            unsigned long idle = strtoul(optarg, &end, 10);
+            unsigned long sweep = 32;
+            if (*end == '/')
+                sweep = strtoul(end + 1, &end, 10);
+            if (*end != '\0' || sweep == 0) {
+                fprintf(stderr, "Invalid adaptive sampling: %s\n", optarg);
+                return 1;
+            }
+            set_sample_backoff((unsigned int)idle, (unsigned int)sweep);
+            break;
+        }
+        case 28:
+            if (watch_parse_pids(optarg, &wopt) != 0) {
+                fprintf(stderr, "Invalid watch list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 29:
+            wopt.sample_ms = (unsigned int)strtoul(optarg, NULL, 10);
+            if (wopt.sample_ms < 1 || wopt.sample_ms > 1000) {
+                fprintf(stderr, "Invalid watch interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 30:
+            wopt.jsonl = 1;
+            break;
+        case 31:
+            set_schedstat_mode(1);
+            break;
+        case 32:
+            set_wait_stats(1);
+            break;
+        case 33:
+            perfctr_set_top((size_t)strtoul(optarg, NULL, 10));
+            break;
+        case 34: {
+            double secs = strtod(optarg, NULL);
+            if (secs <= 0.0) {
+                fprintf(stderr, "Invalid PSS interval: %s\n", optarg);
+                return 1;
+            }
+            smaps_set_interval((unsigned int)(secs * 1000.0 + 0.5));
+            smaps_enable();
+            break;
+        }
+        case 35:
+            set_switch_stats(1);
+            break;
+        case 36:
+            cgroup_view = 1;
+#ifdef WITH_UI
+            ui_set_show_cgroups(1);
+#endif
+            break;
+        case 37:
+            cgroup_set_filter(optarg);
+            break;
+        case 38:
+            if (cgroup_set_root(optarg) != 0) {
+                fprintf(stderr, "Invalid cgroup root: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 39:
+            cgroup_set_throttle(1);
+            break;
+        case 40:
+            disk_view = 1;
+#ifdef WITH_UI
+            ui_set_show_disks(1);
+#endif
+            break;
+        case 41:
+            disk_set_all(1);
+            break;
+        case 42:
+            net_view = 1;
+            wopt.net = 1;
+#ifdef WITH_UI
+            ui_set_show_net(2);
+#endif
+            break;
+        case 43:
+            irq_view = 1;
+#ifdef WITH_UI
+            ui_set_show_irqs(1);
+#endif
+            break;
+        case 44:
+#ifdef WITH_UI
+            if (ui_set_core_group(optarg) != 0) {
+                fprintf(stderr, "Invalid CPU group: %s\n", optarg);
+                return 1;
+            }
+#endif
+            break;
+        case 45:
+            if (share_set_group(optarg) != 0) {
+                fprintf(stderr, "Invalid group: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 46:
+            share_set_public();
+            break;
         case '1':
 #ifdef WITH_UI
             ui_set_show_cores(1);
@@ -249,6 +897,18 @@ int main(int argc, char *argv[]) {
             else if (strcmp(optarg, "pri") == 0 ||
                      strcmp(optarg, "priority") == 0)
                 sort = SORT_PRI;
+            else if (strcmp(optarg, "wait") == 0)
+                sort = SORT_WAIT;
+            else if (strcmp(optarg, "pss") == 0)
+                sort = SORT_PSS;
+            else if (strcmp(optarg, "io") == 0)
+                sort = SORT_IO;
+            else if (strcmp(optarg, "faults") == 0)
+                sort = SORT_FAULTS;
+            else if (strcmp(optarg, "ctxsw") == 0)
+                sort = SORT_CTXSW;
+            else if (strcmp(optarg, "throttle") == 0)
+                sort = SORT_THROTTLE;
             else
                 sort = SORT_PID;
             break;
@@ -306,8 +966,63 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (analyze_path)
+        return run_analyze(analyze_path, &aopt);
+
+    if (wopt.pid_count) {
+        wopt.report_ms = delay_ms > wopt.sample_ms ? delay_ms : wopt.sample_ms;
+        wopt.iterations = iterations;
+        wopt.threads = get_thread_mode();
+        return run_watch(&wopt);
+    }
+
+    if (daemon_mode)
+        return run_daemon(share_name, delay_ms);
+
+    if (use_share)
+        share_attach(share_name);
+
+    if (sopt.addr)
+        return run_serve(delay_ms, &sopt);
+
+    if (replay_path) {
+        if (cgroup_view) {
+            fprintf(stderr, "vtop: recordings hold no cgroups\n");
+            return 1;
+        }
+        if (irq_view) {
+            fprintf(stderr, "vtop: recordings hold no interrupts\n");
+            return 1;
+        }
+        struct recording *rec = recording_open(replay_path);
+        if (!rec) {
+            fprintf(stderr, "vtop: cannot open recording %s\n", replay_path);
+            return 1;
+        }
+        int ret;
+#ifdef WITH_UI
+        if (!batch) {
+            ui_set_replay(rec);
+            ret = run_ui(delay_ms, sort, iterations, columns, max_entries);
+        } else
+#endif
+            ret = run_batch(delay_ms, sort, iterations, rec, 0);
+        recording_close(rec);
+        return ret;
+    }
+
+    if (record_path) {
+        if (record_open(record_path) != 0) {
+            perror(record_path);
+            return 1;
+        }
+        int ret = run_batch(delay_ms, sort, iterations, NULL, !batch);
+        record_close();
+        return ret;
+    }
+
     if (batch)
-        return run_batch(delay_ms, sort, iterations);
+        return run_batch(delay_ms, sort, iterations, NULL, 0);
 
 #ifdef WITH_UI
     return run_ui(delay_ms, sort, iterations, columns, max_entries);
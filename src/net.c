@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include "net.h"
+#include "proc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* raw counters of one interface, in /proc/net/dev order */
+struct sample {
+    char name[32];
+    unsigned long long rx_bytes;
+    unsigned long long rx_packets;
+    unsigned long long rx_errors;
+    unsigned long long rx_drops;
+    unsigned long long tx_bytes;
+    unsigned long long tx_packets;
+    unsigned long long tx_errors;
+    unsigned long long tx_drops;
+};
+
+static struct sample *prev;
+static size_t nprev;
+static size_t prev_cap;
+static struct sample *cur;
+static size_t cur_cap;
+static double prev_time;
+static struct net_info *list;
+static size_t nlist;
+static size_t list_cap;
+static char *buf;
+static size_t buf_cap;
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const struct sample *find_prev(const struct sample *s, size_t i) {
+    /* interfaces keep their place unless one comes or goes */
+    if (i < nprev && strcmp(prev[i].name, s->name) == 0)
+        return &prev[i];
+    for (size_t j = 0; j < nprev; j++) {
+        if (strcmp(prev[j].name, s->name) == 0)
+            return &prev[j];
+    }
+    return NULL;
+}
+
+static double rate(unsigned long long now, unsigned long long before,
+                   double elapsed) {
+    return now >= before ? (double)(now - before) / elapsed : 0.0;
+}
+
+static void fill_rates(struct net_info *n, const struct sample *s,
+                       const struct sample *old, double elapsed) {
+    memset(n, 0, sizeof(*n));
+    memcpy(n->name, s->name, sizeof(n->name));
+    if (!old || elapsed <= 0.0)
+        return;
+    n->rx_rate = rate(s->rx_bytes, old->rx_bytes, elapsed);
+    n->tx_rate = rate(s->tx_bytes, old->tx_bytes, elapsed);
+    n->rx_packets = rate(s->rx_packets, old->rx_packets, elapsed);
+    n->tx_packets = rate(s->tx_packets, old->tx_packets, elapsed);
+    n->rx_drops = rate(s->rx_drops, old->rx_drops, elapsed);
+    n->tx_drops = rate(s->tx_drops, old->tx_drops, elapsed);
+    n->rx_errors = rate(s->rx_errors, old->rx_errors, elapsed);
+    n->tx_errors = rate(s->tx_errors, old->tx_errors, elapsed);
+}
+
+/* Parse "  eth0: rx bytes packets errs drop fifo frame compressed
+ * multicast, tx bytes packets errs drop ..." into s. */
+static int parse_line(char *line, struct sample *s) {
+    char *colon = strchr(line, ':');
+    if (!colon)
+        return -1;
+    *colon = '\0';
+    while (*line == ' ')
+        line++;
+    snprintf(s->name, sizeof(s->name), "%s", line);
+    unsigned long long skip;
+    return sscanf(colon + 1,
+                  "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                  &s->rx_bytes, &s->rx_packets, &s->rx_errors, &s->rx_drops,
+                  &skip, &skip, &skip, &skip, &s->tx_bytes, &s->tx_packets,
+                  &s->tx_errors, &s->tx_drops) == 12 ? 0 : -1;
+}
+
+int net_collect(void) {
+    nlist = 0;
+    if (read_proc_file("net/dev", &buf, &buf_cap) < 0)
+        return -1;
+    double now = mono_seconds();
+    double elapsed = prev_time > 0.0 ? now - prev_time : 0.0;
+    size_t n = 0;
+    for (char *line = buf; line && *line;) {
+        char *nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+        if (n == cur_cap) {
+            size_t cap = cur_cap ? cur_cap * 2 : 16;
+            struct sample *tmp = realloc(cur, cap * sizeof(*tmp));
+            if (!tmp)
+                break;
+            cur = tmp;
+            cur_cap = cap;
+        }
+        /* the two header lines have no colon */
+        if (parse_line(line, &cur[n]) == 0) {
+            if (nlist == list_cap) {
+                size_t cap = list_cap ? list_cap * 2 : 16;
+                struct net_info *tmp = realloc(list, cap * sizeof(*tmp));
+                if (tmp) {
+                    list = tmp;
+                    list_cap = cap;
+                }
+            }
+            if (nlist < list_cap)
+                fill_rates(&list[nlist++], &cur[n], find_prev(&cur[n], n),
+                           elapsed);
+            n++;
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    struct sample *tmp = prev;
+    size_t tmp_cap = prev_cap;
+    prev = cur;
+    prev_cap = cur_cap;
+    nprev = n;
+    cur = tmp;
+    cur_cap = tmp_cap;
+    prev_time = now;
+    return (int)nlist;
+}
+
+const struct net_info *net_get(size_t *count) {
+    *count = nlist;
+    return list;
+}
+
+size_t net_total(const struct net_info *nets, size_t count,
+                 struct net_info *total) {
+    size_t summed = 0;
+    memset(total, 0, sizeof(*total));
+    for (size_t i = 0; i < count; i++) {
+        const struct net_info *n = &nets[i];
+        if (strcmp(n->name, "lo") == 0)
+            continue;
+        total->rx_rate += n->rx_rate;
+        total->tx_rate += n->tx_rate;
+        total->rx_packets += n->rx_packets;
+        total->tx_packets += n->tx_packets;
+        total->rx_drops += n->rx_drops;
+        total->tx_drops += n->tx_drops;
+        total->rx_errors += n->rx_errors;
+        total->tx_errors += n->tx_errors;
+        summed++;
+    }
+    strcpy(total->name, "total");
+    return summed;
+}
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include "perfctr.h"
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* groups open at once, four descriptors each */
+#define MAX_GROUPS 128
+/* threads counted per process */
+#define MAX_THREADS 64
+
+enum {
+    EV_CLOCK,
+    EV_CYCLES,
+    EV_INSTR,
+    EV_MISSES,
+    EV_COUNT
+};
+
+/* the task clock leads every group and never needs a PMU */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[EV_COUNT] = {
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+/* position of each event in a group read, -1 when unsupported; set
+ * by probe() */
+static int slot[EV_COUNT];
+static int probed;
+static int nslots;
+
+struct group {
+    int tid;
+    int fd[EV_COUNT];
+    uint64_t last[EV_COUNT];
+    int primed;
+    int seen;
+};
+
+struct ptask {
+    int pid;
+    int tid;
+    double start;
+    int seen;
+    /* no group could be opened, not retried while in the top set */
+    int failed;
+    struct group *groups;
+    size_t count;
+    size_t cap;
+};
+
+static size_t top_n;
+static struct ptask *tracked;
+static size_t ntracked;
+static size_t tracked_cap;
+static size_t open_groups;
+static size_t *top;
+
+static int perf_open(int e, int tid, int leader) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    /* user space only, which perf_event_paranoid 2 still allows */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, tid, -1, leader,
+                        PERF_FLAG_FD_CLOEXEC);
+}
+
+/* Find which events the kernel counts by opening each on vtop itself. */
+static void probe(void) {
+    probed = 1;
+    nslots = 0;
+    for (int e = 0; e < EV_COUNT; e++) {
+        int fd = perf_open(e, 0, -1);
+        slot[e] = fd >= 0 ? nslots++ : -1;
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+const char *perfctr_mode(void) {
+    if (!probed || slot[EV_CLOCK] < 0)
+        return NULL;
+    if (slot[EV_CYCLES] >= 0 && slot[EV_INSTR] >= 0 && slot[EV_MISSES] >= 0)
+        return "hardware";
+    if (slot[EV_CYCLES] >= 0 || slot[EV_INSTR] >= 0)
+        return "partial";
+    return "software";
+}
+
+static void group_close(struct group *g) {
+    for (int e = EV_COUNT - 1; e >= 0; e--) {
+        if (g->fd[e] >= 0)
+            close(g->fd[e]);
+    }
+    open_groups--;
+}
+
+static int group_open(struct group *g, int tid) {
+    if (open_groups >= MAX_GROUPS)
+        return -1;
+    memset(g, 0, sizeof(*g));
+    g->tid = tid;
+    for (int e = 0; e < EV_COUNT; e++)
+        g->fd[e] = -1;
+    g->fd[EV_CLOCK] = perf_open(EV_CLOCK, tid, -1);
+    if (g->fd[EV_CLOCK] < 0)
+        return -1;
+    open_groups++;
+    for (int e = EV_CLOCK + 1; e < EV_COUNT; e++) {
+        if (slot[e] < 0)
+            continue;
+        g->fd[e] = perf_open(e, tid, g->fd[EV_CLOCK]);
+        if (g->fd[e] < 0) {
+            /* a group read has to return every slot */
+            group_close(g);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void ptask_close(struct ptask *t) {
+    for (size_t i = 0; i < t->count; i++)
+        group_close(&t->groups[i]);
+    free(t->groups);
+    t->groups = NULL;
+    t->count = 0;
+    t->cap = 0;
+}
+
+static void ptask_add_thread(struct ptask *t, int tid) {
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 4;
+        struct group *tmp = realloc(t->groups, cap * sizeof(*tmp));
+        if (!tmp)
+            return;
+        t->groups = tmp;
+        t->cap = cap;
+    }
+    if (group_open(&t->groups[t->count], tid) == 0) {
+        t->groups[t->count].seen = 1;
+        t->count++;
+    }
+}
+
+/* Open groups for new threads of t and close those of exited ones. */
+static void ptask_sync(struct ptask *t) {
+    for (size_t i = 0; i < t->count; i++)
+        t->groups[i].seen = 0;
+    if (get_thread_mode()) {
+        if (t->count)
+            t->groups[0].seen = 1;
+        else
+            ptask_add_thread(t, t->tid);
+    } else {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%d/task", get_proc_root(), t->pid);
+        DIR *dir = opendir(path);
+        if (dir) {
+            struct dirent *ent;
+            while ((ent = readdir(dir)) != NULL) {
+                char *end;
+                long tid = strtol(ent->d_name, &end, 10);
+                if (*end != '\0' || end == ent->d_name)
+                    continue;
+                size_t i = 0;
+                while (i < t->count && t->groups[i].tid != (int)tid)
+                    i++;
+                if (i < t->count)
+                    t->groups[i].seen = 1;
+                else if (t->count < MAX_THREADS)
+                    ptask_add_thread(t, (int)tid);
+            }
+            closedir(dir);
+        }
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->groups[i].seen)
+            t->groups[n++] = t->groups[i];
+        else
+            group_close(&t->groups[i]);
+    }
+    t->count = n;
+    if (n == 0)
+        t->failed = 1;
+}
+
+/* Read every group of t once and derive IPC and MPKI from the deltas. */
+static void ptask_read(struct ptask *t, struct process_info *p) {
+    uint64_t sum[EV_COUNT] = {0};
+    int have = 0;
+    for (size_t i = 0; i < t->count; i++) {
+        struct group *g = &t->groups[i];
+        uint64_t buf[1 + EV_COUNT];
+        ssize_t r = read(g->fd[EV_CLOCK], buf, sizeof(buf));
+        if (r < (ssize_t)((1 + nslots) * sizeof(uint64_t)) ||
+            buf[0] != (uint64_t)nslots)
+            continue;
+        for (int e = 0; e < EV_COUNT; e++) {
+            if (slot[e] < 0)
+                continue;
+            uint64_t v = buf[1 + slot[e]];
+            if (g->primed && v >= g->last[e])
+                sum[e] += v - g->last[e];
+            g->last[e] = v;
+        }
+        have |= g->primed;
+        g->primed = 1;
+    }
+    if (!have)
+        return;
+    if (slot[EV_CYCLES] >= 0 && slot[EV_INSTR] >= 0 && sum[EV_CYCLES] > 0)
+        p->ipc = (double)sum[EV_INSTR] / (double)sum[EV_CYCLES];
+    if (slot[EV_INSTR] >= 0 && slot[EV_MISSES] >= 0 && sum[EV_INSTR] > 0)
+        p->mpki = 1000.0 * (double)sum[EV_MISSES] / (double)sum[EV_INSTR];
+}
+
+static struct ptask *ptask_find(const struct process_info *p) {
+    for (size_t i = 0; i < ntracked; i++) {
+        struct ptask *t = &tracked[i];
+        if (t->pid == p->pid && t->tid == p->tid && t->start == p->start_timestamp)
+            return t;
+    }
+    if (ntracked == tracked_cap) {
+        size_t cap = tracked_cap ? tracked_cap * 2 : 16;
+        struct ptask *tmp = realloc(tracked, cap * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        tracked = tmp;
+        tracked_cap = cap;
+    }
+    struct ptask *t = &tracked[ntracked++];
+    memset(t, 0, sizeof(*t));
+    t->pid = p->pid;
+    t->tid = p->tid;
+    t->start = p->start_timestamp;
+    return t;
+}
+
+static void drop_unseen(void) {
+    size_t n = 0;
+    for (size_t i = 0; i < ntracked; i++) {
+        if (tracked[i].seen)
+            tracked[n++] = tracked[i];
+        else
+            ptask_close(&tracked[i]);
+    }
+    ntracked = n;
+}
+
+void perfctr_set_top(size_t n) {
+    size_t *tmp = n ? realloc(top, n * sizeof(*top)) : NULL;
+    if (n && !tmp)
+        n = 0;
+    top_n = n;
+    if (tmp)
+        top = tmp;
+    if (!n) {
+        for (size_t i = 0; i < ntracked; i++)
+            tracked[i].seen = 0;
+        drop_unseen();
+    }
+}
+
+size_t perfctr_get_top(void) { return top_n; }
+
+void perfctr_update(struct process_info *procs, size_t count) {
+    if (!top_n)
+        return;
+    if (!probed)
+        probe();
+    /* the busiest tasks, by insertion into a short sorted list */
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (procs[i].cpu_usage <= 0.0)
+            continue;
+        size_t j = n < top_n ? n++ : top_n;
+        while (j > 0 && procs[top[j - 1]].cpu_usage < procs[i].cpu_usage) {
+            if (j < top_n)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < top_n)
+            top[j] = i;
+    }
+    for (size_t i = 0; i < ntracked; i++)
+        tracked[i].seen = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct process_info *p = &procs[top[i]];
+        struct ptask *t = ptask_find(p);
+        if (!t)
+            continue;
+        t->seen = 1;
+        if (t->failed)
+            continue;
+        ptask_sync(t);
+        ptask_read(t, p);
+    }
+    drop_unseen();
+}
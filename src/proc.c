@@ -7,24 +7,31 @@
 #include <pwd.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "tasks.h"
+#include "selfstat.h"
 
-/* store previous per-process CPU times between calls */
-#define MAX_PREV 1024
-struct prev_entry {
-    int pid;
-    int tid;
-    unsigned long long utime;
-    unsigned long long stime;
-};
-static struct prev_entry prev_table[MAX_PREV];
-static size_t prev_count;
+#ifndef VTOP_PROC_ROOT
+#define VTOP_PROC_ROOT "/proc"
+#endif
+
+/* room for proc_root plus a task file name */
+#define PROC_PATH_MAX 512
+
+/* procfs mount point, VTOP_PROC_ROOT or --proc-root */
+static char proc_root[256] = VTOP_PROC_ROOT;
 
 /* previous total CPU time for usage calculation */
 static unsigned long long last_total_cpu;
+/* CLOCK_BOOTTIME of the previous list_processes() call */
+static double last_scan_time;
 
-/* per-core statistics parsed from /proc/stat */
+/* per-core statistics parsed from /proc/stat, kept between reads */
 static struct cpu_core_stats *core_stats;
 static size_t core_count;
+static size_t core_cap;
 
 /* optional filters */
 static char name_filter[256] = "";
@@ -32,6 +39,10 @@ static char user_filter[32] = "";
 static char pid_filter[256] = "";
 static int pid_list[64];
 static size_t pid_list_count;
+/* sorted member pids, e.g. of a cgroup, see set_member_filter() */
+static int *member_list;
+static size_t member_count;
+static int member_active;
 /* sort order: 0 = ascending, 1 = descending */
 static int sort_descending;
 /* show threads instead of processes */
@@ -39,6 +50,18 @@ static int thread_mode;
 static int show_idle = 1;
 static int hide_kthreads;
 static int show_accum_time;
+/* optional task files are re-read every scan_stride scans, 0 = never */
+static unsigned int scan_stride = 1;
+/* CPU usage from schedstat nanoseconds instead of stat ticks */
+static int schedstat_mode;
+/* run queue wait time from schedstat, see set_wait_stats() */
+static int wait_stats;
+/* sum thread context switches, see set_switch_stats() */
+static int switch_stats;
+/* idle samples before backing off, 0 = sample every task every scan */
+static unsigned int backoff_idle;
+/* scans between full sweeps that read every task */
+static unsigned int backoff_sweep = 32;
 static int cpu_irix_mode;
 static char state_filter;
 
@@ -57,6 +80,22 @@ int get_hide_kthreads(void) { return hide_kthreads; }
 void set_show_accum_time(int on) { show_accum_time = on != 0; }
 int get_show_accum_time(void) { return show_accum_time; }
 
+void set_scan_stride(unsigned int stride) { scan_stride = stride; }
+unsigned int get_scan_stride(void) { return scan_stride; }
+
+void set_sample_backoff(unsigned int idle, unsigned int sweep) {
+    backoff_idle = idle;
+    backoff_sweep = sweep ? sweep : 1;
+}
+unsigned int get_sample_backoff(void) { return backoff_idle; }
+
+void set_schedstat_mode(int on) { schedstat_mode = on != 0; }
+int get_schedstat_mode(void) { return schedstat_mode; }
+void set_wait_stats(int on) { wait_stats = on != 0; }
+int get_wait_stats(void) { return wait_stats; }
+void set_switch_stats(int on) { switch_stats = on != 0; }
+int get_switch_stats(void) { return switch_stats; }
+
 void set_cpu_irix_mode(int on) { cpu_irix_mode = on != 0; }
 int get_cpu_irix_mode(void) { return cpu_irix_mode; }
 
@@ -104,6 +143,28 @@ void set_pid_filter(const char *list) {
 
 const char *get_pid_filter(void) { return pid_filter; }
 
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+void set_member_filter(const int *pids, size_t count) {
+    member_active = pids != NULL;
+    member_count = 0;
+    if (!pids || !count)
+        return;
+    int *tmp = realloc(member_list, count * sizeof(*tmp));
+    if (!tmp) {
+        member_active = 0;
+        return;
+    }
+    member_list = tmp;
+    memcpy(member_list, pids, count * sizeof(*pids));
+    qsort(member_list, count, sizeof(*member_list), cmp_int);
+    member_count = count;
+}
+
 size_t get_cpu_core_count(void) { return core_count; }
 
 const struct cpu_core_stats *get_cpu_core_stats(void) { return core_stats; }
@@ -122,6 +183,10 @@ static int match_filter(int pid, const char *name, const char *user, char state)
         if (!found)
             return 0;
     }
+    if (member_active &&
+        !bsearch(&pid, member_list, member_count, sizeof(*member_list),
+                 cmp_int))
+        return 0;
     if (user_filter[0] && strcmp(user_filter, user) != 0)
         return 0;
     if (state_filter && state_filter != state)
@@ -145,17 +210,121 @@ static int match_filter(int pid, const char *name, const char *user, char state)
     return 1;
 }
 
-int read_cpu_stats(struct cpu_stats *stats) {
-    FILE *fp = fopen("/proc/stat", "r");
-    if (!fp) {
+/* Read a /proc file into buf and NUL terminate it. Files longer than
+ * size - 1 bytes are cut short. Returns the length or -1. */
+static ssize_t read_file(const char *path, char *buf, size_t size) {
+    uint64_t t = self_now();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        self_add(SELF_READ, t);
         return -1;
     }
+    self_count_open();
+    size_t len = 0;
+    while (len < size - 1) {
+        ssize_t n = read(fd, buf + len, size - 1 - len);
+        self_count_read();
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += (size_t)n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    self_add(SELF_READ, t);
+    return (ssize_t)len;
+}
 
-    char buf[256];
-    if (!fgets(buf, sizeof(buf), fp)) {
-        fclose(fp);
+/* Read a whole file into a buffer that grows as needed. */
+static ssize_t read_file_alloc(const char *path, char **buf, size_t *cap) {
+    for (;;) {
+        if (*cap == 0) {
+            char *tmp = malloc(8192);
+            if (!tmp)
+                return -1;
+            *buf = tmp;
+            *cap = 8192;
+        }
+        ssize_t n = read_file(path, *buf, *cap);
+        if (n < 0 || (size_t)n < *cap - 1)
+            return n;
+        char *tmp = realloc(*buf, *cap * 2);
+        if (!tmp)
+            return n;
+        *buf = tmp;
+        *cap *= 2;
+    }
+}
+
+ssize_t read_proc_file(const char *name, char **buf, size_t *cap) {
+    char path[PROC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", proc_root, name);
+    return read_file_alloc(path, buf, cap);
+}
+
+static DIR *open_dir(const char *path) {
+    DIR *d = opendir(path);
+    if (d)
+        self_count_open();
+    return d;
+}
+
+int set_proc_root(const char *path) {
+    size_t n = strlen(path);
+    while (n > 1 && path[n - 1] == '/')
+        n--;
+    if (n == 0 || n >= sizeof(proc_root))
         return -1;
+    memcpy(proc_root, path, n);
+    proc_root[n] = '\0';
+    return 0;
+}
+
+const char *get_proc_root(void) { return proc_root; }
+
+int proc_visible(const struct process_info *p) {
+    if (!show_idle && p->cpu_usage == 0.0)
+        return 0;
+    return match_filter(p->pid, p->name, p->user, p->state);
+}
+
+/* Parse "N user nice system idle iowait irq softirq steal ..." after the
+ * "cpu" of a per-core line; kernels before 2.6.11 stop after irq. */
+static int parse_core_line(const char *p, struct cpu_core_stats *c) {
+    char *end;
+    c->id = (unsigned int)strtoul(p, &end, 10);
+    p = end;
+    unsigned long long f[8] = {0};
+    int n = 0;
+    while (n < 8) {
+        f[n] = strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        n++;
     }
+    if (n < 4)
+        return -1;
+    c->user = f[0];
+    c->nice = f[1];
+    c->system = f[2];
+    c->idle = f[3];
+    c->iowait = f[4];
+    c->irq = f[5];
+    c->softirq = f[6];
+    c->steal = f[7];
+    return 0;
+}
+
+int read_cpu_stats(struct cpu_stats *stats) {
+    static char *buf;
+    static size_t cap;
+    char path[PROC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/stat", proc_root);
+    if (read_file_alloc(path, &buf, &cap) < 0)
+        return -1;
+    uint64_t t = self_now();
     /* parse overall cpu line */
     char cpu_label[16];
     int scanned = sscanf(buf, "%15s %llu %llu %llu %llu %llu %llu %llu %llu",
@@ -169,40 +338,31 @@ int read_cpu_stats(struct cpu_stats *stats) {
                          &stats->softirq,
                          &stats->steal);
     if (scanned < 5) {
-        fclose(fp);
+        self_add(SELF_PARSE, t);
         return -1;
     }
 
-    /* read per-core lines */
-    free(core_stats);
-    core_stats = NULL;
+    /* read per-core lines into the array of the last read, which only
+     * grows when CPUs come online */
     core_count = 0;
-    while (fgets(buf, sizeof(buf), fp)) {
-        if (strncmp(buf, "cpu", 3) == 0 && isdigit((unsigned char)buf[3])) {
-            struct cpu_core_stats tmp;
-            scanned = sscanf(buf, "%15s %llu %llu %llu %llu %llu %llu %llu %llu",
-                             cpu_label,
-                             &tmp.user,
-                             &tmp.nice,
-                             &tmp.system,
-                             &tmp.idle,
-                             &tmp.iowait,
-                             &tmp.irq,
-                             &tmp.softirq,
-                             &tmp.steal);
-            if (scanned >= 5) {
-                struct cpu_core_stats *new_arr =
-                    realloc(core_stats, (core_count + 1) * sizeof(*core_stats));
-                if (new_arr) {
-                    core_stats = new_arr;
-                    core_stats[core_count++] = tmp;
-                }
-            }
-        } else {
+    const char *line = strchr(buf, '\n');
+    while (line && *++line) {
+        if (strncmp(line, "cpu", 3) != 0 || !isdigit((unsigned char)line[3]))
             break;
+        if (core_count == core_cap) {
+            size_t ncap = core_cap ? core_cap * 2 : 64;
+            struct cpu_core_stats *new_arr =
+                realloc(core_stats, ncap * sizeof(*core_stats));
+            if (!new_arr)
+                break;
+            core_stats = new_arr;
+            core_cap = ncap;
         }
+        if (parse_core_line(line + 3, &core_stats[core_count]) == 0)
+            core_count++;
+        line = strchr(line, '\n');
     }
-    fclose(fp);
+    self_add(SELF_PARSE, t);
 
     /* calculate percentages based on previous totals */
     static unsigned long long prev_user = 0;
@@ -265,52 +425,224 @@ int read_cpu_stats(struct cpu_stats *stats) {
     return 0;
 }
 
-static int read_mem_value(const char *key, unsigned long long *val) {
-    FILE *fp = fopen("/proc/meminfo", "r");
-    if (!fp)
-        return -1;
-    char line[256];
+static int read_mem_value(const char *buf, const char *key,
+                          unsigned long long *val) {
     size_t keylen = strlen(key);
-    int found = -1;
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, key, keylen) == 0) {
+    const char *line = buf;
+    while (line && *line) {
+        if (strncmp(line, key, keylen) == 0 && line[keylen] == ':') {
             unsigned long long tmp = 0;
             if (sscanf(line + keylen, ": %llu", &tmp) == 1) {
                 *val = tmp;
-                found = 0;
-                break;
+                return 0;
             }
         }
+        line = strchr(line, '\n');
+        if (line)
+            line++;
     }
-    fclose(fp);
-    return found;
+    return -1;
 }
 
-int read_mem_stats(struct mem_stats *stats) {
-    if (read_mem_value("MemTotal", &stats->total) < 0)
-        return -1;
-    if (read_mem_value("MemFree", &stats->free) < 0)
-        return -1;
-    if (read_mem_value("MemAvailable", &stats->available) < 0)
-        return -1;
-    if (read_mem_value("Buffers", &stats->buffers) < 0)
-        return -1;
-    if (read_mem_value("Cached", &stats->cached) < 0)
-        return -1;
-    if (read_mem_value("SwapTotal", &stats->swap_total) < 0)
+enum {
+    VM_PSWPIN,
+    VM_PSWPOUT,
+    VM_PGMAJFAULT,
+    VM_SCAN_KSWAPD,
+    VM_SCAN_DIRECT,
+    VM_STEAL_KSWAPD,
+    VM_STEAL_DIRECT,
+    VM_ALLOCSTALL,
+    VM_OOM_KILL,
+    VM_COUNT
+};
+
+/* zoned counters are split per zone on some kernels, e.g.
+ * allocstall_normal or pgscan_kswapd_dma32, and summed */
+static const struct {
+    const char *key;
+    int zoned;
+} vm_keys[VM_COUNT] = {
+    { "pswpin", 0 },
+    { "pswpout", 0 },
+    { "pgmajfault", 0 },
+    { "pgscan_kswapd", 1 },
+    { "pgscan_direct", 1 },
+    { "pgsteal_kswapd", 1 },
+    { "pgsteal_direct", 1 },
+    { "allocstall", 1 },
+    { "oom_kill", 0 },
+};
+
+static int vm_key_match(const char *name, size_t len, int k) {
+    size_t klen = strlen(vm_keys[k].key);
+    if (len < klen || memcmp(name, vm_keys[k].key, klen) != 0)
+        return 0;
+    if (len == klen)
+        return 1;
+    /* pgscan_direct_throttle counts throttling, not pages */
+    return vm_keys[k].zoned && name[klen] == '_' &&
+           !(len - klen == 9 && memcmp(name + klen + 1, "throttle", 8) == 0);
+}
+
+/* Sum the counters of vm_keys from a /proc/vmstat buffer. */
+static void parse_vmstat(const char *buf, unsigned long long *vals) {
+    memset(vals, 0, VM_COUNT * sizeof(*vals));
+    for (const char *line = buf; line && *line;) {
+        const char *sp = strchr(line, ' ');
+        const char *nl = strchr(line, '\n');
+        /* every key starts with a, o or p */
+        if (sp && (!nl || sp < nl) &&
+            (*line == 'p' || *line == 'a' || *line == 'o')) {
+            size_t len = (size_t)(sp - line);
+            for (int k = 0; k < VM_COUNT; k++) {
+                if (vm_key_match(line, len, k)) {
+                    vals[k] += strtoull(sp + 1, NULL, 10);
+                    break;
+                }
+            }
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+}
+
+static void read_vm_rates(struct vm_rates *vm) {
+    static char *buf;
+    static size_t cap;
+    static unsigned long long prev[VM_COUNT];
+    static double prev_time;
+    unsigned long long cur[VM_COUNT];
+    char path[PROC_PATH_MAX];
+    /* the same moment as meminfo, which was read just before */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double now = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    memset(vm, 0, sizeof(*vm));
+    snprintf(path, sizeof(path), "%s/vmstat", proc_root);
+    if (read_file_alloc(path, &buf, &cap) < 0)
+        return;
+    uint64_t t = self_now();
+    parse_vmstat(buf, cur);
+    vm->available = 1;
+    double elapsed = prev_time > 0.0 ? now - prev_time : 0.0;
+    double rate[VM_COUNT] = {0};
+    for (int k = 0; k < VM_COUNT && elapsed > 0.0; k++)
+        rate[k] = cur[k] >= prev[k] ? (double)(cur[k] - prev[k]) / elapsed : 0.0;
+    vm->swap_in = rate[VM_PSWPIN];
+    vm->swap_out = rate[VM_PSWPOUT];
+    vm->major_faults = rate[VM_PGMAJFAULT];
+    vm->scan_kswapd = rate[VM_SCAN_KSWAPD];
+    vm->scan_direct = rate[VM_SCAN_DIRECT];
+    vm->steal_kswapd = rate[VM_STEAL_KSWAPD];
+    vm->steal_direct = rate[VM_STEAL_DIRECT];
+    vm->alloc_stalls = rate[VM_ALLOCSTALL];
+    vm->oom_kills = rate[VM_OOM_KILL];
+    memcpy(prev, cur, sizeof(prev));
+    prev_time = now;
+    self_add(SELF_PARSE, t);
+}
+
+static int read_meminfo(struct mem_stats *stats) {
+    char buf[8192];
+    char path[PROC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/meminfo", proc_root);
+    if (read_file(path, buf, sizeof(buf)) < 0)
         return -1;
+    uint64_t t = self_now();
     unsigned long long swap_free = 0;
-    if (read_mem_value("SwapFree", &swap_free) < 0)
-        return -1;
-    if (stats->swap_total >= swap_free)
+    int ret = -1;
+    if (read_mem_value(buf, "MemTotal", &stats->total) == 0 &&
+        read_mem_value(buf, "MemFree", &stats->free) == 0 &&
+        read_mem_value(buf, "MemAvailable", &stats->available) == 0 &&
+        read_mem_value(buf, "Buffers", &stats->buffers) == 0 &&
+        read_mem_value(buf, "Cached", &stats->cached) == 0 &&
+        read_mem_value(buf, "SwapTotal", &stats->swap_total) == 0 &&
+        read_mem_value(buf, "SwapFree", &swap_free) == 0)
+        ret = 0;
+    if (ret == 0 && stats->swap_total >= swap_free)
         stats->swap_used = stats->swap_total - swap_free;
     else
         stats->swap_used = 0;
+    self_add(SELF_PARSE, t);
+    return ret;
+}
+
+int read_mem_stats(struct mem_stats *stats) {
+    int ret = read_meminfo(stats);
+    read_vm_rates(&stats->vm);
+    return ret;
+}
+
+int parse_pressure(const char *buf, struct pressure_resource *res) {
+    res->some_avg10 = res->full_avg10 = -1.0;
+    res->some_total = res->full_total = 0;
+    int found = 0;
+    for (const char *line = buf; line && *line;) {
+        double avg10;
+        unsigned long long total;
+        const char *a = strstr(line, "avg10=");
+        const char *t = strstr(line, "total=");
+        const char *nl = strchr(line, '\n');
+        if (a && t && (!nl || t < nl) &&
+            sscanf(a + 6, "%lf", &avg10) == 1 &&
+            sscanf(t + 6, "%llu", &total) == 1) {
+            if (strncmp(line, "some ", 5) == 0) {
+                res->some_avg10 = avg10;
+                res->some_total = total;
+                found = 1;
+            } else if (strncmp(line, "full ", 5) == 0) {
+                res->full_avg10 = avg10;
+                res->full_total = total;
+            }
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    return found ? 0 : -1;
+}
+
+int read_pressure_stats(struct pressure_stats *stats) {
+    static const char *const names[] = { "cpu", "memory", "io" };
+    static struct pressure_resource prev[3];
+    static int primed;
+    static int seen;
+    static int missing;
+    char buf[512];
+    char path[PROC_PATH_MAX];
+    struct pressure_resource *res[3] = {
+        &stats->cpu, &stats->memory, &stats->io
+    };
+    stats->available = 0;
+    if (missing)
+        return -1;
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/pressure/%s", proc_root, names[i]);
+        errno = 0;
+        ssize_t n = read_file(path, buf, sizeof(buf));
+        if (n < 0 || parse_pressure(buf, res[i]) != 0) {
+            /* Missing files, or psi=0 failing the read, mean the
+             * kernel has no PSI. Other failures may be transient, so
+             * try again next refresh. */
+            if (!seen && (errno == ENOENT || errno == EOPNOTSUPP))
+                missing = 1;
+            primed = 0;
+            return -1;
+        }
+        /* the first read has nothing to compare with */
+        res[i]->some_delta = primed ? (double)(res[i]->some_total -
+                                               prev[i].some_total) : 0.0;
+        res[i]->full_delta = primed ? (double)(res[i]->full_total -
+                                               prev[i].full_total) : 0.0;
+        prev[i] = *res[i];
+    }
+    primed = 1;
+    seen = 1;
+    stats->available = 1;
     return 0;
 }
 
 size_t count_processes(void) {
-    DIR *dir = opendir("/proc");
+    uint64_t t = self_now();
+    DIR *dir = open_dir(proc_root);
     if (!dir)
         return 0;
     struct dirent *ent;
@@ -321,9 +653,9 @@ size_t count_processes(void) {
         if (*endptr != '\0')
             continue;
         if (get_thread_mode()) {
-            char tpath[64];
-            snprintf(tpath, sizeof(tpath), "/proc/%ld/task", pid);
-            DIR *tdir = opendir(tpath);
+            char tpath[PROC_PATH_MAX];
+            snprintf(tpath, sizeof(tpath), "%s/%ld/task", proc_root, pid);
+            DIR *tdir = open_dir(tpath);
             if (!tdir)
                 continue;
             struct dirent *tent;
@@ -339,55 +671,703 @@ size_t count_processes(void) {
         }
     }
     closedir(dir);
+    self_add(SELF_ENUM, t);
     return count;
 }
 
+/* Boot time in seconds since the epoch. The btime line of /proc/stat is
+ * used so start times do not jitter between refreshes. */
+static double get_boot_time(void) {
+    static double boot_time;
+    if (boot_time > 0.0)
+        return boot_time;
+    static char *buf;
+    static size_t cap;
+    char path[PROC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/stat", proc_root);
+    if (read_file_alloc(path, &buf, &cap) >= 0) {
+        const char *line = strstr(buf, "\nbtime ");
+        unsigned long long btime;
+        if (line && sscanf(line + 1, "btime %llu", &btime) == 1)
+            boot_time = (double)btime;
+        free(buf);
+        buf = NULL;
+        cap = 0;
+    }
+    if (boot_time > 0.0)
+        return boot_time;
+    char up[64];
+    double up_secs = 0.0;
+    snprintf(path, sizeof(path), "%s/uptime", proc_root);
+    if (read_file(path, up, sizeof(up)) < 0 ||
+        sscanf(up, "%lf", &up_secs) != 1)
+        up_secs = 0.0;
+    return (double)time(NULL) - up_secs;
+}
+
+/* Fields of /proc/[pid]/stat used by vtop */
+struct stat_info {
+    char comm[256];
+    char state;
+    int ppid;
+    unsigned long long minflt;
+    unsigned long long majflt;
+    unsigned long long utime;
+    unsigned long long stime;
+    unsigned long long cutime;
+    unsigned long long cstime;
+    long priority;
+    long nice;
+    long threads;
+    unsigned long long starttime;
+    unsigned long long vsize;
+    long rss;
+    int processor;
+};
+
+/* Parse a stat line. The command name may contain spaces and
+ * parentheses, so it ends at the last ')'. Returns 0 on success. */
+static int parse_stat(const char *line, struct stat_info *st) {
+    const char *open = strchr(line, '(');
+    const char *close = strrchr(line, ')');
+    if (!open || !close || close < open)
+        return -1;
+    size_t len = (size_t)(close - open - 1);
+    if (len >= sizeof(st->comm))
+        len = sizeof(st->comm) - 1;
+    memcpy(st->comm, open + 1, len);
+    st->comm[len] = '\0';
+    const char *p = close + 1;
+    while (*p == ' ')
+        p++;
+    if (!*p)
+        return -1;
+    st->state = *p++;
+    /* numeric fields as numbered in proc(5), starting with ppid (4) */
+    unsigned long long f[40] = {0};
+    int n = 4;
+    while (n < 40) {
+        char *end;
+        f[n] = strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        n++;
+    }
+    if (n <= 24)
+        return -1;
+    st->ppid = (int)f[4];
+    st->minflt = f[10];
+    st->majflt = f[12];
+    st->utime = f[14];
+    st->stime = f[15];
+    st->cutime = f[16];
+    st->cstime = f[17];
+    st->priority = (long)f[18];
+    st->nice = (long)f[19];
+    st->threads = (long)f[20];
+    st->starttime = f[22];
+    st->vsize = f[23];
+    st->rss = (long)f[24];
+    st->processor = (int)f[39];
+    return 0;
+}
+
+static void stat_from_cache(const struct task_sample *t, struct stat_info *st) {
+    snprintf(st->comm, sizeof(st->comm), "%s", t->comm);
+    st->state = t->state;
+    st->ppid = t->ppid;
+    st->minflt = t->minflt;
+    st->majflt = t->majflt;
+    st->utime = t->utime;
+    st->stime = t->stime;
+    st->cutime = t->child_time;
+    st->cstime = 0;
+    st->priority = t->priority;
+    st->nice = t->nice;
+    st->threads = 0;
+    st->starttime = t->start;
+    st->vsize = t->vsize;
+    st->rss = t->rss;
+    st->processor = t->processor;
+}
+
+/* Remember a freshly read stat and schedule the next sample: every scan
+ * while the task uses CPU, then after 2, 4, 8... scans once it was idle
+ * for backoff_idle samples in a row, at most backoff_sweep apart. */
+static void stat_to_cache(struct task_sample *t, const struct stat_info *st,
+                          unsigned long long delta, unsigned int scan) {
+    strncpy(t->comm, st->comm, sizeof(t->comm) - 1);
+    t->comm[sizeof(t->comm) - 1] = '\0';
+    t->state = st->state;
+    t->ppid = st->ppid;
+    t->child_time = st->cutime + st->cstime;
+    t->priority = st->priority;
+    t->nice = st->nice;
+    t->vsize = st->vsize;
+    t->rss = st->rss;
+    t->processor = st->processor;
+    t->stat_valid = 1;
+    if (delta > 0 || st->state == 'R' || !backoff_idle) {
+        t->idle_samples = 0;
+        t->next_sample = scan + 1;
+        return;
+    }
+    t->idle_samples++;
+    unsigned int skip = 1;
+    if (t->idle_samples >= backoff_idle) {
+        unsigned int n = t->idle_samples - backoff_idle + 1;
+        skip = n < 31 ? 1u << n : backoff_sweep;
+        if (skip > backoff_sweep)
+            skip = backoff_sweep;
+    }
+    t->next_sample = scan + skip;
+}
+
+/* Process states seen by the last list_processes() call, so
+ * read_misc_stats() need not read every status file again. Only valid
+ * when that call walked all of /proc. */
+static struct {
+    int valid;
+    int sleeping;
+    int stopped;
+    int zombie;
+} scan_states;
+
+static void count_state(char state) {
+    switch (state) {
+    case 'S':
+    case 'D':
+        scan_states.sleeping++;
+        break;
+    case 'T':
+    case 't':
+        scan_states.stopped++;
+        break;
+    case 'Z':
+        scan_states.zombie++;
+        break;
+    default:
+        break;
+    }
+}
+
+/* schedstat counters: on-CPU and run queue wait nanoseconds and the
+ * number of timeslices */
+struct sched_info {
+    unsigned long long run_ns;
+    unsigned long long wait_ns;
+    unsigned long long slices;
+};
+
+static int parse_schedstat(const char *buf, struct sched_info *si) {
+    si->wait_ns = 0;
+    si->slices = 0;
+    /* the wait and slice fields are missing without CONFIG_SCHED_INFO */
+    return sscanf(buf, "%llu %llu %llu", &si->run_ns, &si->wait_ns,
+                  &si->slices) >= 1 ? 0 : -1;
+}
+
+/* schedstat of a task. A process is its main thread in
+ * /proc/PID/schedstat, so multi-threaded processes sum their threads.
+ * Returns 0 on success. */
+static int read_sched_info(long pid, long tid, long threads,
+                           struct sched_info *si) {
+    char path[PROC_PATH_MAX];
+    char buf[128];
+    if (thread_mode || threads <= 1) {
+        if (thread_mode)
+            snprintf(path, sizeof(path), "%s/%ld/task/%ld/schedstat", proc_root,
+                     pid, tid);
+        else
+            snprintf(path, sizeof(path), "%s/%ld/schedstat", proc_root, pid);
+        if (read_file(path, buf, sizeof(buf)) < 0)
+            return -1;
+        return parse_schedstat(buf, si);
+    }
+    snprintf(path, sizeof(path), "%s/%ld/task", proc_root, pid);
+    DIR *dir = open_dir(path);
+    if (!dir)
+        return -1;
+    struct sched_info sum = {0, 0, 0};
+    int found = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char *end;
+        long t = strtol(ent->d_name, &end, 10);
+        if (*end != '\0' || end == ent->d_name)
+            continue;
+        struct sched_info v;
+        snprintf(path, sizeof(path), "%s/%ld/task/%ld/schedstat", proc_root,
+                 pid, t);
+        if (read_file(path, buf, sizeof(buf)) >= 0 &&
+            parse_schedstat(buf, &v) == 0) {
+            sum.run_ns += v.run_ns;
+            sum.wait_ns += v.wait_ns;
+            sum.slices += v.slices;
+            found = 1;
+        }
+    }
+    closedir(dir);
+    *si = sum;
+    return found ? 0 : -1;
+}
+
+/* Values shared by every task of one list_processes() call */
+struct scan_ctx {
+    unsigned long long total_delta;
+    unsigned long long mem_total;
+    long page_kb;
+    long clk_tck;
+    double boot_time;
+    /* seconds since the previous scan, 0 on the first one */
+    double elapsed;
+    /* previous scan time in clock ticks after boot */
+    unsigned long long last_ticks;
+    /* CLOCK_BOOTTIME seconds of this scan */
+    double now;
+    /* CLOCK_MONOTONIC seconds of this scan, for schedstat */
+    double mono;
+    /* CPUs for scaling schedstat run time, at least 1 */
+    size_t ncpu;
+    unsigned int scan;
+    /* every task is read, see set_sample_backoff() */
+    int sweep;
+};
+
+static void read_cmdline(long pid, char *dst, size_t size) {
+    char path[PROC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%ld/cmdline", proc_root, pid);
+    ssize_t r = read_file(path, dst, size);
+    if (r < 0) {
+        dst[0] = '\0';
+        return;
+    }
+    size_t j = 0;
+    for (size_t i = 0; i < (size_t)r && j < size - 1; i++) {
+        char c = dst[i];
+        if (c == '\0') {
+            if (j > 0 && dst[j - 1] != ' ')
+                dst[j++] = ' ';
+        } else {
+            dst[j++] = c;
+        }
+    }
+    if (j > 0 && dst[j - 1] == ' ')
+        j--; /* strip trailing space */
+    dst[j] = '\0';
+}
+
+/* Per-second rate of a counter read span seconds apart, 0 when it went
+ * backwards */
+static float counter_rate(unsigned long long now, unsigned long long before,
+                          double span) {
+    if (now < before)
+        return 0.0f;
+    return (float)((double)(now - before) / span);
+}
+
+/* Voluntary and involuntary context switches from a status file */
+static void parse_switches(const char *buf, unsigned long long *vcsw,
+                           unsigned long long *ivcsw) {
+    const char *v = strstr(buf, "\nvoluntary_ctxt_switches:");
+    if (v)
+        *vcsw += strtoull(v + 25, NULL, 10);
+    v = strstr(buf, "\nnonvoluntary_ctxt_switches:");
+    if (v)
+        *ivcsw += strtoull(v + 28, NULL, 10);
+}
+
+/* status of a process only counts its main thread's switches, so a
+ * multi-threaded process adds up those of all its threads */
+static void read_process_switches(long pid, unsigned long long *vcsw,
+                                  unsigned long long *ivcsw) {
+    char path[PROC_PATH_MAX];
+    char buf[4096];
+    snprintf(path, sizeof(path), "%s/%ld/task", proc_root, pid);
+    DIR *dir = open_dir(path);
+    if (!dir)
+        return;
+    *vcsw = 0;
+    *ivcsw = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char *end;
+        long t = strtol(ent->d_name, &end, 10);
+        if (*end != '\0' || end == ent->d_name)
+            continue;
+        snprintf(path, sizeof(path), "%s/%ld/task/%ld/status", proc_root,
+                 pid, t);
+        if (read_file(path, buf, sizeof(buf)) >= 0)
+            parse_switches(buf, vcsw, ivcsw);
+    }
+    closedir(dir);
+}
+
+/* Read status, statm, io and cmdline into the cache of t. Without a
+ * task entry the values go straight to out. */
+static void read_task_info(long pid, long tid, long threads,
+                           const struct scan_ctx *ctx, int optional,
+                           struct task_sample *t, struct process_info *out) {
+    char path[PROC_PATH_MAX];
+    char buf[4096];
+    unsigned int uid = 0;
+    unsigned long long syscr = 0, syscw = 0;
+    unsigned long long vcsw = 0, ivcsw = 0;
+    if (thread_mode)
+        snprintf(path, sizeof(path), "%s/%ld/task/%ld/status", proc_root, pid, tid);
+    else
+        snprintf(path, sizeof(path), "%s/%ld/status", proc_root, pid);
+    if (read_file(path, buf, sizeof(buf)) >= 0) {
+        const char *line = strstr(buf, "\nUid:");
+        if (line)
+            sscanf(line + 5, "%u", &uid);
+        parse_switches(buf, &vcsw, &ivcsw);
+        if (switch_stats && !thread_mode && threads > 1)
+            read_process_switches(pid, &vcsw, &ivcsw);
+    }
+    out->uid = uid;
+    out->shared = 0;
+    out->read_bytes = 0;
+    out->write_bytes = 0;
+    out->cmdline[0] = '\0';
+    if (optional) {
+        snprintf(path, sizeof(path), "%s/%ld/statm", proc_root, pid);
+        if (read_file(path, buf, sizeof(buf)) >= 0) {
+            unsigned long dummy, res, shr;
+            if (sscanf(buf, "%lu %lu %lu", &dummy, &res, &shr) >= 3)
+                out->shared = shr * ctx->page_kb;
+        }
+        if (thread_mode)
+            snprintf(path, sizeof(path), "%s/%ld/task/%ld/io", proc_root, pid, tid);
+        else
+            snprintf(path, sizeof(path), "%s/%ld/io", proc_root, pid);
+        if (read_file(path, buf, sizeof(buf)) >= 0) {
+            const char *v = strstr(buf, "\nread_bytes:");
+            if (v)
+                sscanf(v + 12, "%llu", &out->read_bytes);
+            v = strstr(buf, "\nwrite_bytes:");
+            if (v)
+                sscanf(v + 13, "%llu", &out->write_bytes);
+            v = strstr(buf, "\nsyscr:");
+            if (v)
+                sscanf(v + 7, "%llu", &syscr);
+            v = strstr(buf, "\nsyscw:");
+            if (v)
+                sscanf(v + 7, "%llu", &syscw);
+        }
+        read_cmdline(pid, out->cmdline, sizeof(out->cmdline));
+    }
+    if (!t)
+        return;
+    t->uid = uid;
+    /* switches come with status, which every turn reads; with a stride
+     * of 0 that is the first turn only and the rates are not shown */
+    double cspan = ctx->now - t->ctxsw_time;
+    if (t->ctxsw_time > 0.0 && cspan > 0.0) {
+        t->vcsw_rate = counter_rate(vcsw, t->vcsw, cspan);
+        t->ivcsw_rate = counter_rate(ivcsw, t->ivcsw, cspan);
+    }
+    t->vcsw = vcsw;
+    t->ivcsw = ivcsw;
+    t->ctxsw_time = ctx->now;
+    if (optional) {
+        /* over the time since this task's own previous io read */
+        double span = ctx->now - t->io_time;
+        if (t->io_time > 0.0 && span > 0.0) {
+            t->read_rate = counter_rate(out->read_bytes, t->read_bytes, span);
+            t->write_rate = counter_rate(out->write_bytes, t->write_bytes, span);
+            t->syscr_rate = counter_rate(syscr, t->syscr, span);
+            t->syscw_rate = counter_rate(syscw, t->syscw, span);
+            t->io_rate = t->read_rate + t->write_rate;
+        }
+        t->io_time = ctx->now;
+    }
+    if (optional || !t->info_valid) {
+        t->shared_kb = out->shared;
+        t->read_bytes = out->read_bytes;
+        t->write_bytes = out->write_bytes;
+        t->syscr = syscr;
+        t->syscw = syscw;
+        tasks_set_cmdline(t, out->cmdline);
+    }
+    t->info_valid = 1;
+}
+
+/* Whether the /proc directory of the task is the one its cache was last
+ * checked against. procfs stamps a directory when it creates the inode,
+ * so a pid reused by a new task gets another one; so does an evicted
+ * inode, which only costs a stat read. */
+static int task_dir_same(long pid, long tid, struct task_sample *t) {
+    char path[PROC_PATH_MAX];
+    struct stat sb;
+    if (thread_mode)
+        snprintf(path, sizeof(path), "%s/%ld/task/%ld", proc_root, pid, tid);
+    else
+        snprintf(path, sizeof(path), "%s/%ld", proc_root, pid);
+    uint64_t ts = self_now();
+    int ok = stat(path, &sb) == 0;
+    self_add(SELF_READ, ts);
+    if (!ok)
+        return 0;
+    long long ctime = (long long)sb.st_ctim.tv_sec * 1000000000LL +
+                      sb.st_ctim.tv_nsec;
+    int same = t->dir_ino == (unsigned long long)sb.st_ino &&
+               t->dir_ctime == ctime;
+    t->dir_ino = (unsigned long long)sb.st_ino;
+    t->dir_ctime = ctime;
+    return same;
+}
+
+static int read_task_data(long pid, long tid, const struct scan_ctx *ctx,
+                          struct process_info *out) {
+    char path[PROC_PATH_MAX];
+    char buf[4096];
+    if (thread_mode)
+        snprintf(path, sizeof(path), "%s/%ld/task/%ld/stat", proc_root, pid, tid);
+    else
+        snprintf(path, sizeof(path), "%s/%ld/stat", proc_root, pid);
+    struct stat_info st;
+    int created = 0;
+    struct task_sample *t = NULL;
+    /* idle tasks not due for a sample keep their last values */
+    int cached = 0;
+    if (backoff_idle && !ctx->sweep) {
+        t = tasks_peek((int)pid, (int)tid);
+        cached = t && t->stat_valid && (int)(ctx->scan - t->next_sample) < 0 &&
+                 task_dir_same(pid, tid, t);
+    }
+    if (cached) {
+        stat_from_cache(t, &st);
+    } else {
+        if (read_file(path, buf, sizeof(buf)) < 0 || parse_stat(buf, &st) != 0)
+            return -1;
+        t = tasks_get((int)pid, (int)tid, st.starttime, &created);
+    }
+    if (tid == pid)
+        count_state(st.state);
+    unsigned long long delta = 0;
+    if (t && !created)
+        delta = (st.utime + st.stime) - (t->utime + t->stime);
+    else if (ctx->elapsed > 0.0 && st.starttime >= ctx->last_ticks)
+        delta = st.utime + st.stime; /* started since the last scan */
+    float minflt_rate = 0.0f, majflt_rate = 0.0f;
+    if (t && !cached) {
+        /* idle tasks skipped by the backoff fault no pages either */
+        double span = ctx->now - t->fault_time;
+        if (!created && t->fault_time > 0.0 && span > 0.0) {
+            minflt_rate = counter_rate(st.minflt, t->minflt, span);
+            majflt_rate = counter_rate(st.majflt, t->majflt, span);
+        }
+        t->minflt = st.minflt;
+        t->majflt = st.majflt;
+        t->fault_time = ctx->now;
+        t->utime = st.utime;
+        t->stime = st.stime;
+        stat_to_cache(t, &st, delta, ctx->scan);
+    }
+    double usage = 100.0 * (double)delta / (double)ctx->total_delta;
+    int busy = delta > 0;
+    double wait_percent = 0.0;
+    double wait_slice = 0.0;
+    if ((schedstat_mode || wait_stats) && t && !cached) {
+        struct sched_info si;
+        if (read_sched_info(pid, tid, st.threads, &si) == 0) {
+            /* threads that exited take their counters with them */
+            if (!created && t->run_time > 0.0 && ctx->mono > t->run_time &&
+                si.run_ns >= t->run_ns && si.wait_ns >= t->wait_ns &&
+                si.slices >= t->slices) {
+                double span = (ctx->mono - t->run_time) * 1e9;
+                unsigned long long d = si.run_ns - t->run_ns;
+                unsigned long long w = si.wait_ns - t->wait_ns;
+                unsigned long long n = si.slices - t->slices;
+                if (schedstat_mode) {
+                    usage = 100.0 * (double)d / (span * (double)ctx->ncpu);
+                    busy = d > 0;
+                }
+                wait_percent = 100.0 * (double)w / span;
+                if (n > 0)
+                    wait_slice = (double)w / (double)n / 1e3;
+            }
+            t->run_ns = si.run_ns;
+            t->wait_ns = si.wait_ns;
+            t->slices = si.slices;
+            t->run_time = ctx->mono;
+        }
+    }
+    if (cpu_irix_mode) {
+        size_t ncpu = get_cpu_core_count();
+        if (ncpu > 0)
+            usage *= (double)ncpu;
+    }
+    if (!show_idle && !busy)
+        return -1;
+
+    /* stat is read every scan, the other files by new tasks and in
+     * turns; with a stride of 0 only status is read, once */
+    int turn = !t || !t->info_valid ||
+               (!cached && scan_stride == 1) ||
+               (!cached && scan_stride > 1 &&
+                ((unsigned int)tid + ctx->scan) % scan_stride == 0);
+    if (turn) {
+        read_task_info(pid, tid, st.threads, ctx, scan_stride != 0, t, out);
+    } else {
+        out->uid = t->uid;
+        out->shared = t->shared_kb;
+        out->read_bytes = t->read_bytes;
+        out->write_bytes = t->write_bytes;
+        snprintf(out->cmdline, sizeof(out->cmdline), "%s",
+                 t->cmdline ? t->cmdline : "");
+    }
+
+    out->pid = (int)pid;
+    out->tid = (int)tid;
+    out->ppid = st.ppid;
+    uint64_t tu = self_now();
+    struct passwd *pw = getpwuid((uid_t)out->uid);
+    if (pw) {
+        strncpy(out->user, pw->pw_name, sizeof(out->user) - 1);
+        out->user[sizeof(out->user) - 1] = '\0';
+    } else {
+        snprintf(out->user, sizeof(out->user), "%u", out->uid);
+    }
+    self_add(SELF_USER, tu);
+    strncpy(out->name, st.comm, sizeof(out->name) - 1);
+    out->name[sizeof(out->name) - 1] = '\0';
+
+    if (!match_filter((int)pid, out->name, out->user, st.state))
+        return -1;
+
+    out->state = st.state;
+    out->priority = st.priority;
+    out->nice = st.nice;
+    out->vsize = st.vsize;
+    long rss_kb = st.rss * ctx->page_kb;
+    out->rss = rss_kb;
+    out->rss_percent = 100.0 * (double)rss_kb / (double)ctx->mem_total;
+    out->utime = st.utime;
+    out->stime = st.stime;
+    out->cpu_usage = usage;
+    out->wait_percent = wait_percent;
+    out->wait_slice = wait_slice;
+    out->ipc = -1.0;
+    out->mpki = -1.0;
+    out->pss = -1;
+    out->uss = -1;
+    out->swap_pss = -1;
+    out->throttle_percent = -1.0;
+    out->throttle_ms = -1.0;
+    /* with a stride of 0, io and status are not read again and the last
+     * rates would stay forever */
+    int rates = t && scan_stride != 0;
+    out->read_rate = rates ? t->read_rate : 0.0;
+    out->write_rate = rates ? t->write_rate : 0.0;
+    out->syscr_rate = rates ? t->syscr_rate : 0.0;
+    out->syscw_rate = rates ? t->syscw_rate : 0.0;
+    out->minflt_rate = minflt_rate;
+    out->majflt_rate = majflt_rate;
+    out->vcsw_rate = rates ? t->vcsw_rate : 0.0;
+    out->ivcsw_rate = rates ? t->ivcsw_rate : 0.0;
+    unsigned long long tt = st.utime + st.stime;
+    if (show_accum_time)
+        tt += st.cutime + st.cstime;
+    out->cpu_time = (double)tt / (double)ctx->clk_tck;
+    time_t start_epoch = (time_t)(ctx->boot_time +
+                                  (double)st.starttime / (double)ctx->clk_tck);
+    struct tm *tm = localtime(&start_epoch);
+    if (tm)
+        strftime(out->start_time, sizeof(out->start_time), "%H:%M:%S", tm);
+    else
+        strncpy(out->start_time, "??:??:??", sizeof(out->start_time));
+    out->start_timestamp = (double)start_epoch;
+    out->cpu = st.processor;
+    out->level = 0;
+
+    if (t) {
+        float vals[TASK_METRIC_COUNT];
+        vals[TASK_METRIC_CPU] = (float)usage;
+        vals[TASK_METRIC_RSS] = (float)rss_kb;
+        vals[TASK_METRIC_IO] = rates ? t->io_rate : 0.0f;
+        tasks_record(t, vals);
+    }
+    return 0;
+}
+
+/* Read one task into out. tid equals pid in process mode. Returns 0 when
+ * the task passed the filters and out was filled. */
+static int read_task(long pid, long tid, const struct scan_ctx *ctx,
+                     struct process_info *out) {
+    uint64_t t = self_now();
+    uint64_t mark = t ? self_mark() : 0;
+    int ret = read_task_data(pid, tid, ctx, out);
+    /* everything not spent reading files or resolving users */
+    self_add_excl(SELF_PARSE, t, mark);
+    if (ret == 0)
+        self_count_task();
+    return ret;
+}
+
 size_t list_processes(struct process_info *buf, size_t max) {
+    struct scan_ctx ctx;
     struct cpu_stats cs;
-    unsigned long long total_delta = 1;
+    ctx.total_delta = 1;
     if (read_cpu_stats(&cs) == 0) {
         unsigned long long total = cs.user + cs.nice + cs.system + cs.idle +
                                    cs.iowait + cs.irq + cs.softirq + cs.steal;
         if (last_total_cpu != 0)
-            total_delta = total - last_total_cpu;
+            ctx.total_delta = total - last_total_cpu;
         last_total_cpu = total;
-        if (total_delta == 0)
-            total_delta = 1;
+        if (ctx.total_delta == 0)
+            ctx.total_delta = 1;
     }
 
     struct mem_stats ms;
-    if (read_mem_stats(&ms) != 0)
+    /* only the total; a second vmstat read would cut the rates short */
+    if (read_meminfo(&ms) != 0 || ms.total == 0)
         ms.total = 1; /* avoid divide by zero */
-    long page_kb = getpagesize() / 1024;
-    if (page_kb <= 0)
-        page_kb = 4;
+    ctx.mem_total = ms.total;
+    ctx.page_kb = getpagesize() / 1024;
+    if (ctx.page_kb <= 0)
+        ctx.page_kb = 4;
+    ctx.clk_tck = sysconf(_SC_CLK_TCK);
+    if (ctx.clk_tck <= 0)
+        ctx.clk_tck = 100;
+    ctx.boot_time = get_boot_time();
 
-    DIR *dir = opendir("/proc");
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    double now_secs = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+    ctx.elapsed = last_scan_time > 0.0 ? now_secs - last_scan_time : 0.0;
+    ctx.last_ticks = (unsigned long long)(last_scan_time * (double)ctx.clk_tck);
+    last_scan_time = now_secs;
+    ctx.now = now_secs;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ctx.mono = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+    ctx.ncpu = get_cpu_core_count();
+    if (ctx.ncpu == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        ctx.ncpu = n > 0 ? (size_t)n : 1;
+    }
+
+    uint64_t t = self_now();
+    uint64_t mark = t ? self_mark() : 0;
+    DIR *dir = open_dir(proc_root);
     if (!dir)
         return 0;
     struct dirent *ent;
     size_t count = 0;
-    long clk_tck = sysconf(_SC_CLK_TCK);
-    if (clk_tck <= 0)
-        clk_tck = 100;
-
-    FILE *upt = fopen("/proc/uptime", "r");
-    double up_secs = 0.0;
-    if (upt) {
-        fscanf(upt, "%lf", &up_secs);
-        fclose(upt);
-    }
-    time_t now = time(NULL);
-    double boot_time = (double)now - up_secs;
+    memset(&scan_states, 0, sizeof(scan_states));
+    ctx.scan = tasks_begin_scan();
+    ctx.sweep = backoff_idle == 0 || ctx.scan % backoff_sweep == 0;
     while ((ent = readdir(dir)) != NULL && count < max) {
         char *endptr;
         long pid = strtol(ent->d_name, &endptr, 10);
         if (*endptr != '\0')
             continue; /* not a pid */
-        char tpath[64];
-        if (get_thread_mode()) {
-            snprintf(tpath, sizeof(tpath), "/proc/%ld/task", pid);
-            DIR *tdir = opendir(tpath);
+        if (thread_mode) {
+            char tpath[PROC_PATH_MAX];
+            snprintf(tpath, sizeof(tpath), "%s/%ld/task", proc_root, pid);
+            DIR *tdir = open_dir(tpath);
             if (!tdir)
                 continue;
             struct dirent *tent;
@@ -395,365 +1375,67 @@ size_t list_processes(struct process_info *buf, size_t max) {
                 long tid = strtol(tent->d_name, &endptr, 10);
                 if (*endptr != '\0')
                     continue;
-                char path[64];
-                snprintf(path, sizeof(path), "/proc/%ld/task/%ld/stat", pid, tid);
-                FILE *fp = fopen(path, "r");
-                if (!fp)
-                    continue;
-                char line[1024];
-                if (fgets(line, sizeof(line), fp)) {
-                    char comm[256];
-                    char state;
-                    int ppid;
-                    unsigned long long utime, stime, cutime, cstime, starttime;
-                    long priority, niceval;
-                    unsigned long long vsize;
-                    long rss;
-                    int cpu = 0;
-                    sscanf(line,
-                           "%*d (%255[^)]) %c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu %llu %llu %llu %ld %ld %*s %*s %llu %llu %ld"
-                           " %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %d",
-                           comm, &state, &ppid, &utime, &stime, &cutime, &cstime,
-                           &priority, &niceval, &starttime, &vsize, &rss, &cpu);
-
-                    unsigned int uid = 0;
-                    snprintf(path, sizeof(path), "/proc/%ld/status", pid);
-                    FILE *fs = fopen(path, "r");
-                    if (fs) {
-                        char line2[256];
-                        while (fgets(line2, sizeof(line2), fs)) {
-                            if (strncmp(line2, "Uid:", 4) == 0) {
-                                sscanf(line2 + 4, "%u", &uid);
-                                break;
-                            }
-                        }
-                        fclose(fs);
-                    }
-
-                    unsigned long long old_utime = 0, old_stime = 0;
-                    for (size_t i = 0; i < prev_count; i++) {
-                        if (prev_table[i].pid == pid && prev_table[i].tid == tid) {
-                            old_utime = prev_table[i].utime;
-                            old_stime = prev_table[i].stime;
-                            prev_table[i].utime = utime;
-                            prev_table[i].stime = stime;
-                            break;
-                        }
-                    }
-                    if (old_utime == 0 && old_stime == 0 && prev_count < MAX_PREV) {
-                        prev_table[prev_count].pid = pid;
-                        prev_table[prev_count].tid = tid;
-                        prev_table[prev_count].utime = utime;
-                        prev_table[prev_count].stime = stime;
-                        prev_count++;
-                    }
-
-                    unsigned long long delta = (utime - old_utime) + (stime - old_stime);
-                    double usage = 100.0 * (double)delta / (double)total_delta;
-                    if (get_cpu_irix_mode()) {
-                        size_t ncpu = get_cpu_core_count();
-                        if (ncpu > 0)
-                            usage *= (double)ncpu;
-                    }
-                    if (!show_idle && delta == 0) {
-                        fclose(fp);
-                        continue;
-                    }
-
-                    buf[count].pid = (int)pid;
-                    buf[count].tid = (int)tid;
-                    buf[count].ppid = ppid;
-                    buf[count].uid = uid;
-                    struct passwd *pw = getpwuid((uid_t)uid);
-                    if (pw) {
-                        strncpy(buf[count].user, pw->pw_name, sizeof(buf[count].user) - 1);
-                        buf[count].user[sizeof(buf[count].user) - 1] = '\0';
-                    } else {
-                        snprintf(buf[count].user, sizeof(buf[count].user), "%u", uid);
-                    }
-                    strncpy(buf[count].name, comm, sizeof(buf[count].name) - 1);
-                    buf[count].name[sizeof(buf[count].name) - 1] = '\0';
-
-                    snprintf(path, sizeof(path), "/proc/%ld/cmdline", pid);
-                    FILE *fc = fopen(path, "r");
-                    if (fc) {
-                        size_t r = fread(buf[count].cmdline, 1,
-                                         sizeof(buf[count].cmdline) - 1, fc);
-                        fclose(fc);
-                        size_t j = 0;
-                        for (size_t i = 0; i < r && j < sizeof(buf[count].cmdline) - 1; i++) {
-                            char c = buf[count].cmdline[i];
-                            if (c == '\0') {
-                                if (j > 0 && buf[count].cmdline[j - 1] != ' ')
-                                    buf[count].cmdline[j++] = ' ';
-                            } else {
-                                buf[count].cmdline[j++] = c;
-                            }
-                        }
-                        if (j > 0 && buf[count].cmdline[j - 1] == ' ')
-                            j--; /* strip trailing space */
-                        buf[count].cmdline[j] = '\0';
-                    } else {
-                        buf[count].cmdline[0] = '\0';
-                    }
-
-                    if (!match_filter((int)pid, buf[count].name, buf[count].user, state)) {
-                        fclose(fp);
-                        continue;
-                    }
-
-                    buf[count].state = state;
-                    buf[count].priority = priority;
-                    buf[count].nice = niceval;
-                    buf[count].vsize = vsize;
-                    long rss_kb = rss * page_kb;
-                    buf[count].rss = rss_kb;
-                    unsigned long long shared_kb = 0;
-                    snprintf(path, sizeof(path), "/proc/%ld/statm", pid);
-                    FILE *fm = fopen(path, "r");
-                    if (fm) {
-                        unsigned long dummy, res, shr;
-                        if (fscanf(fm, "%lu %lu %lu", &dummy, &res, &shr) >= 3)
-                            shared_kb = shr * page_kb;
-                        fclose(fm);
-                    }
-                    buf[count].shared = shared_kb;
-                    buf[count].rss_percent = 100.0 * (double)rss_kb /
-                                           (double)ms.total;
-                    unsigned long long rb = 0, wb = 0;
-                    snprintf(path, sizeof(path), "/proc/%ld/task/%ld/io", pid, tid);
-                    FILE *fio = fopen(path, "r");
-                    if (fio) {
-                        char lineio[256];
-                        while (fgets(lineio, sizeof(lineio), fio)) {
-                            if (sscanf(lineio, "read_bytes: %llu", &rb) == 1)
-                                continue;
-                            if (sscanf(lineio, "write_bytes: %llu", &wb) == 1)
-                                continue;
-                        }
-                        fclose(fio);
-                    }
-                    buf[count].read_bytes = rb;
-                    buf[count].write_bytes = wb;
-                    buf[count].utime = utime;
-                    buf[count].stime = stime;
-                    buf[count].cpu_usage = usage;
-                    unsigned long long tt = utime + stime;
-                    if (get_show_accum_time())
-                        tt += cutime + cstime;
-                    buf[count].cpu_time = (double)tt / (double)clk_tck;
-                    time_t start_epoch = (time_t)(boot_time +
-                                                 (double)starttime / (double)clk_tck);
-                    struct tm *tm = localtime(&start_epoch);
-                    if (tm)
-                        strftime(buf[count].start_time, sizeof(buf[count].start_time),
-                                 "%H:%M:%S", tm);
-                    else
-                        strncpy(buf[count].start_time, "??:??:??",
-                                sizeof(buf[count].start_time));
-                    buf[count].start_timestamp = (double)start_epoch;
-                    buf[count].cpu = cpu;
-                    buf[count].level = 0;
+                if (read_task(pid, tid, &ctx, &buf[count]) == 0)
                     count++;
-                }
-                fclose(fp);
             }
             closedir(tdir);
-        } else {
-            char path[64];
-            snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
-            FILE *fp = fopen(path, "r");
-            if (!fp)
-                continue;
-            char line[1024];
-            if (fgets(line, sizeof(line), fp)) {
-                char comm[256];
-                char state;
-                int ppid;
-                unsigned long long utime, stime, cutime, cstime, starttime;
-                long priority, niceval;
-                unsigned long long vsize;
-                long rss;
-                int cpu = 0;
-                sscanf(line,
-                       "%*d (%255[^)]) %c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu %llu %llu %llu %ld %ld %*s %*s %llu %llu %ld"
-                       " %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %d",
-                       comm, &state, &ppid, &utime, &stime, &cutime, &cstime,
-                       &priority, &niceval, &starttime, &vsize, &rss, &cpu);
-
-                unsigned int uid = 0;
-                snprintf(path, sizeof(path), "/proc/%ld/status", pid);
-                FILE *fs = fopen(path, "r");
-                if (fs) {
-                    char line2[256];
-                    while (fgets(line2, sizeof(line2), fs)) {
-                        if (strncmp(line2, "Uid:", 4) == 0) {
-                            sscanf(line2 + 4, "%u", &uid);
-                            break;
-                        }
-                    }
-                    fclose(fs);
-                }
-
-                unsigned long long old_utime = 0, old_stime = 0;
-                for (size_t i = 0; i < prev_count; i++) {
-                    if (prev_table[i].pid == pid && prev_table[i].tid == pid) {
-                        old_utime = prev_table[i].utime;
-                        old_stime = prev_table[i].stime;
-                        prev_table[i].utime = utime;
-                        prev_table[i].stime = stime;
-                        break;
-                    }
-                }
-                if (old_utime == 0 && old_stime == 0 && prev_count < MAX_PREV) {
-                    prev_table[prev_count].pid = pid;
-                    prev_table[prev_count].tid = pid;
-                    prev_table[prev_count].utime = utime;
-                    prev_table[prev_count].stime = stime;
-                    prev_count++;
-                }
-
-                unsigned long long delta = (utime - old_utime) + (stime - old_stime);
-                double usage = 100.0 * (double)delta / (double)total_delta;
-                if (get_cpu_irix_mode()) {
-                    size_t ncpu = get_cpu_core_count();
-                    if (ncpu > 0)
-                        usage *= (double)ncpu;
-                }
-                if (!show_idle && delta == 0) {
-                    fclose(fp);
-                    continue;
-                }
-
-                buf[count].pid = (int)pid;
-                buf[count].tid = (int)pid;
-                buf[count].ppid = ppid;
-                buf[count].uid = uid;
-                struct passwd *pw = getpwuid((uid_t)uid);
-                if (pw) {
-                    strncpy(buf[count].user, pw->pw_name, sizeof(buf[count].user) - 1);
-                    buf[count].user[sizeof(buf[count].user) - 1] = '\0';
-                } else {
-                    snprintf(buf[count].user, sizeof(buf[count].user), "%u", uid);
-                }
-                strncpy(buf[count].name, comm, sizeof(buf[count].name) - 1);
-                buf[count].name[sizeof(buf[count].name) - 1] = '\0';
-
-                snprintf(path, sizeof(path), "/proc/%ld/cmdline", pid);
-                FILE *fc = fopen(path, "r");
-                if (fc) {
-                    size_t r = fread(buf[count].cmdline, 1,
-                                     sizeof(buf[count].cmdline) - 1, fc);
-                    fclose(fc);
-                    size_t j = 0;
-                    for (size_t i = 0; i < r && j < sizeof(buf[count].cmdline) - 1; i++) {
-                        char c = buf[count].cmdline[i];
-                        if (c == '\0') {
-                            if (j > 0 && buf[count].cmdline[j - 1] != ' ')
-                                buf[count].cmdline[j++] = ' ';
-                        } else {
-                            buf[count].cmdline[j++] = c;
-                        }
-                    }
-                    if (j > 0 && buf[count].cmdline[j - 1] == ' ')
-                        j--; /* strip trailing space */
-                    buf[count].cmdline[j] = '\0';
-                } else {
-                    buf[count].cmdline[0] = '\0';
-                }
-
-                if (!match_filter((int)pid, buf[count].name, buf[count].user, state)) {
-                    fclose(fp);
-                    continue;
-                }
-
-                buf[count].state = state;
-                buf[count].priority = priority;
-                buf[count].nice = niceval;
-                buf[count].vsize = vsize;
-                long rss_kb = rss * page_kb;
-                buf[count].rss = rss_kb;
-                unsigned long long shared_kb = 0;
-                snprintf(path, sizeof(path), "/proc/%ld/statm", pid);
-                FILE *fm = fopen(path, "r");
-                if (fm) {
-                    unsigned long dummy, res, shr;
-                    if (fscanf(fm, "%lu %lu %lu", &dummy, &res, &shr) >= 3)
-                        shared_kb = shr * page_kb;
-                    fclose(fm);
-                }
-                buf[count].shared = shared_kb;
-                buf[count].rss_percent = 100.0 * (double)rss_kb /
-                                       (double)ms.total;
-                unsigned long long rb = 0, wb = 0;
-                snprintf(path, sizeof(path), "/proc/%ld/io", pid);
-                FILE *fio = fopen(path, "r");
-                if (fio) {
-                    char lineio[256];
-                    while (fgets(lineio, sizeof(lineio), fio)) {
-                        if (sscanf(lineio, "read_bytes: %llu", &rb) == 1)
-                            continue;
-                        if (sscanf(lineio, "write_bytes: %llu", &wb) == 1)
-                            continue;
-                    }
-                    fclose(fio);
-                }
-                buf[count].read_bytes = rb;
-                buf[count].write_bytes = wb;
-                buf[count].utime = utime;
-                buf[count].stime = stime;
-                buf[count].cpu_usage = usage;
-                unsigned long long tt = utime + stime;
-                if (get_show_accum_time())
-                    tt += cutime + cstime;
-                buf[count].cpu_time = (double)tt / (double)clk_tck;
-                time_t start_epoch = (time_t)(boot_time +
-                                             (double)starttime / (double)clk_tck);
-                struct tm *tm = localtime(&start_epoch);
-                if (tm)
-                    strftime(buf[count].start_time, sizeof(buf[count].start_time),
-                             "%H:%M:%S", tm);
-                else
-                    strncpy(buf[count].start_time, "??:??:??",
-                            sizeof(buf[count].start_time));
-                buf[count].start_timestamp = (double)start_epoch;
-                buf[count].cpu = cpu;
-                buf[count].level = 0;
-                count++;
-            }
-            fclose(fp);
+        } else if (read_task(pid, pid, &ctx, &buf[count]) == 0) {
+            count++;
         }
     }
+    scan_states.valid = ent == NULL;
     closedir(dir);
+    tasks_end_scan();
+    self_add_excl(SELF_ENUM, t, mark);
     return count;
 }
 
-int read_misc_stats(struct misc_stats *stats) {
-    FILE *fp = fopen("/proc/loadavg", "r");
-    if (!fp)
-        return -1;
+int read_load_stats(struct misc_stats *stats) {
+    char buf[256];
+    char path[PROC_PATH_MAX];
     double l1 = 0.0, l5 = 0.0, l15 = 0.0;
     int running = 0, total = 0;
-    if (fscanf(fp, "%lf %lf %lf %d/%d", &l1, &l5, &l15, &running, &total) < 5) {
-        fclose(fp);
+    snprintf(path, sizeof(path), "%s/loadavg", proc_root);
+    if (read_file(path, buf, sizeof(buf)) < 0 ||
+        sscanf(buf, "%lf %lf %lf %d/%d", &l1, &l5, &l15, &running, &total) < 5)
         return -1;
-    }
-    fclose(fp);
 
-    fp = fopen("/proc/uptime", "r");
-    if (!fp)
-        return -1;
     double up = 0.0;
-    if (fscanf(fp, "%lf", &up) != 1) {
-        fclose(fp);
+    snprintf(path, sizeof(path), "%s/uptime", proc_root);
+    if (read_file(path, buf, sizeof(buf)) < 0 ||
+        sscanf(buf, "%lf", &up) != 1)
+        return -1;
+    stats->load1 = l1;
+    stats->load5 = l5;
+    stats->load15 = l15;
+    stats->uptime = up;
+    stats->running_tasks = running;
+    stats->total_tasks = total;
+    return 0;
+}
+
+int read_misc_stats(struct misc_stats *stats) {
+    char buf[4096];
+    char path[PROC_PATH_MAX];
+    struct misc_stats load = {0};
+    if (read_load_stats(&load) != 0)
         return -1;
-    }
-    fclose(fp);
 
     int sleeping = 0;
     int stopped = 0;
     int zombie = 0;
-    DIR *dir = opendir("/proc");
+    uint64_t t = self_now();
+    uint64_t mark = t ? self_mark() : 0;
+    DIR *dir = NULL;
+    if (scan_states.valid) {
+        /* counted by the list_processes() call just before */
+        sleeping = scan_states.sleeping;
+        stopped = scan_states.stopped;
+        zombie = scan_states.zombie;
+        scan_states.valid = 0;
+    } else {
+        dir = open_dir(proc_root);
+    }
     if (dir) {
         struct dirent *ent;
         while ((ent = readdir(dir)) != NULL) {
@@ -761,48 +1443,34 @@ int read_misc_stats(struct misc_stats *stats) {
             long pid = strtol(ent->d_name, &endptr, 10);
             if (*endptr != '\0')
                 continue;
-            char path[64];
-            snprintf(path, sizeof(path), "/proc/%ld/status", pid);
-            FILE *fs = fopen(path, "r");
-            if (!fs)
+            snprintf(path, sizeof(path), "%s/%ld/status", proc_root, pid);
+            if (read_file(path, buf, sizeof(buf)) < 0)
                 continue;
-            char line[256];
-            while (fgets(line, sizeof(line), fs)) {
-                if (strncmp(line, "State:", 6) == 0) {
-                    char st;
-                    if (sscanf(line + 6, " %c", &st) == 1) {
-                        switch (st) {
-                        case 'R':
-                            break;
-                        case 'S':
-                        case 'D':
-                            sleeping++;
-                            break;
-                        case 'T':
-                        case 't':
-                            stopped++;
-                            break;
-                        case 'Z':
-                            zombie++;
-                            break;
-                        default:
-                            break;
-                        }
-                    }
-                    break;
-                }
+            const char *line = strstr(buf, "\nState:");
+            char st;
+            if (!line || sscanf(line + 7, " %c", &st) != 1)
+                continue;
+            switch (st) {
+            case 'S':
+            case 'D':
+                sleeping++;
+                break;
+            case 'T':
+            case 't':
+                stopped++;
+                break;
+            case 'Z':
+                zombie++;
+                break;
+            default:
+                break;
             }
-            fclose(fs);
         }
         closedir(dir);
     }
+    self_add_excl(SELF_ENUM, t, mark);
 
-    stats->load1 = l1;
-    stats->load5 = l5;
-    stats->load15 = l15;
-    stats->uptime = up;
-    stats->running_tasks = running;
-    stats->total_tasks = total;
+    *stats = load;
     stats->sleeping_tasks = sleeping;
     stats->stopped_tasks = stopped;
     stats->zombie_tasks = zombie;
@@ -911,3 +1579,86 @@ int cmp_proc_start(const void *a, const void *b) {
         res = -res;
     return res;
 }
+
+int cmp_proc_wait(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    int res = 0;
+    if (pa->wait_percent < pb->wait_percent)
+        res = -1;
+    else if (pa->wait_percent > pb->wait_percent)
+        res = 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
+
+int cmp_proc_pss(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    int res = 0;
+    if (pa->pss < pb->pss)
+        res = -1;
+    else if (pa->pss > pb->pss)
+        res = 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
+
+int cmp_proc_io(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    double ia = pa->read_rate + pa->write_rate;
+    double ib = pb->read_rate + pb->write_rate;
+    int res = 0;
+    if (ia < ib)
+        res = -1;
+    else if (ia > ib)
+        res = 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
+
+/* major faults first, they mean disk reads */
+int cmp_proc_faults(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    int res = 0;
+    if (pa->majflt_rate != pb->majflt_rate)
+        res = pa->majflt_rate < pb->majflt_rate ? -1 : 1;
+    else if (pa->minflt_rate != pb->minflt_rate)
+        res = pa->minflt_rate < pb->minflt_rate ? -1 : 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
+
+/* involuntary switches first, they mean tasks were preempted */
+int cmp_proc_ctxsw(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    int res = 0;
+    if (pa->ivcsw_rate != pb->ivcsw_rate)
+        res = pa->ivcsw_rate < pb->ivcsw_rate ? -1 : 1;
+    else if (pa->vcsw_rate != pb->vcsw_rate)
+        res = pa->vcsw_rate < pb->vcsw_rate ? -1 : 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
+
+/* throttled periods first, then throttled time */
+int cmp_proc_throttle(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    int res = 0;
+    if (pa->throttle_percent != pb->throttle_percent)
+        res = pa->throttle_percent < pb->throttle_percent ? -1 : 1;
+    else if (pa->throttle_ms != pb->throttle_ms)
+        res = pa->throttle_ms < pb->throttle_ms ? -1 : 1;
+    if (sort_descending)
+        res = -res;
+    return res;
+}
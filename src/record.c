@@ -0,0 +1,1071 @@
+#include "record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REC_MAGIC "VTOPREC"
+#define IDX_MAGIC "VTOPIDX"
+#define REC_VERSION 1
+#define HEADER_SIZE 32
+#define FOOTER_SIZE 24
+#define INDEX_ENTRY_SIZE 16
+
+#define FRAME_KEY 'K'
+#define FRAME_DELTA 'D'
+
+/* frame sections */
+enum {
+    SEC_SYSTEM = 1,
+    SEC_CORES = 2,
+    SEC_TASKS = 3,
+    SEC_DISKS = 4,
+    SEC_NETS = 5,
+    SEC_CORE_IDS = 6
+};
+
+
+/* task string presence flags */
+#define TF_USER 0x01
+#define TF_NAME 0x02
+#define TF_CMDLINE 0x04
+
+enum field_kind {
+    FK_INT,
+    FK_UINT,
+    FK_LONG,
+    FK_U64,
+    FK_CHAR,
+    FK_DOUBLE
+};
+
+/* Numeric values are stored through these tables. New fields must be
+ * appended so older recordings keep decoding; the header stores how many
+ * fields each frame carries. */
+struct field_desc {
+    size_t offset;
+    int kind;
+    /* fixed point scale for doubles */
+    int scale;
+};
+
+#define SYS_FIELD(m, k, s) { offsetof(struct snapshot, m), k, s }
+#define TASK_FIELD(m, k, s) { offsetof(struct process_info, m), k, s }
+
+static const struct field_desc sys_fields[] = {
+    SYS_FIELD(cpu.user, FK_U64, 1),
+    SYS_FIELD(cpu.nice, FK_U64, 1),
+    SYS_FIELD(cpu.system, FK_U64, 1),
+    SYS_FIELD(cpu.idle, FK_U64, 1),
+    SYS_FIELD(cpu.iowait, FK_U64, 1),
+    SYS_FIELD(cpu.irq, FK_U64, 1),
+    SYS_FIELD(cpu.softirq, FK_U64, 1),
+    SYS_FIELD(cpu.steal, FK_U64, 1),
+    SYS_FIELD(cpu.user_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.nice_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.system_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.idle_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.iowait_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.irq_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.softirq_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(cpu.steal_percent, FK_DOUBLE, 1000),
+    SYS_FIELD(mem.total, FK_U64, 1),
+    SYS_FIELD(mem.free, FK_U64, 1),
+    SYS_FIELD(mem.available, FK_U64, 1),
+    SYS_FIELD(mem.buffers, FK_U64, 1),
+    SYS_FIELD(mem.cached, FK_U64, 1),
+    SYS_FIELD(mem.swap_total, FK_U64, 1),
+    SYS_FIELD(mem.swap_used, FK_U64, 1),
+    SYS_FIELD(misc.load1, FK_DOUBLE, 100),
+    SYS_FIELD(misc.load5, FK_DOUBLE, 100),
+    SYS_FIELD(misc.load15, FK_DOUBLE, 100),
+    SYS_FIELD(misc.uptime, FK_DOUBLE, 100),
+    SYS_FIELD(misc.running_tasks, FK_INT, 1),
+    SYS_FIELD(misc.total_tasks, FK_INT, 1),
+    SYS_FIELD(misc.sleeping_tasks, FK_INT, 1),
+    SYS_FIELD(misc.stopped_tasks, FK_INT, 1),
+    SYS_FIELD(misc.zombie_tasks, FK_INT, 1),
+    SYS_FIELD(cpu_usage, FK_DOUBLE, 1000),
+    SYS_FIELD(psi.available, FK_INT, 1),
+    SYS_FIELD(psi.cpu.some_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.cpu.full_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.cpu.some_delta, FK_DOUBLE, 1),
+    SYS_FIELD(psi.cpu.full_delta, FK_DOUBLE, 1),
+    SYS_FIELD(psi.memory.some_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.memory.full_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.memory.some_delta, FK_DOUBLE, 1),
+    SYS_FIELD(psi.memory.full_delta, FK_DOUBLE, 1),
+    SYS_FIELD(psi.io.some_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.io.full_avg10, FK_DOUBLE, 100),
+    SYS_FIELD(psi.io.some_delta, FK_DOUBLE, 1),
+    SYS_FIELD(psi.io.full_delta, FK_DOUBLE, 1),
+    SYS_FIELD(mem.vm.available, FK_INT, 1),
+    SYS_FIELD(mem.vm.swap_in, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.swap_out, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.major_faults, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.scan_kswapd, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.scan_direct, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.steal_kswapd, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.steal_direct, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.alloc_stalls, FK_DOUBLE, 100),
+    SYS_FIELD(mem.vm.oom_kills, FK_DOUBLE, 100)
+};
+
+static const struct field_desc task_fields[] = {
+    TASK_FIELD(ppid, FK_INT, 1),
+    TASK_FIELD(uid, FK_UINT, 1),
+    TASK_FIELD(state, FK_CHAR, 1),
+    TASK_FIELD(priority, FK_LONG, 1),
+    TASK_FIELD(nice, FK_LONG, 1),
+    TASK_FIELD(vsize, FK_U64, 1),
+    TASK_FIELD(rss, FK_LONG, 1),
+    TASK_FIELD(shared, FK_U64, 1),
+    TASK_FIELD(rss_percent, FK_DOUBLE, 1000),
+    TASK_FIELD(utime, FK_U64, 1),
+    TASK_FIELD(stime, FK_U64, 1),
+    TASK_FIELD(cpu_usage, FK_DOUBLE, 1000),
+    TASK_FIELD(cpu_time, FK_DOUBLE, 100),
+    TASK_FIELD(read_bytes, FK_U64, 1),
+    TASK_FIELD(write_bytes, FK_U64, 1),
+    TASK_FIELD(start_timestamp, FK_DOUBLE, 1),
+    TASK_FIELD(cpu, FK_INT, 1),
+    TASK_FIELD(wait_percent, FK_DOUBLE, 1000),
+    TASK_FIELD(wait_slice, FK_DOUBLE, 1000),
+    TASK_FIELD(ipc, FK_DOUBLE, 1000),
+    TASK_FIELD(mpki, FK_DOUBLE, 1000),
+    TASK_FIELD(pss, FK_LONG, 1),
+    TASK_FIELD(uss, FK_LONG, 1),
+    TASK_FIELD(swap_pss, FK_LONG, 1),
+    TASK_FIELD(read_rate, FK_DOUBLE, 1),
+    TASK_FIELD(write_rate, FK_DOUBLE, 1),
+    TASK_FIELD(syscr_rate, FK_DOUBLE, 10),
+    TASK_FIELD(syscw_rate, FK_DOUBLE, 10),
+    TASK_FIELD(minflt_rate, FK_DOUBLE, 10),
+    TASK_FIELD(majflt_rate, FK_DOUBLE, 10),
+    TASK_FIELD(vcsw_rate, FK_DOUBLE, 10),
+    TASK_FIELD(ivcsw_rate, FK_DOUBLE, 10),
+    TASK_FIELD(throttle_percent, FK_DOUBLE, 1000),
+    TASK_FIELD(throttle_ms, FK_DOUBLE, 1000)
+};
+
+#define DISK_FIELD(m, s) { offsetof(struct disk_info, m), FK_DOUBLE, s }
+
+static const struct field_desc disk_fields[] = {
+    DISK_FIELD(read_iops, 100),
+    DISK_FIELD(write_iops, 100),
+    DISK_FIELD(read_rate, 1),
+    DISK_FIELD(write_rate, 1),
+    DISK_FIELD(await, 100),
+    DISK_FIELD(util, 100)
+};
+
+#define NET_FIELD(m, s) { offsetof(struct net_info, m), FK_DOUBLE, s }
+
+static const struct field_desc net_fields[] = {
+    NET_FIELD(rx_rate, 1),
+    NET_FIELD(tx_rate, 1),
+    NET_FIELD(rx_packets, 100),
+    NET_FIELD(tx_packets, 100),
+    NET_FIELD(rx_drops, 100),
+    NET_FIELD(tx_drops, 100),
+    NET_FIELD(rx_errors, 100),
+    NET_FIELD(tx_errors, 100)
+};
+
+#define SYS_FIELD_COUNT (sizeof(sys_fields) / sizeof(sys_fields[0]))
+#define TASK_FIELD_COUNT (sizeof(task_fields) / sizeof(task_fields[0]))
+#define DISK_FIELD_COUNT (sizeof(disk_fields) / sizeof(disk_fields[0]))
+#define NET_FIELD_COUNT (sizeof(net_fields) / sizeof(net_fields[0]))
+
+static uint64_t load_field(const void *base, const struct field_desc *f) {
+    const char *p = (const char *)base + f->offset;
+    switch (f->kind) {
+    case FK_INT:
+        return (uint64_t)(int64_t)*(const int *)p;
+    case FK_UINT:
+        return *(const unsigned int *)p;
+    case FK_LONG:
+        return (uint64_t)(int64_t)*(const long *)p;
+    case FK_U64:
+        return *(const unsigned long long *)p;
+    case FK_CHAR:
+        return (uint64_t)(int64_t)*(const char *)p;
+    case FK_DOUBLE: {
+        double d = *(const double *)p * f->scale;
+        return (uint64_t)(int64_t)(d < 0 ? d - 0.5 : d + 0.5);
+    }
+    default:
+        return 0;
+    }
+}
+
+static void store_field(void *base, const struct field_desc *f, uint64_t v) {
+    char *p = (char *)base + f->offset;
+    switch (f->kind) {
+    case FK_INT:
+        *(int *)p = (int)(int64_t)v;
+        break;
+    case FK_UINT:
+        *(unsigned int *)p = (unsigned int)v;
+        break;
+    case FK_LONG:
+        *(long *)p = (long)(int64_t)v;
+        break;
+    case FK_U64:
+        *(unsigned long long *)p = v;
+        break;
+    case FK_CHAR:
+        *(char *)p = (char)(int64_t)v;
+        break;
+    case FK_DOUBLE:
+        *(double *)p = (double)(int64_t)v / f->scale;
+        break;
+    default:
+        break;
+    }
+}
+
+/* growable output buffer */
+struct buf {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+};
+
+static int buf_reserve(struct buf *b, size_t extra) {
+    if (b->failed)
+        return -1;
+    if (b->len + extra <= b->cap)
+        return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra)
+        cap *= 2;
+    unsigned char *tmp = realloc(b->data, cap);
+    if (!tmp) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = tmp;
+    b->cap = cap;
+    return 0;
+}
+
+static void put_bytes(struct buf *b, const void *src, size_t n) {
+    if (buf_reserve(b, n) != 0)
+        return;
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+static void put_byte(struct buf *b, unsigned char c) {
+    put_bytes(b, &c, 1);
+}
+
+static void put_varint(struct buf *b, uint64_t v) {
+    unsigned char tmp[10];
+    size_t n = 0;
+    while (v >= 0x80) {
+        tmp[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    tmp[n++] = (unsigned char)v;
+    put_bytes(b, tmp, n);
+}
+
+static void put_svarint(struct buf *b, int64_t v) {
+    put_varint(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_string(struct buf *b, const char *s) {
+    size_t n = strlen(s);
+    put_varint(b, n);
+    put_bytes(b, s, n);
+}
+
+static void put_fields(struct buf *b, const struct field_desc *fields,
+                       size_t n, const void *cur, const void *base) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = load_field(cur, &fields[i]);
+        uint64_t old = base ? load_field(base, &fields[i]) : 0;
+        put_svarint(b, (int64_t)(v - old));
+    }
+}
+
+static void put_le(unsigned char *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_le(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+/* bounds checked input cursor */
+struct reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int failed;
+};
+
+static uint64_t get_varint(struct reader *r) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (r->p < r->end && shift < 64) {
+        unsigned char c = *r->p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return v;
+        shift += 7;
+    }
+    r->failed = 1;
+    return 0;
+}
+
+static int64_t get_svarint(struct reader *r) {
+    uint64_t v = get_varint(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static unsigned char get_byte(struct reader *r) {
+    if (r->p >= r->end) {
+        r->failed = 1;
+        return 0;
+    }
+    return *r->p++;
+}
+
+static void get_string(struct reader *r, char *dst, size_t size) {
+    uint64_t n = get_varint(r);
+    if (r->failed || n > (uint64_t)(r->end - r->p) || n >= size) {
+        r->failed = 1;
+        dst[0] = '\0';
+        return;
+    }
+    memcpy(dst, r->p, n);
+    dst[n] = '\0';
+    r->p += n;
+}
+
+static void get_fields(struct reader *r, const struct field_desc *fields,
+                       size_t known, size_t present, void *out,
+                       const void *base) {
+    for (size_t i = 0; i < present; i++) {
+        int64_t d = get_svarint(r);
+        if (i >= known)
+            continue;
+        uint64_t old = base ? load_field(base, &fields[i]) : 0;
+        store_field(out, &fields[i], old + (uint64_t)d);
+    }
+}
+
+static int cmp_task_id(const void *a, const void *b) {
+    const struct process_info *pa = a;
+    const struct process_info *pb = b;
+    if (pa->pid != pb->pid)
+        return pa->pid < pb->pid ? -1 : 1;
+    if (pa->tid != pb->tid)
+        return pa->tid < pb->tid ? -1 : 1;
+    return 0;
+}
+
+static long long snapshot_ms(const struct snapshot *s) {
+    return (long long)(s->timestamp * 1000.0 + 0.5);
+}
+
+/* Write the devices of a section: their count and field count, then
+ * per device a flag, the name when the slot changed hands since base
+ * (or always in a keyframe), and the fields. Devices start with their
+ * name. */
+static void put_devices(struct buf *b, const struct field_desc *fields,
+                        size_t nfields, const void *cur, size_t count,
+                        const void *base, size_t base_count, size_t size) {
+    put_varint(b, count);
+    put_varint(b, nfields);
+    for (size_t i = 0; i < count; i++) {
+        const char *d = (const char *)cur + i * size;
+        const char *old = NULL;
+        if (base && i < base_count &&
+            strcmp((const char *)base + i * size, d) == 0)
+            old = (const char *)base + i * size;
+        put_byte(b, old == NULL);
+        if (!old)
+            put_string(b, d);
+        put_fields(b, fields, nfields, d, old);
+    }
+}
+
+/* Read count devices into items, which hold the prev devices of the
+ * previous frame. Returns 0 on success. */
+static int get_devices(struct reader *r, const struct field_desc *fields,
+                       size_t known, void *items, size_t count, size_t prev,
+                       size_t size, size_t name_size) {
+    uint64_t present = get_varint(r);
+    for (size_t i = 0; i < count && !r->failed; i++) {
+        char *d = (char *)items + i * size;
+        int renamed = get_byte(r);
+        if (renamed) {
+            /* fields an older writer did not have read as 0 */
+            memset(d, 0, size);
+            get_string(r, d, name_size);
+        }
+        else if (i >= prev)
+            return -1;
+        get_fields(r, fields, known, present, d, renamed ? NULL : d);
+    }
+    return r->failed ? -1 : 0;
+}
+
+/* Whether the CPU numbers of cur need a section: they differ from base,
+ * or for a keyframe from the positions a reader assumes without one. */
+static int core_ids_changed(const struct snapshot *cur,
+                            const struct snapshot *base) {
+    if (base && base->core_count != cur->core_count)
+        return 1;
+    for (size_t i = 0; i < cur->core_count; i++) {
+        unsigned int old = base ? base->core_id[i] : (unsigned int)i;
+        if (cur->core_id[i] != old)
+            return 1;
+    }
+    return 0;
+}
+
+/* Encode cur as a frame payload. Tasks in cur must be ordered by pid/tid.
+ * When base is NULL a keyframe is produced. */
+static void encode_frame(struct buf *b, const struct snapshot *cur,
+                         const struct snapshot *base) {
+    struct buf sec = {0};
+    long long ms = snapshot_ms(cur);
+    put_svarint(b, base ? ms - snapshot_ms(base) : ms);
+
+    put_fields(&sec, sys_fields, SYS_FIELD_COUNT, cur, base);
+    put_varint(b, SEC_SYSTEM);
+    put_varint(b, sec.len);
+    put_bytes(b, sec.data, sec.len);
+
+    sec.len = 0;
+    put_varint(&sec, cur->core_count);
+    for (size_t i = 0; i < cur->core_count; i++) {
+        int64_t v = (int64_t)(cur->core_usage[i] * 1000.0 + 0.5);
+        int64_t old = 0;
+        if (base && i < base->core_count)
+            old = (int64_t)(base->core_usage[i] * 1000.0 + 0.5);
+        put_svarint(&sec, v - old);
+    }
+    put_varint(b, SEC_CORES);
+    put_varint(b, sec.len);
+    put_bytes(b, sec.data, sec.len);
+
+    /* each id as the gap after the previous one, 0 for consecutive CPUs */
+    if (core_ids_changed(cur, base)) {
+        sec.len = 0;
+        put_varint(&sec, cur->core_count);
+        for (size_t i = 0; i < cur->core_count; i++) {
+            unsigned int next = i ? cur->core_id[i - 1] + 1 : 0;
+            put_varint(&sec, cur->core_id[i] - next);
+        }
+        put_varint(b, SEC_CORE_IDS);
+        put_varint(b, sec.len);
+        put_bytes(b, sec.data, sec.len);
+    }
+
+    sec.len = 0;
+    put_devices(&sec, disk_fields, DISK_FIELD_COUNT, cur->disks,
+                cur->disk_count, base ? base->disks : NULL,
+                base ? base->disk_count : 0, sizeof(*cur->disks));
+    put_varint(b, SEC_DISKS);
+    put_varint(b, sec.len);
+    put_bytes(b, sec.data, sec.len);
+
+    sec.len = 0;
+    put_devices(&sec, net_fields, NET_FIELD_COUNT, cur->nets,
+                cur->net_count, base ? base->nets : NULL,
+                base ? base->net_count : 0, sizeof(*cur->nets));
+    put_varint(b, SEC_NETS);
+    put_varint(b, sec.len);
+    put_bytes(b, sec.data, sec.len);
+
+    sec.len = 0;
+    put_varint(&sec, cur->count);
+    size_t j = 0;
+    int last_pid = 0;
+    for (size_t i = 0; i < cur->count; i++) {
+        const struct process_info *p = &cur->procs[i];
+        const struct process_info *old = NULL;
+        while (base && j < base->count && cmp_task_id(&base->procs[j], p) < 0)
+            j++;
+        if (base && j < base->count && cmp_task_id(&base->procs[j], p) == 0)
+            old = &base->procs[j];
+        put_svarint(&sec, (int64_t)p->pid - last_pid);
+        put_svarint(&sec, (int64_t)p->tid - p->pid);
+        last_pid = p->pid;
+        unsigned char flags = 0;
+        if (!old || strcmp(old->user, p->user) != 0)
+            flags |= TF_USER;
+        if (!old || strcmp(old->name, p->name) != 0)
+            flags |= TF_NAME;
+        if (!old || strcmp(old->cmdline, p->cmdline) != 0)
+            flags |= TF_CMDLINE;
+        put_byte(&sec, flags);
+        if (flags & TF_USER)
+            put_string(&sec, p->user);
+        if (flags & TF_NAME)
+            put_string(&sec, p->name);
+        if (flags & TF_CMDLINE)
+            put_string(&sec, p->cmdline);
+        put_fields(&sec, task_fields, TASK_FIELD_COUNT, p, old);
+    }
+    put_varint(b, SEC_TASKS);
+    put_varint(b, sec.len);
+    put_bytes(b, sec.data, sec.len);
+    if (sec.failed)
+        b->failed = 1;
+    free(sec.data);
+}
+
+/* ---- writer ---- */
+
+struct index_entry {
+    uint64_t offset;
+    long long ms;
+    int key;
+};
+
+static FILE *rec_fp;
+static uint64_t rec_offset;
+static struct index_entry *rec_index;
+static size_t rec_frames;
+static size_t rec_index_cap;
+static struct snapshot rec_prev;
+static struct snapshot rec_cur;
+static struct buf rec_buf;
+
+int record_active(void) { return rec_fp != NULL; }
+
+int record_open(const char *path) {
+    if (rec_fp)
+        record_close();
+    rec_fp = fopen(path, "wb");
+    if (!rec_fp)
+        return -1;
+    unsigned char hdr[HEADER_SIZE] = {0};
+    memcpy(hdr, REC_MAGIC, sizeof(REC_MAGIC));
+    put_le(hdr + 8, REC_VERSION, 2);
+    put_le(hdr + 10, SYS_FIELD_COUNT, 2);
+    put_le(hdr + 12, TASK_FIELD_COUNT, 2);
+    put_le(hdr + 14, RECORD_KEYFRAME_INTERVAL, 2);
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0)
+        clk_tck = 100;
+    put_le(hdr + 16, (uint64_t)clk_tck, 4);
+    put_le(hdr + 24, (uint64_t)time(NULL), 8);
+    if (fwrite(hdr, 1, sizeof(hdr), rec_fp) != sizeof(hdr)) {
+        fclose(rec_fp);
+        rec_fp = NULL;
+        return -1;
+    }
+    rec_offset = sizeof(hdr);
+    rec_frames = 0;
+    return 0;
+}
+
+int record_frame(const struct snapshot *s) {
+    if (!rec_fp)
+        return -1;
+    if (rec_frames == rec_index_cap) {
+        size_t cap = rec_index_cap ? rec_index_cap * 2 : 1024;
+        struct index_entry *tmp = realloc(rec_index, cap * sizeof(*tmp));
+        if (!tmp)
+            return -1;
+        rec_index = tmp;
+        rec_index_cap = cap;
+    }
+    if (snapshot_copy(&rec_cur, s) != 0)
+        return -1;
+    qsort(rec_cur.procs, rec_cur.count, sizeof(*rec_cur.procs), cmp_task_id);
+
+    int key = rec_frames % RECORD_KEYFRAME_INTERVAL == 0;
+    rec_buf.len = 0;
+    rec_buf.failed = 0;
+    encode_frame(&rec_buf, &rec_cur, key ? NULL : &rec_prev);
+    if (rec_buf.failed)
+        return -1;
+
+    struct buf head = {0};
+    put_byte(&head, key ? FRAME_KEY : FRAME_DELTA);
+    put_varint(&head, rec_buf.len);
+    if (head.failed ||
+        fwrite(head.data, 1, head.len, rec_fp) != head.len ||
+        fwrite(rec_buf.data, 1, rec_buf.len, rec_fp) != rec_buf.len) {
+        free(head.data);
+        return -1;
+    }
+    fflush(rec_fp);
+    rec_index[rec_frames].offset = rec_offset;
+    rec_index[rec_frames].ms = snapshot_ms(&rec_cur);
+    rec_index[rec_frames].key = key;
+    rec_frames++;
+    rec_offset += head.len + rec_buf.len;
+    free(head.data);
+
+    struct snapshot tmp = rec_prev;
+    rec_prev = rec_cur;
+    rec_cur = tmp;
+    return 0;
+}
+
+void record_close(void) {
+    if (!rec_fp)
+        return;
+    unsigned char ent[INDEX_ENTRY_SIZE];
+    for (size_t i = 0; i < rec_frames; i++) {
+        put_le(ent, rec_index[i].offset, 8);
+        put_le(ent + 8, ((uint64_t)rec_index[i].ms << 1) | (rec_index[i].key ? 1 : 0), 8);
+        fwrite(ent, 1, sizeof(ent), rec_fp);
+    }
+    unsigned char foot[FOOTER_SIZE] = {0};
+    put_le(foot, rec_offset, 8);
+    put_le(foot + 8, rec_frames, 8);
+    memcpy(foot + 16, IDX_MAGIC, sizeof(IDX_MAGIC));
+    fwrite(foot, 1, sizeof(foot), rec_fp);
+    fclose(rec_fp);
+    rec_fp = NULL;
+    free(rec_index);
+    rec_index = NULL;
+    rec_index_cap = 0;
+    rec_frames = 0;
+    free(rec_buf.data);
+    memset(&rec_buf, 0, sizeof(rec_buf));
+    snapshot_free(&rec_prev);
+    snapshot_free(&rec_cur);
+}
+
+/* ---- reader ---- */
+
+struct recording {
+    int fd;
+    const unsigned char *map;
+    size_t size;
+    size_t sys_fields;
+    size_t task_fields;
+    long clk_tck;
+    struct index_entry *index;
+    size_t frames;
+};
+
+static int load_index(struct recording *rec) {
+    if (rec->size < HEADER_SIZE + FOOTER_SIZE)
+        return -1;
+    const unsigned char *foot = rec->map + rec->size - FOOTER_SIZE;
+    if (memcmp(foot + 16, IDX_MAGIC, sizeof(IDX_MAGIC)) != 0)
+        return -1;
+    uint64_t off = get_le(foot, 8);
+    uint64_t n = get_le(foot + 8, 8);
+    if (off < HEADER_SIZE || off > rec->size - FOOTER_SIZE ||
+        n != (rec->size - FOOTER_SIZE - off) / INDEX_ENTRY_SIZE)
+        return -1;
+    rec->index = calloc(n ? n : 1, sizeof(*rec->index));
+    if (!rec->index)
+        return -1;
+    const unsigned char *p = rec->map + off;
+    for (uint64_t i = 0; i < n; i++, p += INDEX_ENTRY_SIZE) {
+        uint64_t v = get_le(p + 8, 8);
+        rec->index[i].offset = get_le(p, 8);
+        rec->index[i].ms = (long long)(v >> 1);
+        rec->index[i].key = (int)(v & 1);
+        if (rec->index[i].offset >= off) {
+            free(rec->index);
+            rec->index = NULL;
+            return -1;
+        }
+    }
+    rec->frames = n;
+    return 0;
+}
+
+/* Rebuild the index of a recording that was not closed cleanly. A
+ * trailing partial frame is ignored. */
+static int scan_index(struct recording *rec) {
+    size_t cap = 0;
+    uint64_t off = HEADER_SIZE;
+    long long ms = 0;
+    rec->frames = 0;
+    while (off < rec->size) {
+        struct reader r = { rec->map + off, rec->map + rec->size, 0 };
+        unsigned char type = get_byte(&r);
+        if (type != FRAME_KEY && type != FRAME_DELTA)
+            break;
+        if (type == FRAME_DELTA && rec->frames == 0)
+            break;
+        uint64_t len = get_varint(&r);
+        if (r.failed || len > (uint64_t)(r.end - r.p))
+            break;
+        struct reader body = { r.p, r.p + len, 0 };
+        int64_t d = get_svarint(&body);
+        if (body.failed)
+            break;
+        ms = type == FRAME_KEY ? d : ms + d;
+        if (rec->frames == cap) {
+            cap = cap ? cap * 2 : 1024;
+            struct index_entry *tmp = realloc(rec->index, cap * sizeof(*tmp));
+            if (!tmp)
+                return -1;
+            rec->index = tmp;
+        }
+        rec->index[rec->frames].offset = off;
+        rec->index[rec->frames].ms = ms;
+        rec->index[rec->frames].key = type == FRAME_KEY;
+        rec->frames++;
+        off = (uint64_t)(r.p - rec->map) + len;
+    }
+    return 0;
+}
+
+struct recording *recording_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    struct recording *rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+    rec->fd = fd;
+    rec->map = map;
+    rec->size = (size_t)st.st_size;
+    if (memcmp(rec->map, REC_MAGIC, sizeof(REC_MAGIC)) != 0 ||
+        get_le(rec->map + 8, 2) != REC_VERSION) {
+        recording_close(rec);
+        return NULL;
+    }
+    rec->sys_fields = (size_t)get_le(rec->map + 10, 2);
+    rec->task_fields = (size_t)get_le(rec->map + 12, 2);
+    rec->clk_tck = (long)get_le(rec->map + 16, 4);
+    if (rec->clk_tck <= 0)
+        rec->clk_tck = 100;
+    if (load_index(rec) != 0 && scan_index(rec) != 0) {
+        recording_close(rec);
+        return NULL;
+    }
+    madvise((void *)rec->map, rec->size, MADV_SEQUENTIAL);
+    return rec;
+}
+
+void recording_close(struct recording *rec) {
+    if (!rec)
+        return;
+    munmap((void *)rec->map, rec->size);
+    close(rec->fd);
+    free(rec->index);
+    free(rec);
+}
+
+size_t recording_frame_count(const struct recording *rec) { return rec->frames; }
+
+double recording_frame_time(const struct recording *rec, size_t idx) {
+    if (idx >= rec->frames)
+        return 0.0;
+    return (double)rec->index[idx].ms / 1000.0;
+}
+
+int recording_is_keyframe(const struct recording *rec, size_t idx) {
+    return idx < rec->frames && rec->index[idx].key;
+}
+
+long recording_clk_tck(const struct recording *rec) { return rec->clk_tck; }
+
+size_t recording_find_time(const struct recording *rec, double t) {
+    long long ms = (long long)(t * 1000.0);
+    size_t lo = 0, hi = rec->frames;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (rec->index[mid].ms <= ms)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+int recording_parse_time(const struct recording *rec, const char *arg,
+                         double ref, double *out) {
+    int h, m, sec;
+    char *end;
+    if (!arg || !*arg)
+        return -1;
+    if (sscanf(arg, "%d:%d:%d", &h, &m, &sec) == 3) {
+        time_t t = (time_t)ref;
+        struct tm tm;
+        if (!localtime_r(&t, &tm))
+            return -1;
+        tm.tm_hour = h;
+        tm.tm_min = m;
+        tm.tm_sec = sec;
+        tm.tm_isdst = -1;
+        *out = (double)mktime(&tm);
+        return 0;
+    }
+    double v = strtod(arg, &end);
+    if (*end != '\0')
+        return -1;
+    if (arg[0] == '+' || arg[0] == '-')
+        *out = ref + v;
+    else if (v < 1e9)
+        *out = recording_frame_time(rec, 0) + v;
+    else
+        *out = v;
+    return 0;
+}
+
+void replay_cursor_init(struct replay_cursor *c, const struct recording *rec) {
+    memset(c, 0, sizeof(*c));
+    c->rec = rec;
+    c->pos = (size_t)-1;
+}
+
+void replay_cursor_free(struct replay_cursor *c) {
+    snapshot_free(&c->snap);
+    free(c->scratch);
+    c->scratch = NULL;
+    c->scratch_cap = 0;
+    c->pos = (size_t)-1;
+}
+
+static int decode_tasks(struct replay_cursor *c, struct reader *r, int key,
+                        size_t task_n) {
+    uint64_t n = get_varint(r);
+    if (r->failed || n > (uint64_t)(r->end - r->p))
+        return -1;
+    if (n > c->scratch_cap) {
+        struct process_info *tmp = realloc(c->scratch, n * sizeof(*tmp));
+        if (!tmp)
+            return -1;
+        c->scratch = tmp;
+        c->scratch_cap = n;
+    }
+    const struct process_info *prev = key ? NULL : c->snap.procs;
+    size_t prev_count = key ? 0 : c->snap.count;
+    size_t j = 0;
+    int pid = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        struct process_info *p = &c->scratch[i];
+        pid += (int)get_svarint(r);
+        int tid = pid + (int)get_svarint(r);
+        unsigned char flags = get_byte(r);
+        if (r->failed)
+            return -1;
+        struct process_info id = { .pid = pid, .tid = tid };
+        while (j < prev_count && cmp_task_id(&prev[j], &id) < 0)
+            j++;
+        const struct process_info *old = NULL;
+        if (j < prev_count && cmp_task_id(&prev[j], &id) == 0)
+            old = &prev[j];
+        if (old)
+            *p = *old;
+        else
+            memset(p, 0, sizeof(*p));
+        p->pid = pid;
+        p->tid = tid;
+        if (flags & TF_USER)
+            get_string(r, p->user, sizeof(p->user));
+        if (flags & TF_NAME)
+            get_string(r, p->name, sizeof(p->name));
+        if (flags & TF_CMDLINE)
+            get_string(r, p->cmdline, sizeof(p->cmdline));
+        get_fields(r, task_fields, TASK_FIELD_COUNT, task_n, p, old);
+        if (r->failed)
+            return -1;
+        if (!old || old->start_timestamp != p->start_timestamp) {
+            time_t start = (time_t)p->start_timestamp;
+            struct tm tm;
+            if (localtime_r(&start, &tm))
+                strftime(p->start_time, sizeof(p->start_time), "%H:%M:%S", &tm);
+            else
+                strncpy(p->start_time, "??:??:??", sizeof(p->start_time));
+        }
+        p->level = 0;
+    }
+    struct process_info *tmp = c->snap.procs;
+    size_t tmp_cap = c->snap.proc_cap;
+    c->snap.procs = c->scratch;
+    c->snap.proc_cap = c->scratch_cap;
+    c->snap.count = (size_t)n;
+    c->scratch = tmp;
+    c->scratch_cap = tmp_cap;
+    return 0;
+}
+
+/* Decode the sections of a frame payload into c->snap. sys_n and task_n
+ * are the field counts of the writer. */
+static int decode_sections(struct replay_cursor *c, struct reader *r, int key,
+                           size_t sys_n, size_t task_n) {
+    struct snapshot *s = &c->snap;
+    if (key) {
+        s->core_count = 0;
+        s->disk_count = 0;
+        s->net_count = 0;
+        s->count = 0;
+    }
+    while (!r->failed && r->p < r->end) {
+        uint64_t tag = get_varint(r);
+        uint64_t slen = get_varint(r);
+        if (r->failed || slen > (uint64_t)(r->end - r->p))
+            return -1;
+        struct reader sec = { r->p, r->p + slen, 0 };
+        r->p += slen;
+        switch (tag) {
+        case SEC_SYSTEM:
+            get_fields(&sec, sys_fields, SYS_FIELD_COUNT, sys_n,
+                       s, key ? NULL : s);
+            break;
+        case SEC_CORES: {
+            uint64_t n = get_varint(&sec);
+            if (sec.failed || n > slen ||
+                snapshot_reserve_cores(s, (size_t)n) != 0)
+                return -1;
+            for (uint64_t i = 0; i < n; i++) {
+                int64_t old = 0;
+                if (!key && i < s->core_count)
+                    old = (int64_t)(s->core_usage[i] * 1000.0 + 0.5);
+                s->core_usage[i] = (double)(old + get_svarint(&sec)) / 1000.0;
+                /* positions until a core id section says otherwise */
+                if (key || i >= s->core_count)
+                    s->core_id[i] = (unsigned int)i;
+            }
+            s->core_count = (size_t)n;
+            break;
+        }
+        case SEC_CORE_IDS: {
+            uint64_t n = get_varint(&sec);
+            if (sec.failed || n != s->core_count)
+                return -1;
+            for (uint64_t i = 0; i < n; i++)
+                s->core_id[i] = (unsigned int)get_varint(&sec) +
+                                (i ? s->core_id[i - 1] + 1 : 0);
+            break;
+        }
+        case SEC_DISKS: {
+            uint64_t n = get_varint(&sec);
+            if (sec.failed || n > slen ||
+                snapshot_reserve_disks(s, (size_t)n) != 0)
+                return -1;
+            if (get_devices(&sec, disk_fields, DISK_FIELD_COUNT, s->disks,
+                            (size_t)n, key ? 0 : s->disk_count,
+                            sizeof(*s->disks), sizeof(s->disks->name)) != 0)
+                return -1;
+            s->disk_count = (size_t)n;
+            break;
+        }
+        case SEC_NETS: {
+            uint64_t n = get_varint(&sec);
+            if (sec.failed || n > slen ||
+                snapshot_reserve_nets(s, (size_t)n) != 0)
+                return -1;
+            if (get_devices(&sec, net_fields, NET_FIELD_COUNT, s->nets,
+                            (size_t)n, key ? 0 : s->net_count,
+                            sizeof(*s->nets), sizeof(s->nets->name)) != 0)
+                return -1;
+            s->net_count = (size_t)n;
+            break;
+        }
+        case SEC_TASKS:
+            if (decode_tasks(c, &sec, key, task_n) != 0)
+                return -1;
+            break;
+        default:
+            /* unknown section from a newer writer */
+            break;
+        }
+        if (sec.failed)
+            return -1;
+    }
+    return r->failed ? -1 : 0;
+}
+
+static int decode_frame(struct replay_cursor *c, size_t idx) {
+    const struct recording *rec = c->rec;
+    const struct index_entry *e = &rec->index[idx];
+    struct reader r = { rec->map + e->offset, rec->map + rec->size, 0 };
+    get_byte(&r);
+    uint64_t len = get_varint(&r);
+    if (r.failed || len > (uint64_t)(r.end - r.p))
+        return -1;
+    r.end = r.p + len;
+    get_svarint(&r); /* timestamp, already in the index */
+    if (decode_sections(c, &r, e->key, rec->sys_fields, rec->task_fields) != 0)
+        return -1;
+    c->snap.timestamp = (double)e->ms / 1000.0;
+    return 0;
+}
+
+/* ---- standalone keyframes ---- */
+
+void record_field_counts(size_t *sys_n, size_t *task_n) {
+    *sys_n = SYS_FIELD_COUNT;
+    *task_n = TASK_FIELD_COUNT;
+}
+
+int record_encode_keyframe(struct snapshot *s, unsigned char **data,
+                           size_t *len, size_t *cap) {
+    struct buf b = { *data, 0, *cap, 0 };
+    qsort(s->procs, s->count, sizeof(*s->procs), cmp_task_id);
+    encode_frame(&b, s, NULL);
+    *data = b.data;
+    *cap = b.cap;
+    *len = b.len;
+    return b.failed ? -1 : 0;
+}
+
+int record_decode_keyframe(struct replay_cursor *c, const void *data,
+                           size_t len, size_t sys_n, size_t task_n) {
+    struct reader r = { data, (const unsigned char *)data + len, 0 };
+    long long ms = get_svarint(&r);
+    c->pos = (size_t)-1;
+    if (r.failed || decode_sections(c, &r, 1, sys_n, task_n) != 0)
+        return -1;
+    c->snap.timestamp = (double)ms / 1000.0;
+    return 0;
+}
+
+int replay_seek(struct replay_cursor *c, size_t idx) {
+    const struct recording *rec = c->rec;
+    if (idx >= rec->frames)
+        return -1;
+    if (c->pos == idx)
+        return 0;
+    size_t start = idx;
+    while (start > 0 && !rec->index[start].key)
+        start--;
+    if (!rec->index[start].key)
+        return -1;
+    if (c->pos != (size_t)-1 && c->pos < idx && c->pos >= start)
+        start = c->pos + 1;
+    for (size_t i = start; i <= idx; i++) {
+        if (decode_frame(c, i) != 0) {
+            c->pos = (size_t)-1;
+            return -1;
+        }
+        c->pos = i;
+    }
+    return 0;
+}
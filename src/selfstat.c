@@ -0,0 +1,41 @@
+#include "selfstat.h"
+#include <stdio.h>
+#include <string.h>
+
+int self_enabled;
+struct self_stats self_cur;
+static struct self_stats self_prev;
+
+static const char *const phase_names[SELF_PHASE_COUNT] = {
+    "enum", "read", "parse", "user", "sort", "forest", "render"
+};
+
+void self_set_enabled(int on) {
+    self_enabled = on != 0;
+    memset(&self_cur, 0, sizeof(self_cur));
+}
+
+void self_end_refresh(void) {
+    self_prev = self_cur;
+    memset(&self_cur, 0, sizeof(self_cur));
+}
+
+const struct self_stats *self_last(void) { return &self_prev; }
+
+void self_format(char *buf, size_t size) {
+    const struct self_stats *s = &self_prev;
+    uint64_t total = 0;
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < SELF_PHASE_COUNT; i++) {
+        total += s->ns[i];
+        int n = snprintf(buf + len, size - len, "%s%s %.2fms",
+                         i ? " " : "self ", phase_names[i], s->ns[i] / 1e6);
+        if (n < 0 || (size_t)n >= size - len)
+            return;
+        len += (size_t)n;
+    }
+    snprintf(buf + len, size - len,
+             "  total %.2fms  %lu opens %lu reads %lu tasks",
+             total / 1e6, s->opens, s->reads, s->tasks);
+}
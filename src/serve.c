@@ -0,0 +1,662 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include "snapshot.h"
+#include "budget.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 64
+/* clients that do not finish within this many seconds are dropped */
+#define CLIENT_TIMEOUT 10.0
+
+/* A rendered response. Clients keep a reference while sending, so a new
+ * render never touches bytes that are still being written. */
+struct payload {
+    char *data;
+    size_t len;
+    size_t cap;
+    int refs;
+};
+
+struct client {
+    int fd;
+    char req[2048];
+    size_t req_len;
+    /* response header and body, NULL while the request is read */
+    char head[256];
+    size_t head_len;
+    struct payload *body;
+    size_t sent;
+    double since;
+};
+
+/* One exported per-process series, possibly the sum of several tasks */
+struct series {
+    size_t label;
+    double cpu_seconds;
+    double cpu_ratio;
+    double rss_bytes;
+    double read_bytes;
+    double write_bytes;
+    int keep;
+};
+
+static volatile sig_atomic_t serve_stop;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+static double now_mono(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int out_reserve(struct payload *p, size_t extra) {
+    if (p->len + extra <= p->cap)
+        return 0;
+    size_t cap = p->cap ? p->cap : 16384;
+    while (cap < p->len + extra)
+        cap *= 2;
+    char *d = realloc(p->data, cap);
+    if (!d)
+        return -1;
+    p->data = d;
+    p->cap = cap;
+    return 0;
+}
+
+static void out_printf(struct payload *p, const char *fmt, ...) {
+    for (;;) {
+        size_t room = p->cap - p->len;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(p->data ? p->data + p->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < room) {
+            p->len += (size_t)n;
+            return;
+        }
+        if (out_reserve(p, (size_t)n + 1) != 0)
+            return;
+    }
+}
+
+/* Append src as an escaped label value of at most max source bytes,
+ * never cutting a UTF-8 sequence in half. */
+static void out_label_value(struct payload *p, const char *src, size_t max) {
+    size_t n = strlen(src);
+    if (n > max) {
+        n = max;
+        while (n > 0 && ((unsigned char)src[n] & 0xC0) == 0x80)
+            n--;
+    }
+    if (out_reserve(p, n * 2 + 1) != 0)
+        return;
+    for (size_t i = 0; i < n; i++) {
+        char c = src[i];
+        if (c == '\\' || c == '"') {
+            p->data[p->len++] = '\\';
+            p->data[p->len++] = c;
+        } else if (c == '\n') {
+            p->data[p->len++] = '\\';
+            p->data[p->len++] = 'n';
+        } else {
+            p->data[p->len++] = c;
+        }
+    }
+}
+
+int serve_parse_labels(const char *list, unsigned int *mask) {
+    unsigned int m = 0;
+    const char *s = list;
+    while (*s) {
+        size_t n = strcspn(s, ",");
+        if (n == 3 && strncmp(s, "pid", 3) == 0)
+            m |= SERVE_LABEL_PID;
+        else if (n == 4 && strncmp(s, "user", 4) == 0)
+            m |= SERVE_LABEL_USER;
+        else if (n == 4 && strncmp(s, "name", 4) == 0)
+            m |= SERVE_LABEL_NAME;
+        else if (n == 7 && strncmp(s, "cmdline", 7) == 0)
+            m |= SERVE_LABEL_CMDLINE;
+        else if (n != 0)
+            return -1;
+        s += n;
+        if (*s == ',')
+            s++;
+    }
+    *mask = m;
+    return 0;
+}
+
+/* label strings of the current render, referenced by offset */
+static struct payload labels;
+
+static int cmp_label(const void *a, const void *b) {
+    const struct series *x = a, *y = b;
+    return strcmp(labels.data + x->label, labels.data + y->label);
+}
+
+static int cmp_series_cpu(const void *a, const void *b) {
+    const struct series *x = *(struct series *const *)a;
+    const struct series *y = *(struct series *const *)b;
+    return (x->cpu_ratio < y->cpu_ratio) - (x->cpu_ratio > y->cpu_ratio);
+}
+
+static int cmp_series_rss(const void *a, const void *b) {
+    const struct series *x = *(struct series *const *)a;
+    const struct series *y = *(struct series *const *)b;
+    return (x->rss_bytes < y->rss_bytes) - (x->rss_bytes > y->rss_bytes);
+}
+
+static void label_task(const struct process_info *p,
+                       const struct serve_options *opt) {
+    const char *sep = "";
+    if (opt->labels & SERVE_LABEL_PID) {
+        out_printf(&labels, "pid=\"%d\"", p->pid);
+        sep = ",";
+    }
+    if (opt->labels & SERVE_LABEL_USER) {
+        out_printf(&labels, "%suser=\"", sep);
+        out_label_value(&labels, p->user, opt->label_len);
+        out_printf(&labels, "\"");
+        sep = ",";
+    }
+    if (opt->labels & SERVE_LABEL_NAME) {
+        out_printf(&labels, "%sname=\"", sep);
+        out_label_value(&labels, p->name, opt->label_len);
+        out_printf(&labels, "\"");
+        sep = ",";
+    }
+    if (opt->labels & SERVE_LABEL_CMDLINE) {
+        out_printf(&labels, "%scmdline=\"", sep);
+        out_label_value(&labels, p->cmdline, opt->label_len);
+        out_printf(&labels, "\"");
+    }
+    if (out_reserve(&labels, 1) == 0)
+        labels.data[labels.len++] = '\0';
+}
+
+/* Group tasks by their label set and mark the top series by CPU and by
+ * RSS. Returns the number of groups; the exported ones have keep set and
+ * *dropped counts those cut by max_series. */
+static size_t build_series(const struct snapshot *s,
+                           const struct serve_options *opt,
+                           struct series **out, size_t *cap,
+                           struct series ***rank, size_t *dropped) {
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0)
+        clk_tck = 100;
+    labels.len = 0;
+    if (s->count > *cap) {
+        struct series *n = realloc(*out, s->count * sizeof(*n));
+        struct series **r = realloc(*rank, s->count * sizeof(*r));
+        if (n)
+            *out = n;
+        if (r)
+            *rank = r;
+        if (!n || !r)
+            return 0;
+        *cap = s->count;
+    }
+    struct series *ser = *out;
+    for (size_t i = 0; i < s->count; i++) {
+        const struct process_info *p = &s->procs[i];
+        ser[i].label = labels.len;
+        label_task(p, opt);
+        ser[i].cpu_seconds = (double)(p->utime + p->stime) / (double)clk_tck;
+        ser[i].cpu_ratio = p->cpu_usage / 100.0;
+        ser[i].rss_bytes = (double)p->rss * 1024.0;
+        ser[i].read_bytes = (double)p->read_bytes;
+        ser[i].write_bytes = (double)p->write_bytes;
+        ser[i].keep = 0;
+    }
+    if (!labels.data)
+        return 0;
+    /* merge tasks with identical label sets */
+    qsort(ser, s->count, sizeof(*ser), cmp_label);
+    size_t n = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        if (n > 0 && cmp_label(&ser[n - 1], &ser[i]) == 0) {
+            ser[n - 1].cpu_seconds += ser[i].cpu_seconds;
+            ser[n - 1].cpu_ratio += ser[i].cpu_ratio;
+            ser[n - 1].rss_bytes += ser[i].rss_bytes;
+            ser[n - 1].read_bytes += ser[i].read_bytes;
+            ser[n - 1].write_bytes += ser[i].write_bytes;
+        } else {
+            ser[n++] = ser[i];
+        }
+    }
+    struct series **r = *rank;
+    size_t top = opt->top < n ? opt->top : n;
+    size_t kept = 0;
+    *dropped = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < n; i++)
+            r[i] = &ser[i];
+        qsort(r, n, sizeof(*r), pass == 0 ? cmp_series_cpu : cmp_series_rss);
+        for (size_t i = 0; i < top; i++) {
+            if (r[i]->keep)
+                continue;
+            if (kept < opt->max_series) {
+                r[i]->keep = 1;
+                kept++;
+            } else {
+                (*dropped)++;
+            }
+        }
+    }
+    return n;
+}
+
+static void render_family(struct payload *p, const char *name,
+                          const char *type, const char *unit,
+                          const char *help) {
+    out_printf(p, "# TYPE %s %s\n", name, type);
+    if (unit)
+        out_printf(p, "# UNIT %s %s\n", name, unit);
+    out_printf(p, "# HELP %s %s\n", name, help);
+}
+
+static void render(struct payload *p, const struct snapshot *s,
+                   const struct serve_options *opt, double collect_secs,
+                   unsigned long long collections) {
+    static struct series *ser;
+    static struct series **rank;
+    static size_t ser_cap;
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0)
+        clk_tck = 100;
+    double tck = (double)clk_tck;
+    const struct cpu_stats *c = &s->cpu;
+    p->len = 0;
+
+    render_family(p, "vtop_cpu_seconds", "counter", "seconds",
+                  "Time all CPUs spent in each mode.");
+    const struct {
+        const char *mode;
+        unsigned long long v;
+    } modes[] = {
+        {"user", c->user}, {"nice", c->nice}, {"system", c->system},
+        {"idle", c->idle}, {"iowait", c->iowait}, {"irq", c->irq},
+        {"softirq", c->softirq}, {"steal", c->steal}
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+        out_printf(p, "vtop_cpu_seconds_total{mode=\"%s\"} %.2f\n",
+                   modes[i].mode, (double)modes[i].v / tck);
+    render_family(p, "vtop_cpu_usage_ratio", "gauge", "ratio",
+                  "Busy fraction of all CPUs over the last interval.");
+    out_printf(p, "vtop_cpu_usage_ratio %.4f\n", s->cpu_usage / 100.0);
+    if (s->core_count) {
+        render_family(p, "vtop_core_usage_ratio", "gauge", "ratio",
+                      "Busy fraction of each CPU over the last interval.");
+        for (size_t i = 0; i < s->core_count; i++)
+            out_printf(p, "vtop_core_usage_ratio{cpu=\"%u\"} %.4f\n",
+                       s->core_id[i], s->core_usage[i] / 100.0);
+    }
+
+    const struct mem_stats *m = &s->mem;
+    render_family(p, "vtop_memory_bytes", "gauge", "bytes",
+                  "Memory and swap sizes from /proc/meminfo.");
+    const struct {
+        const char *type;
+        unsigned long long kb;
+    } mem[] = {
+        {"total", m->total}, {"free", m->free}, {"available", m->available},
+        {"buffers", m->buffers}, {"cached", m->cached},
+        {"swap_total", m->swap_total}, {"swap_used", m->swap_used}
+    };
+    for (size_t i = 0; i < sizeof(mem) / sizeof(mem[0]); i++)
+        out_printf(p, "vtop_memory_bytes{type=\"%s\"} %llu\n", mem[i].type,
+                   mem[i].kb * 1024ULL);
+
+    const struct misc_stats *ms = &s->misc;
+    render_family(p, "vtop_load_average", "gauge", NULL,
+                  "Run queue load average.");
+    out_printf(p, "vtop_load_average{period=\"1m\"} %.2f\n", ms->load1);
+    out_printf(p, "vtop_load_average{period=\"5m\"} %.2f\n", ms->load5);
+    out_printf(p, "vtop_load_average{period=\"15m\"} %.2f\n", ms->load15);
+    render_family(p, "vtop_uptime_seconds", "gauge", "seconds",
+                  "Time since boot.");
+    out_printf(p, "vtop_uptime_seconds %.0f\n", ms->uptime);
+    render_family(p, "vtop_tasks", "gauge", NULL, "Tasks by state.");
+    out_printf(p, "vtop_tasks{state=\"running\"} %d\n", ms->running_tasks);
+    out_printf(p, "vtop_tasks{state=\"sleeping\"} %d\n", ms->sleeping_tasks);
+    out_printf(p, "vtop_tasks{state=\"stopped\"} %d\n", ms->stopped_tasks);
+    out_printf(p, "vtop_tasks{state=\"zombie\"} %d\n", ms->zombie_tasks);
+
+    static const struct {
+        const char *name;
+        const char *unit;
+        const char *help;
+        size_t rx;
+        size_t tx;
+    } nets[] = {
+        {"vtop_network_bytes_per_second", "bytes_per_second",
+         "Traffic of each interface over the last interval.",
+         offsetof(struct net_info, rx_rate), offsetof(struct net_info, tx_rate)},
+        {"vtop_network_packets_per_second", NULL,
+         "Packets of each interface over the last interval.",
+         offsetof(struct net_info, rx_packets),
+         offsetof(struct net_info, tx_packets)},
+        {"vtop_network_drops_per_second", NULL,
+         "Dropped packets of each interface over the last interval.",
+         offsetof(struct net_info, rx_drops), offsetof(struct net_info, tx_drops)},
+        {"vtop_network_errors_per_second", NULL,
+         "Errors of each interface over the last interval.",
+         offsetof(struct net_info, rx_errors),
+         offsetof(struct net_info, tx_errors)}
+    };
+    for (size_t f = 0; f < sizeof(nets) / sizeof(nets[0]) && s->net_count; f++) {
+        render_family(p, nets[f].name, "gauge", nets[f].unit, nets[f].help);
+        for (size_t i = 0; i < s->net_count; i++) {
+            const char *d = (const char *)&s->nets[i];
+            for (int tx = 0; tx < 2; tx++) {
+                out_printf(p, "%s{interface=\"", nets[f].name);
+                out_label_value(p, s->nets[i].name, sizeof(s->nets[i].name));
+                out_printf(p, "\",direction=\"%s\"} %.1f\n", tx ? "tx" : "rx",
+                           *(const double *)(d + (tx ? nets[f].tx
+                                                     : nets[f].rx)));
+            }
+        }
+    }
+
+    size_t dropped = 0;
+    size_t n = opt->top ? build_series(s, opt, &ser, &ser_cap, &rank,
+                                       &dropped) : 0;
+    static const struct {
+        const char *name;
+        const char *type;
+        const char *unit;
+        const char *help;
+        size_t off;
+        int prec;
+    } fams[] = {
+        {"vtop_process_cpu_seconds", "counter", "seconds",
+         "CPU time used by the task.",
+         offsetof(struct series, cpu_seconds), 2},
+        {"vtop_process_cpu_usage_ratio", "gauge", "ratio",
+         "CPU share of the task over the last interval.",
+         offsetof(struct series, cpu_ratio), 4},
+        {"vtop_process_resident_bytes", "gauge", "bytes",
+         "Resident set size.", offsetof(struct series, rss_bytes), 0},
+        {"vtop_process_read_bytes", "counter", "bytes",
+         "Bytes read from storage.", offsetof(struct series, read_bytes), 0},
+        {"vtop_process_written_bytes", "counter", "bytes",
+         "Bytes written to storage.", offsetof(struct series, write_bytes), 0}
+    };
+    for (size_t f = 0; f < sizeof(fams) / sizeof(fams[0]) && n; f++) {
+        render_family(p, fams[f].name, fams[f].type, fams[f].unit,
+                      fams[f].help);
+        int counter = fams[f].type[0] == 'c';
+        for (size_t i = 0; i < n; i++) {
+            if (!ser[i].keep)
+                continue;
+            const char *l = labels.data + ser[i].label;
+            double v = *(const double *)((const char *)&ser[i] + fams[f].off);
+            out_printf(p, "%s%s%s%s%s %.*f\n", fams[f].name,
+                       counter ? "_total" : "", *l ? "{" : "", l,
+                       *l ? "}" : "", fams[f].prec, v);
+        }
+    }
+    render_family(p, "vtop_process_series_dropped", "gauge", NULL,
+                  "Top series left out because of --metrics-max-series.");
+    out_printf(p, "vtop_process_series_dropped %zu\n", dropped);
+    render_family(p, "vtop_collect_duration_seconds", "gauge", "seconds",
+                  "Time taken by the last /proc walk.");
+    out_printf(p, "vtop_collect_duration_seconds %.6f\n", collect_secs);
+    render_family(p, "vtop_collections", "counter", NULL,
+                  "Number of /proc walks since start.");
+    out_printf(p, "vtop_collections_total %llu\n", collections);
+    out_printf(p, "# EOF\n");
+}
+
+static int open_listener(const char *addr) {
+    char host[256];
+    const char *port = strrchr(addr, ':');
+    size_t hlen = port ? (size_t)(port - addr) : 0;
+    if (hlen >= sizeof(host))
+        return -1;
+    memcpy(host, addr, hlen);
+    host[hlen] = '\0';
+    port = port ? port + 1 : addr;
+    char *h = host;
+    if (hlen >= 2 && host[0] == '[' && host[hlen - 1] == ']') {
+        host[hlen - 1] = '\0';
+        h = host + 1;
+    }
+    struct addrinfo hints = {0}, *res, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(*h ? h : NULL, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "vtop: %s: %s\n", addr, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK |
+                    SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        fprintf(stderr, "vtop: cannot listen on %s: %s\n", addr,
+                strerror(errno));
+    return fd;
+}
+
+static void payload_put(struct payload *p, struct payload *current) {
+    if (--p->refs == 0 && p != current) {
+        free(p->data);
+        free(p);
+    }
+}
+
+static void drop_client(struct client *c, struct payload *current) {
+    close(c->fd);
+    if (c->body)
+        payload_put(c->body, current);
+    c->fd = -1;
+    c->body = NULL;
+}
+
+/* Look at a complete request and queue the response. */
+static void answer(struct client *c, struct payload *current) {
+    const char *status = "200 OK";
+    const char *type = "application/openmetrics-text; version=1.0.0; "
+                       "charset=utf-8";
+    int ok = 0;
+    if (strncmp(c->req, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+    } else {
+        const char *path = c->req + 4;
+        size_t n = strcspn(path, " ?");
+        if ((n == 8 && strncmp(path, "/metrics", 8) == 0) ||
+            (n == 1 && path[0] == '/'))
+            ok = 1;
+        else
+            status = "404 Not Found";
+    }
+    size_t len = ok ? current->len : 0;
+    if (!ok)
+        type = "text/plain";
+    int n = snprintf(c->head, sizeof(c->head),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+    c->head_len = n > 0 && (size_t)n < sizeof(c->head) ? (size_t)n : 0;
+    c->body = ok ? current : NULL;
+    if (ok)
+        current->refs++;
+    c->sent = 0;
+}
+
+/* Send as much of the response as the socket takes. Returns 1 when the
+ * response is complete. */
+static int flush_client(struct client *c) {
+    size_t total = c->head_len + (c->body ? c->body->len : 0);
+    while (c->sent < total) {
+        const char *src;
+        size_t n;
+        if (c->sent < c->head_len) {
+            src = c->head + c->sent;
+            n = c->head_len - c->sent;
+        } else {
+            src = c->body->data + (c->sent - c->head_len);
+            n = total - c->sent;
+        }
+        ssize_t w = send(c->fd, src, n, MSG_NOSIGNAL);
+        if (w < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : 1;
+        c->sent += (size_t)w;
+    }
+    return 1;
+}
+
+int run_serve(unsigned int delay_ms, const struct serve_options *opt) {
+    int lfd = open_listener(opt->addr);
+    if (lfd < 0)
+        return 1;
+    struct client clients[MAX_CLIENTS];
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    struct payload *current = calloc(1, sizeof(*current));
+    struct snapshot snap = {0};
+    unsigned long long collections = 0;
+    if (!current) {
+        close(lfd);
+        return 1;
+    }
+    serve_stop = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    double next = now_mono();
+    while (!serve_stop) {
+        double now = now_mono();
+        if (now >= next) {
+            snapshot_collect(&snap, 0);
+            double done = now_mono();
+            collections++;
+            /* a payload still being sent is left alone */
+            struct payload *p = current;
+            if (p->refs > 0)
+                p = calloc(1, sizeof(*p));
+            if (p) {
+                current = p;
+                render(current, &snap, opt, done - now, collections);
+            }
+            double interval = budget_next_delay(delay_ms) / 1000.0;
+            next += interval;
+            if (next < done)
+                next = done + interval;
+            now = done;
+        }
+
+        struct pollfd pfd[MAX_CLIENTS + 1];
+        int map[MAX_CLIENTS + 1];
+        nfds_t nfds = 0;
+        pfd[nfds].fd = lfd;
+        pfd[nfds].events = POLLIN;
+        map[nfds++] = -1;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0)
+                continue;
+            if (now - clients[i].since > CLIENT_TIMEOUT) {
+                drop_client(&clients[i], current);
+                continue;
+            }
+            pfd[nfds].fd = clients[i].fd;
+            pfd[nfds].events = clients[i].head_len ? POLLOUT : POLLIN;
+            map[nfds++] = i;
+        }
+        int timeout = (int)((next - now) * 1000.0) + 1;
+        if (timeout < 0)
+            timeout = 0;
+        int r = poll(pfd, nfds, timeout);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (nfds_t k = 1; k < nfds; k++) {
+            struct client *c = &clients[map[k]];
+            if (!pfd[k].revents)
+                continue;
+            if (c->head_len == 0) {
+                ssize_t n = recv(c->fd, c->req + c->req_len,
+                                 sizeof(c->req) - 1 - c->req_len, 0);
+                if (n <= 0) {
+                    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                        continue;
+                    drop_client(c, current);
+                    continue;
+                }
+                c->req_len += (size_t)n;
+                c->req[c->req_len] = '\0';
+                if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+                    answer(c, current);
+                else if (c->req_len == sizeof(c->req) - 1)
+                    drop_client(c, current);
+                if (c->fd < 0 || c->head_len == 0)
+                    continue;
+            }
+            if (flush_client(c))
+                drop_client(c, current);
+        }
+        if (pfd[0].revents & POLLIN) {
+            for (;;) {
+                int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                    break;
+                int slot = -1;
+                for (int i = 0; i < MAX_CLIENTS && slot < 0; i++)
+                    if (clients[i].fd < 0)
+                        slot = i;
+                if (slot < 0) {
+                    close(fd);
+                    continue;
+                }
+                struct client *c = &clients[slot];
+                c->fd = fd;
+                c->req_len = 0;
+                c->head_len = 0;
+                c->body = NULL;
+                c->sent = 0;
+                c->since = now_mono();
+            }
+        }
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        if (clients[i].fd >= 0)
+            drop_client(&clients[i], current);
+    close(lfd);
+    free(current->data);
+    free(current);
+    snapshot_free(&snap);
+    return 0;
+}
@@ -0,0 +1,567 @@
+#define _GNU_SOURCE
+#include "share.h"
+#include "record.h"
+#include "budget.h"
+#include "perfctr.h"
+#include "smaps.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHARE_MAGIC "VTOPSHM"
+#define SHARE_VERSION 1
+/* initial room for frames, grown when a frame does not fit */
+#define SHARE_INITIAL_CAP (1u << 21)
+/* a frame older than this many intervals (and at least STALE_MIN
+ * seconds) means the daemon is gone */
+#define STALE_INTERVALS 3
+#define STALE_MIN 5.0
+
+/* Header at the start of the segment. Everything except magic, version
+ * and seq is only valid while seq is even and unchanged. */
+struct share_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    /* odd while the daemon is writing */
+    uint64_t seq;
+    /* bytes available for the frame after the header */
+    uint64_t capacity;
+    /* bytes of the current frame */
+    uint64_t len;
+    uint32_t sys_fields;
+    uint32_t task_fields;
+    uint32_t interval_ms;
+    int32_t pid;
+    uint32_t threads;
+    uint32_t reserved;
+    /* wall clock time of the last publish */
+    double published;
+};
+
+/* Frame header on the socket fallback, followed by len bytes */
+struct sock_header {
+    uint32_t len;
+    uint16_t sys_fields;
+    uint16_t task_fields;
+    uint32_t interval_ms;
+    uint32_t threads;
+};
+
+static volatile sig_atomic_t daemon_stop;
+
+/* The segment holds what /proc only shows the owner of a task, e.g. its
+ * io counters, so by default only the daemon's user may read it. */
+static mode_t seg_mode = 0600;
+static gid_t seg_gid = (gid_t)-1;
+
+int share_set_group(const char *group) {
+    struct group *gr = getgrnam(group);
+    char *end;
+    if (gr) {
+        seg_gid = gr->gr_gid;
+    } else {
+        unsigned long id = strtoul(group, &end, 10);
+        if (end == group || *end)
+            return -1;
+        seg_gid = (gid_t)id;
+    }
+    if (seg_mode == 0600)
+        seg_mode = 0640;
+    return 0;
+}
+
+void share_set_public(void) { seg_mode = 0644; }
+
+static void handle_stop(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+static void shm_path(const char *name, char *buf, size_t size) {
+    snprintf(buf, size, "/%s", name);
+}
+
+/* Only the user's own daemon or root's may feed a viewer, anything
+ * else could show made up processes. */
+static int trusted_uid(uid_t uid) {
+    return uid == 0 || uid == geteuid();
+}
+
+/* The socket lives in a directory only the user can write to:
+ * $XDG_RUNTIME_DIR, else /tmp/vtop-UID created with mode 0700. */
+static int sock_path(const char *name, char *buf, size_t size) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char tmpdir[64];
+    if (!dir || dir[0] != '/') {
+        snprintf(tmpdir, sizeof(tmpdir), "/tmp/vtop-%u", (unsigned)geteuid());
+        if (mkdir(tmpdir, 0700) != 0 && errno != EEXIST)
+            return -1;
+        struct stat st;
+        if (lstat(tmpdir, &st) != 0 || !S_ISDIR(st.st_mode) ||
+            st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+            errno = EACCES;
+            return -1;
+        }
+        dir = tmpdir;
+    }
+    int n = snprintf(buf, size, "%s/vtop-%s.sock", dir, name);
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static double now_real(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double now_mono(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int pid_alive(pid_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static int is_stale(double published, unsigned int interval_ms) {
+    double limit = STALE_INTERVALS * interval_ms / 1000.0;
+    if (limit < STALE_MIN)
+        limit = STALE_MIN;
+    return now_real() - published > limit;
+}
+
+/* ---- daemon ---- */
+
+static struct share_header *pub_hdr;
+static size_t pub_size;
+static int pub_fd = -1;
+
+static int publish_open(const char *name, unsigned int delay_ms) {
+    char path[256];
+    shm_path(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd >= 0) {
+        struct share_header h;
+        struct stat st;
+        ssize_t n = pread(fd, &h, sizeof(h), 0);
+        int trusted = fstat(fd, &st) == 0 && trusted_uid(st.st_uid);
+        close(fd);
+        /* a segment of another user proves nothing about a daemon and
+         * cannot be replaced; serve on the socket instead */
+        if (!trusted)
+            return -1;
+        if (n == (ssize_t)sizeof(h) && memcmp(h.magic, SHARE_MAGIC, 8) == 0 &&
+            pid_alive(h.pid) && h.pid != getpid() &&
+            !is_stale(h.published, h.interval_ms)) {
+            fprintf(stderr, "vtop: a daemon (pid %d) already publishes %s\n",
+                    (int)h.pid, name);
+            return 1;
+        }
+        /* viewers of the old segment notice that it went stale */
+        shm_unlink(path);
+    }
+    fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return -1;
+    if ((seg_gid != (gid_t)-1 && fchown(fd, (uid_t)-1, seg_gid) != 0) ||
+        fchmod(fd, seg_mode) != 0) {
+        fprintf(stderr, "vtop: cannot set the permissions of %s: %s\n", name,
+                strerror(errno));
+        close(fd);
+        shm_unlink(path);
+        return 1;
+    }
+    size_t size = sizeof(struct share_header) + SHARE_INITIAL_CAP;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(path);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        shm_unlink(path);
+        return -1;
+    }
+    pub_hdr = map;
+    pub_size = size;
+    pub_fd = fd;
+    memset(pub_hdr, 0, sizeof(*pub_hdr));
+    pub_hdr->version = SHARE_VERSION;
+    pub_hdr->header_size = sizeof(*pub_hdr);
+    pub_hdr->capacity = SHARE_INITIAL_CAP;
+    pub_hdr->interval_ms = delay_ms;
+    pub_hdr->pid = (int32_t)getpid();
+    /* the magic goes last so readers never see a half set up header */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(pub_hdr->magic, SHARE_MAGIC, sizeof(SHARE_MAGIC));
+    return 0;
+}
+
+static int publish_frame(const unsigned char *data, size_t len,
+                         double published) {
+    uint64_t seq = pub_hdr->seq;
+    __atomic_store_n(&pub_hdr->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (len > pub_hdr->capacity) {
+        size_t cap = (size_t)pub_hdr->capacity;
+        while (cap < len)
+            cap *= 2;
+        size_t size = sizeof(struct share_header) + cap;
+        void *map = MAP_FAILED;
+        if (ftruncate(pub_fd, (off_t)size) == 0)
+            map = mremap(pub_hdr, pub_size, size, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED) {
+            __atomic_store_n(&pub_hdr->seq, seq + 2, __ATOMIC_RELEASE);
+            return -1;
+        }
+        pub_hdr = map;
+        pub_size = size;
+        pub_hdr->capacity = cap;
+    }
+    memcpy((unsigned char *)pub_hdr + sizeof(*pub_hdr), data, len);
+    pub_hdr->len = len;
+    size_t sys_n, task_n;
+    record_field_counts(&sys_n, &task_n);
+    pub_hdr->sys_fields = (uint32_t)sys_n;
+    pub_hdr->task_fields = (uint32_t)task_n;
+    pub_hdr->threads = (uint32_t)get_thread_mode();
+    pub_hdr->published = published;
+    __atomic_store_n(&pub_hdr->seq, seq + 2, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void publish_close(const char *name) {
+    char path[256];
+    shm_path(name, path, sizeof(path));
+    pub_hdr->published = 0.0;
+    munmap(pub_hdr, pub_size);
+    close(pub_fd);
+    shm_unlink(path);
+    pub_hdr = NULL;
+    pub_fd = -1;
+}
+
+static int sock_listen(const char *name) {
+    struct sockaddr_un sa = {0};
+    sa.sun_family = AF_UNIX;
+    if (sock_path(name, sa.sun_path, sizeof(sa.sun_path)) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(sa.sun_path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 ||
+        chmod(sa.sun_path, 0600) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Hand the current frame to one socket viewer. */
+static void sock_send(int lfd, const unsigned char *data, size_t len,
+                      unsigned int delay_ms) {
+    int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    /* a stuck viewer must not hold up collection for long */
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    size_t sys_n, task_n;
+    record_field_counts(&sys_n, &task_n);
+    struct sock_header h = { (uint32_t)len, (uint16_t)sys_n, (uint16_t)task_n,
+                             delay_ms, (uint32_t)get_thread_mode() };
+    if (send(fd, &h, sizeof(h), MSG_NOSIGNAL) == (ssize_t)sizeof(h)) {
+        size_t off = 0;
+        while (off < len) {
+            ssize_t w = send(fd, data + off, len - off, MSG_NOSIGNAL);
+            if (w <= 0)
+                break;
+            off += (size_t)w;
+        }
+    }
+    close(fd);
+}
+
+int run_daemon(const char *name, unsigned int delay_ms) {
+    int lfd = -1;
+    int r = publish_open(name, delay_ms);
+    if (r > 0)
+        return 1;
+    if (r < 0) {
+        lfd = sock_listen(name);
+        if (lfd < 0) {
+            fprintf(stderr, "vtop: cannot publish %s: %s\n", name,
+                    strerror(errno));
+            return 1;
+        }
+    }
+    daemon_stop = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    struct snapshot snap = {0};
+    unsigned char *data = NULL;
+    size_t len = 0, cap = 0;
+    unsigned int interval_ms = delay_ms;
+    double next = now_mono();
+    while (!daemon_stop) {
+        double now = now_mono();
+        if (now >= next) {
+            snapshot_collect(&snap, 0);
+            if (record_encode_keyframe(&snap, &data, &len, &cap) == 0 &&
+                pub_hdr)
+                publish_frame(data, len, snap.timestamp);
+            /* viewers judge staleness by the stretched interval */
+            interval_ms = budget_next_delay(delay_ms);
+            if (pub_hdr)
+                pub_hdr->interval_ms = interval_ms;
+            next += interval_ms / 1000.0;
+            if (next < now)
+                next = now + interval_ms / 1000.0;
+            continue;
+        }
+        int timeout = (int)((next - now) * 1000.0) + 1;
+        if (lfd < 0) {
+            usleep((useconds_t)timeout * 1000);
+            continue;
+        }
+        struct pollfd pfd = { lfd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout) > 0 && len > 0)
+            sock_send(lfd, data, len, interval_ms);
+    }
+    if (pub_hdr)
+        publish_close(name);
+    if (lfd >= 0) {
+        char path[108];
+        close(lfd);
+        if (sock_path(name, path, sizeof(path)) == 0)
+            unlink(path);
+    }
+    free(data);
+    snapshot_free(&snap);
+    return 0;
+}
+
+/* ---- viewer ---- */
+
+static char view_name[64];
+static int view_attached;
+static const struct share_header *view_hdr;
+static size_t view_size;
+static int view_fd = -1;
+static unsigned char *view_buf;
+static size_t view_cap;
+static struct replay_cursor view_cursor;
+
+static int view_reserve(size_t n) {
+    if (n <= view_cap)
+        return 0;
+    unsigned char *tmp = realloc(view_buf, n);
+    if (!tmp)
+        return -1;
+    view_buf = tmp;
+    view_cap = n;
+    return 0;
+}
+
+static int view_map(size_t size) {
+    if (view_hdr)
+        munmap((void *)view_hdr, view_size);
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, view_fd, 0);
+    view_hdr = map == MAP_FAILED ? NULL : map;
+    view_size = view_hdr ? size : 0;
+    return view_hdr ? 0 : -1;
+}
+
+/* Copy the newest frame out of the segment. Returns the frame length or
+ * -1 when the segment is gone or stale. */
+static long shm_fetch(struct sock_header *out, double *published) {
+    for (int tries = 0; tries < 1000; tries++) {
+        uint64_t seq = __atomic_load_n(&view_hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            if (tries > 10)
+                usleep(100);
+            continue;
+        }
+        uint64_t capacity = view_hdr->capacity;
+        if (sizeof(struct share_header) + capacity > view_size) {
+            if (view_map(sizeof(struct share_header) + (size_t)capacity) != 0)
+                return -1;
+            continue;
+        }
+        size_t len = (size_t)view_hdr->len;
+        if (len > capacity || view_reserve(len) != 0)
+            continue;
+        memcpy(view_buf, (const unsigned char *)view_hdr + sizeof(*view_hdr),
+               len);
+        out->sys_fields = (uint16_t)view_hdr->sys_fields;
+        out->task_fields = (uint16_t)view_hdr->task_fields;
+        out->interval_ms = view_hdr->interval_ms;
+        out->threads = view_hdr->threads;
+        *published = view_hdr->published;
+        int32_t pid = view_hdr->pid;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&view_hdr->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+        if (!pid_alive(pid) || is_stale(*published, out->interval_ms))
+            return -1;
+        return (long)len;
+    }
+    return -1;
+}
+
+static long sock_fetch(struct sock_header *out, double *published) {
+    struct sockaddr_un sa = {0};
+    sa.sun_family = AF_UNIX;
+    if (sock_path(view_name, sa.sun_path, sizeof(sa.sun_path)) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct timeval tv = { 2, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    long ret = -1;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0 &&
+        getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0 &&
+        trusted_uid(cred.uid) &&
+        recv(fd, out, sizeof(*out), MSG_WAITALL) == (ssize_t)sizeof(*out) &&
+        view_reserve(out->len) == 0) {
+        size_t off = 0;
+        while (off < out->len) {
+            ssize_t n = recv(fd, view_buf + off, out->len - off, 0);
+            if (n <= 0)
+                break;
+            off += (size_t)n;
+        }
+        if (off == out->len)
+            ret = (long)off;
+    }
+    close(fd);
+    *published = now_real();
+    return ret;
+}
+
+static long fetch(struct sock_header *h, double *published) {
+    return view_hdr ? shm_fetch(h, published) : sock_fetch(h, published);
+}
+
+int share_attach(const char *name) {
+    share_detach();
+    snprintf(view_name, sizeof(view_name), "%s", name);
+    char path[256];
+    shm_path(name, path, sizeof(path));
+    view_fd = shm_open(path, O_RDONLY, 0);
+    if (view_fd >= 0) {
+        struct share_header h;
+        struct stat st;
+        if (fstat(view_fd, &st) != 0 || !trusted_uid(st.st_uid) ||
+            pread(view_fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+            memcmp(h.magic, SHARE_MAGIC, 8) != 0 ||
+            h.version != SHARE_VERSION ||
+            view_map(sizeof(h) + (size_t)h.capacity) != 0) {
+            /* not usable, try the socket */
+            share_detach();
+        }
+    }
+    struct sock_header sh;
+    double published;
+    if (fetch(&sh, &published) < 0) {
+        share_detach();
+        return -1;
+    }
+    replay_cursor_init(&view_cursor, NULL);
+    view_attached = 1;
+    return 0;
+}
+
+int share_attached(void) { return view_attached; }
+
+void share_detach(void) {
+    if (view_hdr)
+        munmap((void *)view_hdr, view_size);
+    if (view_fd >= 0)
+        close(view_fd);
+    view_hdr = NULL;
+    view_size = 0;
+    view_fd = -1;
+    if (view_attached)
+        replay_cursor_free(&view_cursor);
+    view_attached = 0;
+}
+
+int share_read(struct snapshot *s, size_t max_entries) {
+    if (!view_attached)
+        return -1;
+    struct sock_header h;
+    double published;
+    long len = fetch(&h, &published);
+    if (len < 0) {
+        share_detach();
+        return -1;
+    }
+    /* the daemon lists processes, a thread view needs its own walk */
+    if ((int)h.threads != get_thread_mode())
+        return -1;
+    /* nor does it read run queue wait times, counters or smaps */
+    if (get_wait_stats() || perfctr_get_top() || smaps_enabled())
+        return -1;
+    if (record_decode_keyframe(&view_cursor, view_buf, (size_t)len,
+                               h.sys_fields, h.task_fields) != 0)
+        return -1;
+    const struct snapshot *src = &view_cursor.snap;
+    if (snapshot_reserve_cores(s, src->core_count) != 0 ||
+        snapshot_reserve_disks(s, src->disk_count) != 0 ||
+        snapshot_reserve_nets(s, src->net_count) != 0 ||
+        snapshot_reserve_procs(s, src->count) != 0)
+        return -1;
+    s->timestamp = src->timestamp;
+    s->cpu = src->cpu;
+    s->mem = src->mem;
+    s->misc = src->misc;
+    s->psi = src->psi;
+    s->cpu_usage = src->cpu_usage;
+    if (src->core_count) {
+        memcpy(s->core_usage, src->core_usage,
+               src->core_count * sizeof(*s->core_usage));
+        memcpy(s->core_id, src->core_id,
+               src->core_count * sizeof(*s->core_id));
+    }
+    s->core_count = src->core_count;
+    if (src->disk_count)
+        memcpy(s->disks, src->disks, src->disk_count * sizeof(*s->disks));
+    s->disk_count = src->disk_count;
+    if (src->net_count)
+        memcpy(s->nets, src->nets, src->net_count * sizeof(*s->nets));
+    s->net_count = src->net_count;
+    size_t n = 0;
+    for (size_t i = 0; i < src->count; i++) {
+        if (max_entries && n >= max_entries)
+            break;
+        if (proc_visible(&src->procs[i]))
+            s->procs[n++] = src->procs[i];
+    }
+    s->count = n;
+    return 0;
+}
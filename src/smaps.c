@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include "smaps.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* largest processes by RSS read before the rest */
+#define SMAPS_TOP 32
+/* processes read per pass at most */
+#define SMAPS_PASS_MAX 256
+
+enum {
+    PRIO_NONE,
+    PRIO_TOP,
+    PRIO_VISIBLE
+};
+
+struct entry {
+    int pid;
+    /* start_timestamp, so a reused pid does not inherit the values */
+    double start;
+    int prio;
+    long rss;
+    long pss;
+    long uss;
+    long swap_pss;
+    /* CLOCK_MONOTONIC seconds of the last read, 0 before the first */
+    double sampled;
+};
+
+/* what the thread works through in one pass */
+struct work {
+    int pid;
+    double start;
+    int prio;
+    double sampled;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static int started;
+static int stopping;
+static int enabled;
+static unsigned int interval_ms = 5000;
+
+/* sorted by pid and guarded by lock; spare is the previous array, which
+ * only the refreshing thread touches */
+static struct entry *cache;
+static size_t ncache;
+static size_t cache_cap;
+static struct entry *spare;
+static size_t spare_cap;
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void smaps_set_interval(unsigned int ms) {
+    pthread_mutex_lock(&lock);
+    interval_ms = ms ? ms : 1;
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned int smaps_get_interval(void) { return interval_ms; }
+
+void smaps_enable(void) { enabled = 1; }
+
+int smaps_enabled(void) { return enabled; }
+
+static long rollup_field(const char *buf, const char *key) {
+    const char *p = strstr(buf, key);
+    return p ? strtol(p + strlen(key), NULL, 10) : 0;
+}
+
+/* Read one smaps_rollup. Returns 0 on success. */
+static int read_rollup(int pid, long *pss, long *uss, long *swap_pss) {
+    char path[512];
+    char buf[4096];
+    snprintf(path, sizeof(path), "%s/%d/smaps_rollup", get_proc_root(), pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    /* kernel threads have no mappings and an empty file */
+    *pss = rollup_field(buf, "\nPss:");
+    *uss = rollup_field(buf, "\nPrivate_Clean:") +
+           rollup_field(buf, "\nPrivate_Dirty:") +
+           rollup_field(buf, "\nPrivate_Hugetlb:");
+    *swap_pss = rollup_field(buf, "\nSwapPss:");
+    return 0;
+}
+
+static struct entry *find_entry(int pid, double start) {
+    size_t lo = 0, hi = ncache;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cache[mid].pid < pid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < ncache && cache[lo].pid == pid && cache[lo].start == start)
+        return &cache[lo];
+    return NULL;
+}
+
+static int cmp_work(const void *a, const void *b) {
+    const struct work *wa = a;
+    const struct work *wb = b;
+    if (wa->prio != wb->prio)
+        return wb->prio - wa->prio;
+    if (wa->sampled != wb->sampled)
+        return wa->sampled < wb->sampled ? -1 : 1;
+    return 0;
+}
+
+static void *smaps_thread(void *arg) {
+    (void)arg;
+    struct work *work = NULL;
+    size_t work_cap = 0;
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        size_t n = ncache;
+        if (n > work_cap) {
+            struct work *tmp = realloc(work, n * sizeof(*work));
+            if (tmp) {
+                work = tmp;
+                work_cap = n;
+            }
+        }
+        if (n > work_cap)
+            n = work_cap;
+        for (size_t i = 0; i < n; i++) {
+            work[i].pid = cache[i].pid;
+            work[i].start = cache[i].start;
+            work[i].prio = cache[i].prio;
+            work[i].sampled = cache[i].sampled;
+        }
+        double age = interval_ms / 1000.0;
+        pthread_mutex_unlock(&lock);
+
+        qsort(work, n, sizeof(*work), cmp_work);
+        double now = mono_seconds();
+        size_t done = 0;
+        for (size_t i = 0; i < n && done < SMAPS_PASS_MAX; i++) {
+            if (work[i].sampled > 0.0 && now - work[i].sampled < age)
+                continue;
+            long pss = -1, uss = -1, swap_pss = -1;
+            if (read_rollup(work[i].pid, &pss, &uss, &swap_pss) != 0)
+                pss = uss = swap_pss = -1;
+            done++;
+            pthread_mutex_lock(&lock);
+            if (stopping) {
+                pthread_mutex_unlock(&lock);
+                break;
+            }
+            struct entry *e = find_entry(work[i].pid, work[i].start);
+            if (e) {
+                e->pss = pss;
+                e->uss = uss;
+                e->swap_pss = swap_pss;
+                e->sampled = mono_seconds();
+            }
+            pthread_mutex_unlock(&lock);
+        }
+
+        pthread_mutex_lock(&lock);
+        if (stopping)
+            break;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += interval_ms / 1000;
+        ts.tv_nsec += (long)(interval_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&wake, &lock, &ts);
+    }
+    pthread_mutex_unlock(&lock);
+    free(work);
+    return NULL;
+}
+
+static int cmp_entry_pid(const void *a, const void *b) {
+    const struct entry *ea = a;
+    const struct entry *eb = b;
+    return (ea->pid > eb->pid) - (ea->pid < eb->pid);
+}
+
+void smaps_update(struct process_info *procs, size_t count) {
+    if (!enabled)
+        return;
+    if (count > spare_cap) {
+        struct entry *tmp = realloc(spare, count * sizeof(*tmp));
+        if (!tmp)
+            return;
+        spare = tmp;
+        spare_cap = count;
+    }
+    /* one entry per process; /proc lists pids in order, so sorting is
+     * usually skipped */
+    size_t n = 0;
+    int sorted = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (n > 0 && spare[n - 1].pid == procs[i].pid)
+            continue;
+        if (n > 0 && spare[n - 1].pid > procs[i].pid)
+            sorted = 0;
+        memset(&spare[n], 0, sizeof(spare[n]));
+        spare[n].pid = procs[i].pid;
+        spare[n].start = procs[i].start_timestamp;
+        spare[n].rss = procs[i].rss;
+        spare[n].pss = spare[n].uss = spare[n].swap_pss = -1;
+        n++;
+    }
+    if (!sorted) {
+        qsort(spare, n, sizeof(*spare), cmp_entry_pid);
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (m == 0 || spare[m - 1].pid != spare[i].pid)
+                spare[m++] = spare[i];
+        }
+        n = m;
+    }
+    /* the largest by RSS, kept as a short sorted list of indices */
+    size_t top[SMAPS_TOP];
+    size_t ntop = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t j = ntop < SMAPS_TOP ? ntop++ : SMAPS_TOP;
+        while (j > 0 && spare[top[j - 1]].rss < spare[i].rss) {
+            if (j < SMAPS_TOP)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < SMAPS_TOP)
+            top[j] = i;
+    }
+    for (size_t i = 0; i < ntop; i++)
+        spare[top[i]].prio = PRIO_TOP;
+
+    pthread_mutex_lock(&lock);
+    /* carry over what was read for processes that are still there; a
+     * pid with another start time is a new process and starts unread */
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        while (j < ncache && cache[j].pid < spare[i].pid)
+            j++;
+        if (j < ncache && cache[j].pid == spare[i].pid &&
+            cache[j].start == spare[i].start) {
+            spare[i].pss = cache[j].pss;
+            spare[i].uss = cache[j].uss;
+            spare[i].swap_pss = cache[j].swap_pss;
+            spare[i].sampled = cache[j].sampled;
+        }
+    }
+    struct entry *old = cache;
+    size_t old_cap = cache_cap;
+    cache = spare;
+    cache_cap = spare_cap;
+    ncache = n;
+    spare = old;
+    spare_cap = old_cap;
+    for (size_t i = 0; i < count; i++) {
+        const struct entry *e =
+            find_entry(procs[i].pid, procs[i].start_timestamp);
+        procs[i].pss = e ? e->pss : -1;
+        procs[i].uss = e ? e->uss : -1;
+        procs[i].swap_pss = e ? e->swap_pss : -1;
+    }
+    if (!started && !stopping &&
+        pthread_create(&thread, NULL, smaps_thread, NULL) == 0) {
+        started = 1;
+        atexit(smaps_stop);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void smaps_prioritize(const struct process_info *procs, size_t count) {
+    if (!enabled)
+        return;
+    int unread = 0;
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < count; i++) {
+        struct entry *e = find_entry(procs[i].pid, procs[i].start_timestamp);
+        if (e) {
+            e->prio = PRIO_VISIBLE;
+            unread |= e->sampled == 0.0;
+        }
+    }
+    /* rows on screen without values are worth an early pass */
+    if (unread)
+        pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void smaps_stop(void) {
+    pthread_mutex_lock(&lock);
+    int join = started && !stopping;
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    if (join)
+        pthread_join(thread, NULL);
+    free(cache);
+    free(spare);
+    cache = spare = NULL;
+    ncache = cache_cap = spare_cap = 0;
+    enabled = 0;
+}
@@ -0,0 +1,234 @@
+#include "snapshot.h"
+#include "cgroup.h"
+#include "perfctr.h"
+#include "share.h"
+#include "smaps.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* per-core totals of the previous read and the ticks since, only
+ * reallocated when CPUs come online */
+static unsigned long long *core_prev_total;
+static unsigned long long *core_prev_idle;
+static double *core_delta_total;
+static double *core_delta_idle;
+static size_t core_prev_count;
+static size_t core_prev_cap;
+
+int snapshot_reserve_procs(struct snapshot *s, size_t n) {
+    if (n <= s->proc_cap)
+        return 0;
+    struct process_info *tmp = realloc(s->procs, n * sizeof(*s->procs));
+    if (!tmp)
+        return -1;
+    s->procs = tmp;
+    s->proc_cap = n;
+    return 0;
+}
+
+int snapshot_reserve_cores(struct snapshot *s, size_t n) {
+    if (n <= s->core_cap)
+        return 0;
+    double *tmp = realloc(s->core_usage, n * sizeof(*s->core_usage));
+    if (!tmp)
+        return -1;
+    s->core_usage = tmp;
+    unsigned int *id = realloc(s->core_id, n * sizeof(*s->core_id));
+    if (!id)
+        return -1;
+    s->core_id = id;
+    s->core_cap = n;
+    return 0;
+}
+
+int snapshot_reserve_disks(struct snapshot *s, size_t n) {
+    if (n <= s->disk_cap)
+        return 0;
+    struct disk_info *tmp = realloc(s->disks, n * sizeof(*s->disks));
+    if (!tmp)
+        return -1;
+    s->disks = tmp;
+    s->disk_cap = n;
+    return 0;
+}
+
+int snapshot_reserve_nets(struct snapshot *s, size_t n) {
+    if (n <= s->net_cap)
+        return 0;
+    struct net_info *tmp = realloc(s->nets, n * sizeof(*s->nets));
+    if (!tmp)
+        return -1;
+    s->nets = tmp;
+    s->net_cap = n;
+    return 0;
+}
+
+static int reserve_core_prev(size_t n) {
+    if (n <= core_prev_cap)
+        return 0;
+    unsigned long long *total = realloc(core_prev_total, n * sizeof(*total));
+    if (total)
+        core_prev_total = total;
+    unsigned long long *idle = realloc(core_prev_idle, n * sizeof(*idle));
+    if (idle)
+        core_prev_idle = idle;
+    double *dtotal = realloc(core_delta_total, n * sizeof(*dtotal));
+    if (dtotal)
+        core_delta_total = dtotal;
+    double *didle = realloc(core_delta_idle, n * sizeof(*didle));
+    if (didle)
+        core_delta_idle = didle;
+    if (!total || !idle || !dtotal || !didle)
+        return -1;
+    core_prev_cap = n;
+    return 0;
+}
+
+static void update_core_usage(struct snapshot *s) {
+    size_t n = get_cpu_core_count();
+    const struct cpu_core_stats *cores = get_cpu_core_stats();
+    if (reserve_core_prev(n) != 0 || snapshot_reserve_cores(s, n) != 0) {
+        s->core_count = 0;
+        return;
+    }
+    /* a CPU came or went: usage since boot, as on the first read */
+    if (n != core_prev_count) {
+        memset(core_prev_total, 0, n * sizeof(*core_prev_total));
+        memset(core_prev_idle, 0, n * sizeof(*core_prev_idle));
+        core_prev_count = n;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned long long cidle = cores[i].idle + cores[i].iowait;
+        unsigned long long ctotal = cores[i].user + cores[i].nice +
+                                    cores[i].system + cores[i].irq +
+                                    cores[i].softirq + cores[i].steal +
+                                    cidle;
+        core_delta_total[i] = (double)(ctotal - core_prev_total[i]);
+        core_delta_idle[i] = (double)(cidle - core_prev_idle[i]);
+        core_prev_total[i] = ctotal;
+        core_prev_idle[i] = cidle;
+        s->core_id[i] = cores[i].id;
+    }
+    /* flat arrays of doubles and a select instead of a branch around the
+     * division, so the compiler can vectorize this loop; a CPU without
+     * ticks has no idle ticks either and comes out at 0 */
+    const double *dt = core_delta_total;
+    const double *di = core_delta_idle;
+    double *usage = s->core_usage;
+    for (size_t i = 0; i < n; i++) {
+        double ticks = dt[i] > 0.0 ? dt[i] : 1.0;
+        usage[i] = 100.0 * (dt[i] - di[i]) / ticks;
+    }
+    s->core_count = n;
+}
+
+static void collect_system(struct snapshot *s) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    s->timestamp = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+
+    if (read_cpu_stats(&s->cpu) == 0) {
+        s->cpu_usage = 100.0 - s->cpu.idle_percent;
+        update_core_usage(s);
+    } else {
+        memset(&s->cpu, 0, sizeof(s->cpu));
+        s->cpu_usage = 0.0;
+        s->core_count = 0;
+    }
+    if (read_mem_stats(&s->mem) != 0)
+        memset(&s->mem, 0, sizeof(s->mem));
+    read_pressure_stats(&s->psi);
+    s->disk_count = 0;
+    if (disk_collect() > 0) {
+        size_t n;
+        const struct disk_info *disks = disk_get(&n);
+        if (snapshot_reserve_disks(s, n) == 0) {
+            memcpy(s->disks, disks, n * sizeof(*disks));
+            s->disk_count = n;
+        }
+    }
+    s->net_count = 0;
+    if (net_collect() > 0) {
+        size_t n;
+        const struct net_info *nets = net_get(&n);
+        if (snapshot_reserve_nets(s, n) == 0) {
+            memcpy(s->nets, nets, n * sizeof(*nets));
+            s->net_count = n;
+        }
+    }
+}
+
+int snapshot_collect(struct snapshot *s, size_t max_entries) {
+    /* members of a drilled-into cgroup, before either source filters */
+    cgroup_apply_filter();
+    /* a running daemon already did the work */
+    if (share_attached() && share_read(s, max_entries) == 0) {
+        cgroup_throttle_update(s->procs, s->count);
+        return 0;
+    }
+
+    collect_system(s);
+    size_t need = count_processes();
+    if (max_entries && need > max_entries)
+        need = max_entries;
+    snapshot_reserve_procs(s, need);
+    s->count = list_processes(s->procs, s->proc_cap);
+    if (max_entries && s->count > max_entries)
+        s->count = max_entries;
+    perfctr_update(s->procs, s->count);
+    smaps_update(s->procs, s->count);
+    cgroup_throttle_update(s->procs, s->count);
+    /* after the task scan, which counts task states on the way */
+    if (read_misc_stats(&s->misc) != 0)
+        memset(&s->misc, 0, sizeof(s->misc));
+    return 0;
+}
+
+int snapshot_collect_system(struct snapshot *s) {
+    collect_system(s);
+    s->count = 0;
+    if (read_load_stats(&s->misc) != 0)
+        memset(&s->misc, 0, sizeof(s->misc));
+    return 0;
+}
+
+int snapshot_copy(struct snapshot *dst, const struct snapshot *src) {
+    if (snapshot_reserve_procs(dst, src->count) != 0 ||
+        snapshot_reserve_cores(dst, src->core_count) != 0 ||
+        snapshot_reserve_disks(dst, src->disk_count) != 0 ||
+        snapshot_reserve_nets(dst, src->net_count) != 0)
+        return -1;
+    dst->timestamp = src->timestamp;
+    dst->cpu = src->cpu;
+    dst->mem = src->mem;
+    dst->misc = src->misc;
+    dst->psi = src->psi;
+    dst->cpu_usage = src->cpu_usage;
+    if (src->core_count) {
+        memcpy(dst->core_usage, src->core_usage,
+               src->core_count * sizeof(*src->core_usage));
+        memcpy(dst->core_id, src->core_id,
+               src->core_count * sizeof(*src->core_id));
+    }
+    dst->core_count = src->core_count;
+    if (src->disk_count)
+        memcpy(dst->disks, src->disks, src->disk_count * sizeof(*src->disks));
+    dst->disk_count = src->disk_count;
+    if (src->net_count)
+        memcpy(dst->nets, src->nets, src->net_count * sizeof(*src->nets));
+    dst->net_count = src->net_count;
+    if (src->count)
+        memcpy(dst->procs, src->procs, src->count * sizeof(*src->procs));
+    dst->count = src->count;
+    return 0;
+}
+
+void snapshot_free(struct snapshot *s) {
+    free(s->core_usage);
+    free(s->core_id);
+    free(s->disks);
+    free(s->nets);
+    free(s->procs);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,222 @@
+#include "tasks.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* open addressing table, slot unused when pid == 0 */
+static struct task_sample *table;
+static size_t table_cap;
+static size_t table_count;
+static unsigned int epoch;
+
+/* History buffers live in one block: every slot owns samples values for
+ * each metric, stored metric by metric so one sparkline is contiguous. */
+static size_t hist_samples = 120;
+static size_t hist_tasks = 1024;
+static float *hist_data;
+static unsigned short *hist_head;
+static unsigned short *hist_len;
+static int *hist_free;
+static size_t hist_free_count;
+
+static size_t hash_task(int pid, int tid) {
+    unsigned int h = (unsigned int)pid * 2654435761u;
+    h ^= (unsigned int)tid * 40503u;
+    return h;
+}
+
+static struct task_sample *find_slot(struct task_sample *tab, size_t cap,
+                                     int pid, int tid) {
+    size_t i = hash_task(pid, tid) & (cap - 1);
+    while (tab[i].pid != 0 && (tab[i].pid != pid || tab[i].tid != tid))
+        i = (i + 1) & (cap - 1);
+    return &tab[i];
+}
+
+static int rehash(size_t cap) {
+    struct task_sample *tab = calloc(cap, sizeof(*tab));
+    if (!tab)
+        return -1;
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].pid != 0)
+            *find_slot(tab, cap, table[i].pid, table[i].tid) = table[i];
+    }
+    free(table);
+    table = tab;
+    table_cap = cap;
+    return 0;
+}
+
+static void hist_release(struct task_sample *t) {
+    if (t->hist < 0)
+        return;
+    hist_free[hist_free_count++] = t->hist;
+    t->hist = -1;
+}
+
+static void hist_attach(struct task_sample *t) {
+    t->hist = -1;
+    if (hist_samples == 0)
+        return;
+    if (!hist_data) {
+        hist_data = calloc(hist_tasks * hist_samples * TASK_METRIC_COUNT,
+                           sizeof(*hist_data));
+        hist_head = calloc(hist_tasks, sizeof(*hist_head));
+        hist_len = calloc(hist_tasks, sizeof(*hist_len));
+        hist_free = malloc(hist_tasks * sizeof(*hist_free));
+        if (!hist_data || !hist_head || !hist_len || !hist_free) {
+            tasks_set_history(0, 0);
+            return;
+        }
+        for (size_t i = 0; i < hist_tasks; i++)
+            hist_free[i] = (int)(hist_tasks - 1 - i);
+        hist_free_count = hist_tasks;
+    }
+    if (hist_free_count == 0)
+        return;
+    t->hist = hist_free[--hist_free_count];
+    hist_head[t->hist] = 0;
+    hist_len[t->hist] = 0;
+}
+
+unsigned int tasks_begin_scan(void) {
+    return ++epoch;
+}
+
+struct task_sample *tasks_get(int pid, int tid, unsigned long long start,
+                              int *created) {
+    if ((table_count + 1) * 4 > table_cap * 3 &&
+        rehash(table_cap ? table_cap * 2 : 1024) != 0)
+        return NULL;
+    struct task_sample *t = find_slot(table, table_cap, pid, tid);
+    *created = 0;
+    if (t->pid == 0) {
+        memset(t, 0, sizeof(*t));
+        t->pid = pid;
+        t->tid = tid;
+        t->start = start;
+        hist_attach(t);
+        table_count++;
+        *created = 1;
+    } else if (t->start != start) {
+        /* pid reused by a new task */
+        int hist = t->hist;
+        free(t->cmdline);
+        memset(t, 0, sizeof(*t));
+        t->pid = pid;
+        t->tid = tid;
+        t->start = start;
+        t->hist = hist;
+        if (hist >= 0)
+            hist_len[hist] = 0;
+        *created = 1;
+    }
+    t->epoch = epoch;
+    return t;
+}
+
+/* Delete slot i, shifting later members of the probe chain back so that
+ * lookups never stop at the hole. */
+static void remove_slot(size_t i) {
+    size_t mask = table_cap - 1;
+    size_t j = i;
+    for (;;) {
+        table[i].pid = 0;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (table[j].pid == 0)
+                return;
+            size_t k = hash_task(table[j].pid, table[j].tid) & mask;
+            /* stop when j's home lies cyclically outside (i, j] */
+            if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+                break;
+        }
+        table[i] = table[j];
+        i = j;
+    }
+}
+
+struct task_sample *tasks_peek(int pid, int tid) {
+    if (table_cap == 0)
+        return NULL;
+    struct task_sample *t = find_slot(table, table_cap, pid, tid);
+    if (t->pid == 0)
+        return NULL;
+    t->epoch = epoch;
+    return t;
+}
+
+void tasks_set_cmdline(struct task_sample *t, const char *cmdline) {
+    if (t->cmdline && strcmp(t->cmdline, cmdline) == 0)
+        return;
+    free(t->cmdline);
+    t->cmdline = cmdline[0] ? strdup(cmdline) : NULL;
+}
+
+void tasks_end_scan(void) {
+    size_t i = 0;
+    while (i < table_cap) {
+        if (table[i].pid != 0 && table[i].epoch != epoch) {
+            hist_release(&table[i]);
+            free(table[i].cmdline);
+            remove_slot(i);
+            table_count--;
+            /* slot i may now hold an entry moved back from later */
+            continue;
+        }
+        i++;
+    }
+}
+
+size_t tasks_count(void) { return table_count; }
+
+int tasks_set_history(size_t samples, size_t max_tasks) {
+    if (samples > 65535)
+        samples = 65535;
+    for (size_t i = 0; i < table_cap; i++)
+        table[i].hist = -1;
+    free(hist_data);
+    free(hist_head);
+    free(hist_len);
+    free(hist_free);
+    hist_data = NULL;
+    hist_head = NULL;
+    hist_len = NULL;
+    hist_free = NULL;
+    hist_free_count = 0;
+    hist_samples = max_tasks ? samples : 0;
+    hist_tasks = max_tasks;
+    return 0;
+}
+
+size_t tasks_history_samples(void) { return hist_samples; }
+
+void tasks_record(struct task_sample *t, const float values[TASK_METRIC_COUNT]) {
+    if (!t || t->hist < 0 || !hist_data)
+        return;
+    size_t slot = (size_t)t->hist;
+    float *base = hist_data + slot * hist_samples * TASK_METRIC_COUNT;
+    unsigned short head = hist_head[slot];
+    for (int m = 0; m < TASK_METRIC_COUNT; m++)
+        base[m * hist_samples + head] = values[m];
+    hist_head[slot] = (unsigned short)((head + 1) % hist_samples);
+    if (hist_len[slot] < hist_samples)
+        hist_len[slot]++;
+}
+
+size_t tasks_history(int pid, int tid, enum task_metric metric,
+                     float *out, size_t max) {
+    if (!table_cap || !hist_data || metric >= TASK_METRIC_COUNT)
+        return 0;
+    const struct task_sample *t = find_slot(table, table_cap, pid, tid);
+    if (t->pid == 0 || t->hist < 0)
+        return 0;
+    size_t slot = (size_t)t->hist;
+    const float *vals = hist_data + (slot * TASK_METRIC_COUNT + metric) * hist_samples;
+    size_t len = hist_len[slot];
+    size_t n = len < max ? len : max;
+    /* newest value sits just before head */
+    size_t first = (hist_head[slot] + hist_samples - n) % hist_samples;
+    for (size_t i = 0; i < n; i++)
+        out[i] = vals[(first + i) % hist_samples];
+    return n;
+}
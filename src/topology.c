@@ -0,0 +1,73 @@
+#define _GNU_SOURCE
+#include "topology.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+
+static struct cpu_topology *cache;
+/* 1 once an entry has been read */
+static unsigned char *loaded;
+static size_t cache_cap;
+static const struct cpu_topology unknown = { -1, -1, -1 };
+
+static int read_int(unsigned int cpu, const char *file) {
+    char path[128];
+    snprintf(path, sizeof(path), CPU_SYSFS "/cpu%u/topology/%s", cpu, file);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    int v;
+    if (fscanf(fp, "%d", &v) != 1)
+        v = -1;
+    fclose(fp);
+    return v;
+}
+
+/* The cpuN directory links to its node as nodeM. */
+static int read_node(unsigned int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), CPU_SYSFS "/cpu%u", cpu);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int node = -1;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) == 0 &&
+            isdigit((unsigned char)ent->d_name[4])) {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+const struct cpu_topology *topology_get(unsigned int cpu) {
+    if (cpu >= cache_cap) {
+        size_t cap = cache_cap ? cache_cap : 64;
+        while (cap <= cpu)
+            cap *= 2;
+        struct cpu_topology *tmp = realloc(cache, cap * sizeof(*tmp));
+        if (!tmp)
+            return &unknown;
+        cache = tmp;
+        unsigned char *flags = realloc(loaded, cap);
+        if (!flags)
+            return &unknown;
+        memset(flags + cache_cap, 0, cap - cache_cap);
+        loaded = flags;
+        cache_cap = cap;
+    }
+    if (!loaded[cpu]) {
+        cache[cpu].package = read_int(cpu, "physical_package_id");
+        cache[cpu].core = read_int(cpu, "core_id");
+        cache[cpu].node = read_node(cpu);
+        loaded[cpu] = 1;
+    }
+    return &cache[cpu];
+}
@@ -1,6 +1,18 @@
 #include "proc.h"
 #include "ui.h"
 #include "control.h"
+#include "snapshot.h"
+#include "record.h"
+#include "tasks.h"
+#include "selfstat.h"
+#include "budget.h"
+#include "perfctr.h"
+#include "smaps.h"
+#include "cgroup.h"
+#include "disk.h"
+#include "net.h"
+#include "irq.h"
+#include "topology.h"
 #ifdef WITH_UI
 #include <ncurses.h>
 #include <stdio.h>
@@ -9,17 +21,16 @@
 #include <unistd.h>
 #include <signal.h>
 #include <ctype.h>
+#include <time.h>
 
 #define MIN_DELAY_MS 100
 #define MAX_DELAY_MS 10000
 
-static unsigned long long prev_total;
-static unsigned long long prev_idle;
+/* replay speed limits */
+#define MIN_REPLAY_SPEED (1.0 / 16.0)
+#define MAX_REPLAY_SPEED 64.0
 
-static double *core_usage;
-static unsigned long long *core_prev_total;
-static unsigned long long *core_prev_idle;
-static size_t core_count;
+/* per-core display: 0 off, 1 grid, 2 heat map */
 static int show_cores;
 static int show_full_cmd;
 static int show_threads;
@@ -41,11 +52,38 @@ static int color_scheme = 1;
 static int show_forest;
 static int show_cpu_summary = 1;
 static int show_mem_summary = 1;
+static int show_pressure = 1;
+static int show_disks;
+/* 0 off, 1 summary line, 2 summary and interface panel */
+static int show_net = 1;
 static int highlight_sort = 1;
 static int show_bold;
+static int show_self_stats;
+/* grouping of the per-core display by sysfs topology */
+enum core_group {
+    CORE_GROUP_NONE,
+    CORE_GROUP_SOCKET,
+    CORE_GROUP_NODE,
+    CORE_GROUP_CORE,
+    CORE_GROUP_COUNT
+};
+static const char *const core_group_names[CORE_GROUP_COUNT] = {
+    "none", "socket", "node", "core"
+};
+static int core_group;
+/* cgroup tree instead of tasks */
+static int show_cgroups;
+/* interrupt heat map instead of tasks */
+static int show_irqs;
 
 #define CP_SORT 1
 #define CP_RUNNING 2
+#define CP_ALERT 3
+
+/* some avg10 from which a pressure figure is highlighted */
+#define PRESSURE_WARN 10.0
+/* disk utilization from which a device is highlighted */
+#define DISK_UTIL_WARN 90.0
 
 static enum sort_field current_sort;
 static int (*compare_procs)(const void *, const void *) = cmp_proc_pid;
@@ -68,6 +106,22 @@ enum column_id {
     COL_START,
     COL_READ,
     COL_WRITE,
+    COL_HIST,
+    COL_WAIT,
+    COL_AVGWAIT,
+    COL_IPC,
+    COL_MPKI,
+    COL_PSS,
+    COL_USS,
+    COL_SWPSS,
+    COL_SYSCR,
+    COL_SYSCW,
+    COL_MINFLT,
+    COL_MAJFLT,
+    COL_VCSW,
+    COL_IVCSW,
+    COL_THROTTLE,
+    COL_THRMS,
     COL_COUNT
 };
 
@@ -98,10 +152,75 @@ static struct column_def columns[COL_COUNT] = {
     {COL_CPUP,  "CPU%",    6, 0, 1,12},
     {COL_TIME,  "TIME",    8, 0, 1,13},
     {COL_START, "START",   8, 1, 1,14},
-    {COL_READ,  "READ",    8, 0, 0,15},
-    {COL_WRITE, "WRITE",   8, 0, 0,16}
+    {COL_READ,  "READ/s",  8, 0, 0,15},
+    {COL_WRITE, "WRITE/s", 8, 0, 0,16},
+    {COL_HIST,  "HIST",   12, 1, 0,17},
+    {COL_WAIT,  "WAIT%",   6, 0, 0,18},
+    {COL_AVGWAIT, "AVGWAIT", 8, 0, 0,19},
+    {COL_IPC,   "IPC",     6, 0, 0,20},
+    {COL_MPKI,  "MPKI",    6, 0, 0,21},
+    {COL_PSS,   "PSS",     8, 0, 0,22},
+    {COL_USS,   "USS",     8, 0, 0,23},
+    {COL_SWPSS, "SWAPPSS", 8, 0, 0,24},
+    {COL_SYSCR, "SYSCR/s", 8, 0, 0,25},
+    {COL_SYSCW, "SYSCW/s", 8, 0, 0,26},
+    {COL_MINFLT, "MINFLT/s", 8, 0, 0,27},
+    {COL_MAJFLT, "MAJFLT/s", 8, 0, 0,28},
+    {COL_VCSW,  "VCSW/s",  7, 0, 0,29},
+    {COL_IVCSW, "IVCSW/s", 7, 0, 0,30},
+    {COL_THROTTLE, "THROTTLE%", 9, 0, 0,31},
+    {COL_THRMS, "THRMS/s", 8, 0, 0,32}
 };
 
+/* WAIT% or AVGWAIT is enabled, so schedstat has to be read */
+static int wait_shown(void) {
+    return columns[COL_WAIT].enabled || columns[COL_AVGWAIT].enabled;
+}
+
+/* VCSW/s or IVCSW/s is enabled, so threads have to be summed */
+static int ctxsw_shown(void) {
+    return columns[COL_VCSW].enabled || columns[COL_IVCSW].enabled;
+}
+
+static void show_wait_columns(void) {
+    columns[COL_WAIT].enabled = 1;
+    columns[COL_AVGWAIT].enabled = 1;
+}
+
+static void show_ctxsw_columns(void) {
+    columns[COL_VCSW].enabled = 1;
+    columns[COL_IVCSW].enabled = 1;
+}
+
+/* THROTTLE% or THRMS/s is enabled, so cgroups have to be mapped */
+static int throttle_shown(void) {
+    return columns[COL_THROTTLE].enabled || columns[COL_THRMS].enabled;
+}
+
+static void show_throttle_columns(void) {
+    columns[COL_THROTTLE].enabled = 1;
+    columns[COL_THRMS].enabled = 1;
+}
+
+/* PSS, USS or SWAPPSS is enabled, so smaps_rollup has to be read */
+static int pss_shown(void) {
+    return columns[COL_PSS].enabled || columns[COL_USS].enabled ||
+           columns[COL_SWPSS].enabled;
+}
+
+/* --pss asks for the smaps columns */
+static void show_pss_columns(void) {
+    columns[COL_PSS].enabled = 1;
+    columns[COL_USS].enabled = 1;
+    columns[COL_SWPSS].enabled = 1;
+}
+
+/* --perf asks for the counter columns */
+static void show_perf_columns(void) {
+    columns[COL_IPC].enabled = 1;
+    columns[COL_MPKI].enabled = 1;
+}
+
 void ui_list_fields(void) {
     for (int i = 0; i < COL_COUNT; i++)
         printf("%s\n", columns[i].title);
@@ -136,16 +255,47 @@ void ui_set_show_full_cmd(int on) { show_full_cmd = on != 0; }
 
 void ui_set_show_idle(int on) { show_idle = on != 0; }
 
-void ui_set_show_cores(int on) { show_cores = on != 0; }
+void ui_set_show_cores(int mode) {
+    show_cores = mode < 0 ? 0 : mode > 2 ? 2 : mode;
+}
+
+int ui_set_core_group(const char *name) {
+    for (int i = 0; i < CORE_GROUP_COUNT; i++) {
+        if (strcmp(name, core_group_names[i]) == 0) {
+            core_group = i;
+            return 0;
+        }
+    }
+    return -1;
+}
 
 void ui_set_hide_kthreads(int on) { hide_kthreads = on != 0; }
 
+/* recording to replay instead of reading /proc */
+static struct recording *replay_rec;
+
+void ui_set_show_self_stats(int on) {
+    show_self_stats = on;
+    self_set_enabled(on);
+}
+
+void ui_set_replay(struct recording *rec) { replay_rec = rec; }
+
+void ui_set_show_cgroups(int on) { show_cgroups = on != 0; }
+
+void ui_set_show_irqs(int on) { show_irqs = on != 0; }
+
+void ui_set_show_disks(int on) { show_disks = on != 0; }
+
+void ui_set_show_net(int mode) { show_net = mode < 0 ? 0 : mode > 2 ? 2 : mode; }
+
 static void apply_color_scheme(void) {
     if (!has_colors())
         return;
     const struct color_scheme *cs = &color_schemes[color_scheme];
     init_pair(CP_SORT, cs->sort, -1);
     init_pair(CP_RUNNING, cs->running, -1);
+    init_pair(CP_ALERT, color_scheme ? COLOR_RED : -1, -1);
 }
 
 int ui_load_config(unsigned int *delay_ms, enum sort_field *sort) {
@@ -186,11 +336,25 @@ int ui_load_config(unsigned int *delay_ms, enum sort_field *sort) {
                 else if (strcmp(val, "pri") == 0 ||
                          strcmp(val, "priority") == 0)
                     *sort = SORT_PRI;
+                else if (strcmp(val, "wait") == 0)
+                    *sort = SORT_WAIT;
+                else if (strcmp(val, "pss") == 0)
+                    *sort = SORT_PSS;
+                else if (strcmp(val, "io") == 0)
+                    *sort = SORT_IO;
+                else if (strcmp(val, "faults") == 0)
+                    *sort = SORT_FAULTS;
+                else if (strcmp(val, "ctxsw") == 0)
+                    *sort = SORT_CTXSW;
+                else if (strcmp(val, "throttle") == 0)
+                    *sort = SORT_THROTTLE;
                 else
                     *sort = SORT_PID;
             }
         } else if (strcmp(key, "show_cores") == 0) {
-            show_cores = atoi(val);
+            ui_set_show_cores(atoi(val));
+        } else if (strcmp(key, "core_group") == 0) {
+            ui_set_core_group(val);
         } else if (strcmp(key, "show_full_cmd") == 0) {
             show_full_cmd = atoi(val);
         } else if (strcmp(key, "show_threads") == 0) {
@@ -205,6 +369,12 @@ int ui_load_config(unsigned int *delay_ms, enum sort_field *sort) {
             show_cpu_summary = atoi(val);
         } else if (strcmp(key, "show_mem_summary") == 0) {
             show_mem_summary = atoi(val);
+        } else if (strcmp(key, "show_pressure") == 0) {
+            show_pressure = atoi(val);
+        } else if (strcmp(key, "show_disks") == 0) {
+            show_disks = atoi(val);
+        } else if (strcmp(key, "show_net") == 0) {
+            ui_set_show_net(atoi(val));
         } else if (strcmp(key, "summary_unit") == 0) {
             summary_unit = parse_mem_unit(val);
         } else if (strcmp(key, "proc_unit") == 0) {
@@ -268,8 +438,21 @@ int ui_save_config(unsigned int delay_ms, enum sort_field sort) {
         s = "time";
     else if (sort == SORT_PRI)
         s = "pri";
+    else if (sort == SORT_WAIT)
+        s = "wait";
+    else if (sort == SORT_PSS)
+        s = "pss";
+    else if (sort == SORT_IO)
+        s = "io";
+    else if (sort == SORT_FAULTS)
+        s = "faults";
+    else if (sort == SORT_CTXSW)
+        s = "ctxsw";
+    else if (sort == SORT_THROTTLE)
+        s = "throttle";
     fprintf(fp, "sort=%s\n", s);
     fprintf(fp, "show_cores=%d\n", show_cores);
+    fprintf(fp, "core_group=%s\n", core_group_names[core_group]);
     fprintf(fp, "show_full_cmd=%d\n", show_full_cmd);
     fprintf(fp, "show_threads=%d\n", show_threads);
     fprintf(fp, "show_idle=%d\n", show_idle);
@@ -277,6 +460,9 @@ int ui_save_config(unsigned int delay_ms, enum sort_field sort) {
     fprintf(fp, "show_forest=%d\n", show_forest);
     fprintf(fp, "show_cpu_summary=%d\n", show_cpu_summary);
     fprintf(fp, "show_mem_summary=%d\n", show_mem_summary);
+    fprintf(fp, "show_pressure=%d\n", show_pressure);
+    fprintf(fp, "show_disks=%d\n", show_disks);
+    fprintf(fp, "show_net=%d\n", show_net);
     fprintf(fp, "summary_unit=%s\n", mem_unit_suffix(summary_unit));
     fprintf(fp, "proc_unit=%s\n", mem_unit_suffix(proc_unit));
     fprintf(fp, "color_scheme=%d\n", color_scheme);
@@ -337,6 +523,18 @@ static enum column_id get_sort_column(void) {
         return COL_TIME;
     case SORT_PRI:
         return COL_PRI;
+    case SORT_WAIT:
+        return COL_WAIT;
+    case SORT_PSS:
+        return COL_PSS;
+    case SORT_IO:
+        return COL_READ;
+    case SORT_FAULTS:
+        return COL_MAJFLT;
+    case SORT_CTXSW:
+        return COL_IVCSW;
+    case SORT_THROTTLE:
+        return COL_THROTTLE;
     case SORT_PID:
     default:
         return COL_PID;
@@ -362,6 +560,34 @@ static void draw_header(int row) {
     }
 }
 
+/* sparkline levels from idle to busy */
+static const char spark_levels[] = " .:-=+*#%@";
+
+/* Render the last width values of vals into out as a sparkline. Values
+ * are scaled to max(largest value, floor). */
+static void format_sparkline(char *out, int width, const float *vals,
+                             size_t n, float floor) {
+    size_t first = n > (size_t)width ? n - (size_t)width : 0;
+    float max = floor;
+    for (size_t i = first; i < n; i++)
+        if (vals[i] > max)
+            max = vals[i];
+    int pad = width - (int)(n - first);
+    int j = 0;
+    while (j < pad)
+        out[j++] = ' ';
+    const int top = (int)sizeof(spark_levels) - 2;
+    for (size_t i = first; i < n; i++) {
+        int lvl = max > 0.0f ? (int)(vals[i] / max * (float)top + 0.5f) : 0;
+        if (lvl < 0)
+            lvl = 0;
+        if (lvl > top)
+            lvl = top;
+        out[j++] = spark_levels[lvl];
+    }
+    out[j] = '\0';
+}
+
 static void draw_process_row(int row, const struct process_info *p) {
     int x = 0;
     enum column_id sort_col = get_sort_column();
@@ -430,6 +656,20 @@ static void draw_process_row(int row, const struct process_info *p) {
                      columns[i].width, rss);
             break;
         }
+        case COL_PSS:
+        case COL_USS:
+        case COL_SWPSS: {
+            long kb = columns[i].id == COL_PSS ? p->pss :
+                      columns[i].id == COL_USS ? p->uss : p->swap_pss;
+            if (kb < 0)
+                mvprintw(row, x, columns[i].left ? "%-*s" : "%*s",
+                         columns[i].width, "-");
+            else
+                mvprintw(row, x, columns[i].left ? "%-*.1f" : "%*.1f",
+                         columns[i].width,
+                         scale_kb((unsigned long long)kb, proc_unit));
+            break;
+        }
         case COL_SHR: {
             double shr = scale_kb(p->shared, proc_unit);
             mvprintw(row, x, columns[i].left ? "%-*.1f" : "%*.1f",
@@ -457,17 +697,69 @@ static void draw_process_row(int row, const struct process_info *p) {
                      columns[i].width, p->start_time);
             break;
         case COL_READ: {
-            double rb = scale_kb(p->read_bytes / 1024ULL, proc_unit);
+            double rb = scale_kb((unsigned long long)(p->read_rate / 1024.0),
+                                 proc_unit);
             mvprintw(row, x, columns[i].left ? "%-*.1f" : "%*.1f",
                      columns[i].width, rb);
             break;
         }
         case COL_WRITE: {
-            double wb = scale_kb(p->write_bytes / 1024ULL, proc_unit);
+            double wb = scale_kb((unsigned long long)(p->write_rate / 1024.0),
+                                 proc_unit);
             mvprintw(row, x, columns[i].left ? "%-*.1f" : "%*.1f",
                      columns[i].width, wb);
             break;
         }
+        case COL_SYSCR:
+        case COL_SYSCW:
+        case COL_MINFLT:
+        case COL_MAJFLT:
+        case COL_VCSW:
+        case COL_IVCSW: {
+            double v = columns[i].id == COL_SYSCR ? p->syscr_rate :
+                       columns[i].id == COL_SYSCW ? p->syscw_rate :
+                       columns[i].id == COL_MINFLT ? p->minflt_rate :
+                       columns[i].id == COL_MAJFLT ? p->majflt_rate :
+                       columns[i].id == COL_VCSW ? p->vcsw_rate :
+                       p->ivcsw_rate;
+            mvprintw(row, x, columns[i].left ? "%-*.0f" : "%*.0f",
+                     columns[i].width, v);
+            break;
+        }
+        case COL_HIST: {
+            float vals[64];
+            char buf[65];
+            int w = columns[i].width < 64 ? columns[i].width : 64;
+            size_t n = tasks_history(p->pid, p->tid, TASK_METRIC_CPU, vals,
+                                     (size_t)w);
+            format_sparkline(buf, w, vals, n, 1.0f);
+            mvprintw(row, x, "%-*s", columns[i].width, buf);
+            break;
+        }
+        case COL_WAIT:
+            mvprintw(row, x, columns[i].left ? "%-*.2f" : "%*.2f",
+                     columns[i].width, p->wait_percent);
+            break;
+        case COL_AVGWAIT:
+            mvprintw(row, x, columns[i].left ? "%-*.1f" : "%*.1f",
+                     columns[i].width, p->wait_slice);
+            break;
+        case COL_IPC:
+        case COL_MPKI:
+        case COL_THROTTLE:
+        case COL_THRMS: {
+            double v = columns[i].id == COL_IPC ? p->ipc :
+                       columns[i].id == COL_MPKI ? p->mpki :
+                       columns[i].id == COL_THROTTLE ? p->throttle_percent :
+                       p->throttle_ms;
+            if (v < 0.0)
+                mvprintw(row, x, columns[i].left ? "%-*s" : "%*s",
+                         columns[i].width, "-");
+            else
+                mvprintw(row, x, columns[i].left ? "%-*.2f" : "%*.2f",
+                         columns[i].width, v);
+            break;
+        }
         default:
             break;
         }
@@ -481,6 +773,394 @@ static void draw_process_row(int row, const struct process_info *p) {
         attroff(COLOR_PAIR(CP_RUNNING));
 }
 
+/* One resource of the pressure line, highlighted above PRESSURE_WARN */
+static void draw_pressure(const char *name, const struct pressure_resource *r) {
+    int alert = color_scheme && r->some_avg10 >= PRESSURE_WARN;
+    if (alert)
+        attron(COLOR_PAIR(CP_ALERT));
+    printw("  %s some %.2f", name, r->some_avg10);
+    if (r->full_avg10 < 0.0)
+        printw(" full -");
+    else
+        printw(" full %.2f", r->full_avg10);
+    printw(" +%.0fms", r->some_delta / 1000.0);
+    if (alert)
+        attroff(COLOR_PAIR(CP_ALERT));
+}
+
+/* The disk panel from row on, at most max devices. Returns the rows
+ * drawn. */
+static int draw_disks(int row, const struct snapshot *s, int max) {
+    if (max < 2 || s->disk_count == 0)
+        return 0;
+    mvprintw(row, 0, "%-12s %8s %8s %8s %8s %7s %6s", "DEVICE", "R/s", "W/s",
+             "READ/s", "WRITE/s", "AWAIT", "UTIL%");
+    int n = 1;
+    for (size_t i = 0; i < s->disk_count && n < max; i++, n++) {
+        const struct disk_info *d = &s->disks[i];
+        int alert = color_scheme && d->util >= DISK_UTIL_WARN;
+        if (alert)
+            attron(COLOR_PAIR(CP_ALERT));
+        mvprintw(row + n, 0, "%-12s %8.1f %8.1f %8.1f %8.1f %7.2f %6.1f",
+                 d->name, d->read_iops, d->write_iops,
+                 scale_kb((unsigned long long)(d->read_rate / 1024.0), proc_unit),
+                 scale_kb((unsigned long long)(d->write_rate / 1024.0), proc_unit),
+                 d->await, d->util);
+        if (alert)
+            attroff(COLOR_PAIR(CP_ALERT));
+    }
+    return n;
+}
+
+/* Traffic of every interface but loopback on one line, drops and
+ * errors in red. Returns 0 when there is no interface to sum. */
+static int draw_net_summary(int row, const struct snapshot *s) {
+    struct net_info t;
+    size_t ifaces = net_total(s->nets, s->net_count, &t);
+    if (!ifaces)
+        return 0;
+    const char *unit = mem_unit_suffix(summary_unit);
+    mvprintw(row, 0, "net rx %.1f%s/s %.0f pkt/s  tx %.1f%s/s %.0f pkt/s",
+             scale_kb((unsigned long long)(t.rx_rate / 1024.0), summary_unit),
+             unit, t.rx_packets,
+             scale_kb((unsigned long long)(t.tx_rate / 1024.0), summary_unit),
+             unit, t.tx_packets);
+    double drops = t.rx_drops + t.tx_drops;
+    double errors = t.rx_errors + t.tx_errors;
+    int alert = color_scheme && drops + errors > 0.0;
+    if (alert)
+        attron(COLOR_PAIR(CP_ALERT));
+    printw("  drop %.0f/s  err %.0f/s", drops, errors);
+    if (alert)
+        attroff(COLOR_PAIR(CP_ALERT));
+    printw("  %zu interface%s", ifaces, ifaces == 1 ? "" : "s");
+    return 1;
+}
+
+/* The interface panel from row on, at most max rows. Returns the rows
+ * drawn. */
+static int draw_nets(int row, const struct snapshot *s, int max) {
+    if (max < 2 || s->net_count == 0)
+        return 0;
+    mvprintw(row, 0, "%-12s %8s %8s %8s %8s %7s %7s %7s %7s", "IFACE", "RX/s",
+             "TX/s", "RXPKT/s", "TXPKT/s", "RXDRP/s", "TXDRP/s", "RXERR/s",
+             "TXERR/s");
+    int n = 1;
+    for (size_t i = 0; i < s->net_count && n < max; i++, n++) {
+        const struct net_info *d = &s->nets[i];
+        int alert = color_scheme && d->rx_drops + d->tx_drops +
+                                    d->rx_errors + d->tx_errors > 0.0;
+        if (alert)
+            attron(COLOR_PAIR(CP_ALERT));
+        mvprintw(row + n, 0, "%-12s %8.1f %8.1f %8.0f %8.0f %7.0f %7.0f %7.0f %7.0f",
+                 d->name,
+                 scale_kb((unsigned long long)(d->rx_rate / 1024.0), proc_unit),
+                 scale_kb((unsigned long long)(d->tx_rate / 1024.0), proc_unit),
+                 d->rx_packets, d->tx_packets, d->rx_drops, d->tx_drops,
+                 d->rx_errors, d->tx_errors);
+        if (alert)
+            attroff(COLOR_PAIR(CP_ALERT));
+    }
+    return n;
+}
+
+/* vmstat rates after the memory sizes. Direct reclaim, allocation
+ * stalls and OOM kills mean tasks wait for memory and are shown in red. */
+static void draw_vm_rates(const struct vm_rates *vm) {
+    printw("  si %.0f so %.0f pg/s  majflt %.0f/s  kswapd scan %.0f steal %.0f",
+           vm->swap_in, vm->swap_out, vm->major_faults, vm->scan_kswapd,
+           vm->steal_kswapd);
+    int alert = color_scheme && (vm->scan_direct > 0.0 ||
+                                 vm->alloc_stalls > 0.0 || vm->oom_kills > 0.0);
+    if (alert)
+        attron(COLOR_PAIR(CP_ALERT));
+    printw("  direct scan %.0f steal %.0f  stall %.1f/s  oom %.1f/s",
+           vm->scan_direct, vm->steal_direct, vm->alloc_stalls, vm->oom_kills);
+    if (alert)
+        attroff(COLOR_PAIR(CP_ALERT));
+}
+
+/* width of a grid cell, "cpuN xx.x%" and a space */
+#define CORE_CELL_WIDTH 13
+/* width of the group label before the cells */
+#define CORE_LABEL_WIDTH 8
+/* busy percentage from which a CPU is highlighted */
+#define CORE_BUSY_WARN 90.0
+
+struct core_slot {
+    unsigned int cpu;
+    int group;
+    int core;
+    double usage;
+};
+
+static struct core_slot *core_slots;
+static size_t core_slot_cap;
+
+static int cmp_core_slot(const void *a, const void *b) {
+    const struct core_slot *x = a;
+    const struct core_slot *y = b;
+    if (x->group != y->group)
+        return x->group < y->group ? -1 : 1;
+    if (x->core != y->core)
+        return x->core < y->core ? -1 : 1;
+    return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+/* The CPUs of the snapshot in drawing order: by group and, grouped by
+ * core, SMT siblings next to each other. */
+static size_t order_cores(const struct snapshot *s) {
+    size_t n = s->core_count;
+    if (n > core_slot_cap) {
+        struct core_slot *tmp = realloc(core_slots, n * sizeof(*tmp));
+        if (!tmp)
+            return 0;
+        core_slots = tmp;
+        core_slot_cap = n;
+    }
+    for (size_t i = 0; i < n; i++) {
+        struct core_slot *c = &core_slots[i];
+        c->cpu = s->core_id[i];
+        c->usage = s->core_usage[i];
+        c->group = -1;
+        c->core = -1;
+        if (core_group == CORE_GROUP_NONE)
+            continue;
+        const struct cpu_topology *t = topology_get(c->cpu);
+        c->group = core_group == CORE_GROUP_NODE ? t->node : t->package;
+        if (core_group == CORE_GROUP_CORE)
+            c->core = t->core;
+    }
+    if (core_group != CORE_GROUP_NONE)
+        qsort(core_slots, n, sizeof(*core_slots), cmp_core_slot);
+    return n;
+}
+
+static char core_shade(double usage) {
+    static const char levels[] = " .:-=+*#%@";
+    if (usage <= 0.0)
+        return levels[0];
+    int level = 1 + (int)(usage / 100.0 * 9.0);
+    return levels[level > 9 ? 9 : level];
+}
+
+/* Lay the CPUs out from row on, a line per group and as many more as the
+ * width needs, drawing the first max lines when draw is set. Returns the
+ * lines the layout needs. In the heat map a space separates physical
+ * cores when grouping by core. */
+static int layout_cores(int row, size_t n, int heat, int max, int draw) {
+    int label = core_group != CORE_GROUP_NONE ? CORE_LABEL_WIDTH : 0;
+    int cell = heat ? 1 : CORE_CELL_WIDTH;
+    int lines = 0;
+    int x = 0;
+    for (size_t i = 0; i < n; i++) {
+        const struct core_slot *c = &core_slots[i];
+        int first = i == 0 || c->group != core_slots[i - 1].group;
+        int gap = heat && core_group == CORE_GROUP_CORE && !first &&
+                  c->core != core_slots[i - 1].core;
+        if (first || x + gap + cell > COLS) {
+            lines++;
+            x = label;
+            gap = 0;
+            if (draw && first && label && lines <= max) {
+                const char *kind = core_group == CORE_GROUP_NODE ? "node"
+                                                                 : "pkg";
+                if (c->group < 0)
+                    mvprintw(row + lines - 1, 0, "%s?", kind);
+                else
+                    mvprintw(row + lines - 1, 0, "%s%d", kind, c->group);
+            }
+        }
+        x += gap;
+        if (draw && lines <= max) {
+            int alert = c->usage >= CORE_BUSY_WARN;
+            if (alert)
+                attron(color_scheme ? COLOR_PAIR(CP_ALERT) : A_BOLD);
+            if (heat)
+                mvaddch(row + lines - 1, x, core_shade(c->usage));
+            else
+                mvprintw(row + lines - 1, x, "cpu%-3u%5.1f%%", c->cpu,
+                         c->usage);
+            if (alert)
+                attroff(color_scheme ? COLOR_PAIR(CP_ALERT) : A_BOLD);
+        }
+        x += cell;
+    }
+    return lines;
+}
+
+/* Per-core usage from row on in at most max rows: a grid of percentages
+ * when it fits, else a heat map of one character per CPU. Returns the
+ * rows drawn. */
+static int draw_cores(int row, const struct snapshot *s, int max) {
+    if (max < 1)
+        return 0;
+    size_t n = order_cores(s);
+    int heat = show_cores == 2 || COLS < CORE_LABEL_WIDTH + CORE_CELL_WIDTH ||
+               layout_cores(row, n, 0, max, 0) > max;
+    int lines = layout_cores(row, n, heat, max, 1);
+    return lines < max ? lines : max;
+}
+
+/* busiest cells of the interrupt view, highlighted in the heat map */
+#define IRQ_HOT 5
+/* columns before the heat map: name and total rate */
+#define IRQ_LABEL_WIDTH 32
+
+static int irq_is_hot(const struct irq_hot *hot, size_t nhot,
+                      enum irq_kind kind, size_t r, size_t col, size_t width) {
+    for (size_t i = 0; i < nhot; i++) {
+        if (hot[i].kind == kind && hot[i].row == r && hot[i].col >= col &&
+            hot[i].col < col + width)
+            return 1;
+    }
+    return 0;
+}
+
+/* Title and CPU axis of one table, a CPU number every 8 cells */
+static void draw_irq_header(int row, const char *title,
+                            const struct irq_table *t, size_t width) {
+    if (color_scheme)
+        attron(COLOR_PAIR(CP_SORT));
+    mvprintw(row, 0, "%-20s %9s  ", title, "TOTAL/s");
+    if (color_scheme)
+        attroff(COLOR_PAIR(CP_SORT));
+    for (size_t c = 0; c * width < t->ncpu; c += 8) {
+        if (IRQ_LABEL_WIDTH + (int)c >= COLS)
+            break;
+        mvprintw(row, IRQ_LABEL_WIDTH + (int)c, "%d", t->cpu_ids[c * width]);
+    }
+}
+
+static void draw_irq_row(int row, const struct irq_table *t,
+                         enum irq_kind kind, size_t r, size_t width,
+                         double max, const struct irq_hot *hot, size_t nhot) {
+    mvprintw(row, 0, "%-20.20s %9.0f  ", t->names[r], t->totals[r]);
+    for (size_t col = 0, x = IRQ_LABEL_WIDTH; col < t->ncpu && (int)x < COLS;
+         col += width, x++) {
+        int alert = irq_is_hot(hot, nhot, kind, r, col, width);
+        int attr = color_scheme ? COLOR_PAIR(CP_ALERT) | A_BOLD : A_REVERSE;
+        if (alert)
+            attron(attr);
+        mvaddch(row, (int)x, irq_shade(irq_cell(t, r, col, width), max));
+        if (alert)
+            attroff(attr);
+    }
+}
+
+/* Softirqs and then the busiest interrupts as rows of one character per
+ * CPU, several CPUs to a character when they do not fit the width. */
+static void draw_irqs(int row, int max_rows) {
+    const struct irq_table *soft = irq_get(IRQ_SOFT);
+    const struct irq_table *hard = irq_get(IRQ_HARD);
+    size_t ncpu = soft->ncpu > hard->ncpu ? soft->ncpu : hard->ncpu;
+    int avail = COLS - IRQ_LABEL_WIDTH;
+    if (max_rows < 4 || avail < 1 || ncpu == 0)
+        return;
+    size_t width = (ncpu + (size_t)avail - 1) / (size_t)avail;
+    double max = soft->max > hard->max ? soft->max : hard->max;
+    struct irq_hot hot[IRQ_HOT];
+    size_t nhot = irq_top(hot, IRQ_HOT);
+
+    int end = row + max_rows;
+    mvprintw(row++, 0, "interrupts per CPU, %zu CPUs", ncpu);
+    if (width > 1)
+        printw(", %zu to a column", width);
+    printw(", scale \" .:-=+*#%%@\" up to %.0f/s", max);
+    /* the hot list sits on the last row */
+    end--;
+    if (soft->nrows && row < end) {
+        draw_irq_header(row++, "SOFTIRQ", soft, width);
+        for (size_t r = 0; r < soft->nrows && row < end; r++)
+            draw_irq_row(row++, soft, IRQ_SOFT, r, width, max, hot, nhot);
+    }
+    if (hard->nrows && row + 1 < end) {
+        draw_irq_header(row++, "IRQ", hard, width);
+        for (size_t i = 0; i < hard->nrows && row < end; i++) {
+            size_t r = hard->order[i];
+            if (hard->totals[r] <= 0.0)
+                break;
+            draw_irq_row(row++, hard, IRQ_HARD, r, width, max, hot, nhot);
+        }
+    }
+    if (nhot == 0)
+        return;
+    mvprintw(end, 0, "hot");
+    if (color_scheme)
+        attron(COLOR_PAIR(CP_ALERT));
+    for (size_t i = 0; i < nhot; i++) {
+        const struct irq_table *t = irq_get(hot[i].kind);
+        printw("  %s cpu%d %.0f/s", t->names[hot[i].row],
+               t->cpu_ids[hot[i].col], hot[i].rate);
+    }
+    if (color_scheme)
+        attroff(COLOR_PAIR(CP_ALERT));
+}
+
+static void draw_cgroup_header(int row) {
+    if (highlight_sort && color_scheme)
+        attron(COLOR_PAIR(CP_SORT));
+    mvprintw(row, 0, "%6s", "CPU%");
+    if (highlight_sort && color_scheme)
+        attroff(COLOR_PAIR(CP_SORT));
+    printw(" %8s %8s %8s %8s %8s %7s %7s %6s %6s %6s  %s", "MEM", "ANON",
+           "FILE", "READ/s", "WRITE/s", "RIOPS", "WIOPS", "CPUPSI", "MEMPSI",
+           "IOPSI", "CGROUP");
+}
+
+/* A cgroup size in the process unit, "-" when the file is missing */
+static void print_cgroup_kb(long long kb) {
+    if (kb < 0)
+        printw(" %8s", "-");
+    else
+        printw(" %8.1f", scale_kb((unsigned long long)kb, proc_unit));
+}
+
+static void draw_cgroup_row(int row, const struct cgroup_info *c,
+                            int selected) {
+    const char *name = c->level ? strrchr(c->path, '/') + 1 : c->path;
+    if (selected)
+        attron(A_REVERSE);
+    if (show_bold)
+        attron(A_BOLD);
+    mvprintw(row, 0, "%6.1f", c->cpu_usage);
+    print_cgroup_kb(c->memory);
+    print_cgroup_kb(c->anon);
+    print_cgroup_kb(c->file);
+    if (c->read_rate < 0.0)
+        printw(" %8s %8s %7s %7s", "-", "-", "-", "-");
+    else
+        printw(" %8.1f %8.1f %7.0f %7.0f",
+               scale_kb((unsigned long long)(c->read_rate / 1024.0), proc_unit),
+               scale_kb((unsigned long long)(c->write_rate / 1024.0), proc_unit),
+               c->rios_rate, c->wios_rate);
+    const double psi[3] = {
+        c->cpu_pressure, c->memory_pressure, c->io_pressure
+    };
+    for (int i = 0; i < 3; i++) {
+        int alert = !selected && color_scheme && psi[i] >= PRESSURE_WARN;
+        if (alert)
+            attron(COLOR_PAIR(CP_ALERT));
+        if (psi[i] < 0.0)
+            printw(" %6s", "-");
+        else
+            printw(" %6.2f", psi[i]);
+        if (alert)
+            attroff(COLOR_PAIR(CP_ALERT));
+    }
+    printw("  %*s%s", 2 * c->level, "", name);
+    if (selected) {
+        /* the bar spans the row */
+        int y, x;
+        getyx(stdscr, y, x);
+        if (y == row && x < COLS)
+            printw("%*s", COLS - x, "");
+        attroff(A_REVERSE);
+    }
+    if (show_bold)
+        attroff(A_BOLD);
+}
+
 static void field_manager(void) {
     const int n = COL_COUNT;
     int order[COL_COUNT];
@@ -539,8 +1219,66 @@ static void field_manager(void) {
     nodelay(stdscr, TRUE);
 }
 
+/* Full-width history charts of one task. */
+static void show_task_detail(int pid, int tid) {
+    static const struct {
+        enum task_metric metric;
+        const char *title;
+        const char *unit;
+        float floor;
+    } charts[] = {
+        { TASK_METRIC_CPU, "CPU", "%", 1.0f },
+        { TASK_METRIC_RSS, "RSS", "KB", 1.0f },
+        { TASK_METRIC_IO,  "I/O", "B/s", 1.0f }
+    };
+    size_t cap = tasks_history_samples();
+    float *vals = cap ? malloc(cap * sizeof(*vals)) : NULL;
+    int w = COLS > 4 ? COLS - 4 : COLS;
+    int h = 4 + 3 * (int)(sizeof(charts) / sizeof(charts[0]));
+    int starty = LINES > h ? (LINES - h) / 2 : 0;
+    WINDOW *win = newwin(h, w, starty, (COLS - w) / 2);
+    char *line = malloc((size_t)w + 1);
+    box(win, 0, 0);
+    if (tid != pid)
+        mvwprintw(win, 1, 2, "History of PID %d TID %d (%zu samples max)",
+                  pid, tid, cap);
+    else
+        mvwprintw(win, 1, 2, "History of PID %d (%zu samples max)", pid, cap);
+    for (size_t c = 0; c < sizeof(charts) / sizeof(charts[0]); c++) {
+        int row = 2 + 3 * (int)c;
+        size_t n = vals ? tasks_history(pid, tid, charts[c].metric, vals, cap) : 0;
+        if (n == 0) {
+            mvwprintw(win, row, 2, "%s: no samples", charts[c].title);
+            continue;
+        }
+        float min = vals[0], max = vals[0];
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            if (vals[i] < min)
+                min = vals[i];
+            if (vals[i] > max)
+                max = vals[i];
+            sum += vals[i];
+        }
+        mvwprintw(win, row, 2, "%s  min %.1f  avg %.1f  max %.1f %s",
+                  charts[c].title, min, sum / (double)n, max, charts[c].unit);
+        if (line && w > 4) {
+            format_sparkline(line, w - 4, vals, n, charts[c].floor);
+            mvwprintw(win, row + 1, 2, "%s", line);
+        }
+    }
+    mvwprintw(win, h - 2, 2, "Press any key to return");
+    wrefresh(win);
+    nodelay(stdscr, FALSE);
+    wgetch(win);
+    nodelay(stdscr, TRUE);
+    delwin(win);
+    free(line);
+    free(vals);
+}
+
 static void show_help(void) {
-    const int h = 42;
+    const int h = 61;
     const int w = 52;
     int startx = COLS > w ? (COLS - w) / 2 : 0;
     if (startx < 0)
@@ -567,7 +1305,7 @@ static void show_help(void) {
     mvwprintw(win, 16, 2, "g       Filter by state");
     mvwprintw(win, 17, 2, "k       Send signal to a process");
     mvwprintw(win, 18, 2, "r       Renice a process");
-    mvwprintw(win, 19, 2, "c       Toggle per-core view");
+    mvwprintw(win, 19, 2, "c       Cycle per-core grid, heat map and off");
     mvwprintw(win, 20, 2, "a       Toggle full command");
     mvwprintw(win, 21, 2, "H       Toggle thread view");
     mvwprintw(win, 22, 2, "K       Toggle kernel threads");
@@ -584,11 +1322,29 @@ static void show_help(void) {
     mvwprintw(win, 33, 2, "f       Field manager (toggle columns)");
     mvwprintw(win, 34, 2, "n       Set entry limit");
     mvwprintw(win, 35, 2, "W       Save config");
-    mvwprintw(win, 36, 2, "READ/WRITE columns show disk I/O");
+    mvwprintw(win, 36, 2, "READ/WRITE columns show disk I/O per second");
     mvwprintw(win, 37, 2, "UP/DOWN  Scroll one line");
     mvwprintw(win, 38, 2, "PgUp/PgDn Scroll a page");
     mvwprintw(win, 39, 2, "SPACE    Pause/resume");
     mvwprintw(win, 40, 2, "h       Show this help");
+    mvwprintw(win, 41, 2, ". / ,   Step frame (replay)");
+    mvwprintw(win, 42, 2, "[ / ]   Replay speed");
+    mvwprintw(win, 43, 2, "G       Seek (replay)");
+    mvwprintw(win, 44, 2, "D       Task history (HIST column)");
+    mvwprintw(win, 45, 2, "O       Show vtop's own refresh cost");
+    mvwprintw(win, 46, 2, "w       Sort by run queue wait (WAIT%%)");
+    mvwprintw(win, 47, 2, "p       Sort by proportional memory (PSS)");
+    mvwprintw(win, 48, 2, "R       Sort by disk I/O rate");
+    mvwprintw(win, 49, 2, "F       Sort by page faults (major first)");
+    mvwprintw(win, 50, 2, "X       Sort by involuntary context switches");
+    mvwprintw(win, 51, 2, "v       Toggle cgroup view, Enter shows members");
+    mvwprintw(win, 52, 2, "Q       Sort by cgroup CPU throttling");
+    mvwprintw(win, 53, 2, "y       Toggle pressure (PSI) line");
+    mvwprintw(win, 54, 2, "j       Toggle disk panel");
+    mvwprintw(win, 55, 2, "J       List partitions and loop devices");
+    mvwprintw(win, 56, 2, "N       Cycle network line, panel and off");
+    mvwprintw(win, 57, 2, "A       Toggle interrupt heat map per CPU");
+    mvwprintw(win, 58, 2, "Y       Group cores by socket, node, core");
     mvwprintw(win, h - 2, 2, "Press any key to return");
     wrefresh(win);
     nodelay(stdscr, FALSE);
@@ -632,6 +1388,30 @@ static void set_sort(enum sort_field sort) {
         compare_procs = cmp_proc_priority;
         set_sort_descending(0);
         break;
+    case SORT_WAIT:
+        compare_procs = cmp_proc_wait;
+        set_sort_descending(1);
+        break;
+    case SORT_PSS:
+        compare_procs = cmp_proc_pss;
+        set_sort_descending(1);
+        break;
+    case SORT_IO:
+        compare_procs = cmp_proc_io;
+        set_sort_descending(1);
+        break;
+    case SORT_FAULTS:
+        compare_procs = cmp_proc_faults;
+        set_sort_descending(1);
+        break;
+    case SORT_CTXSW:
+        compare_procs = cmp_proc_ctxsw;
+        set_sort_descending(1);
+        break;
+    case SORT_THROTTLE:
+        compare_procs = cmp_proc_throttle;
+        set_sort_descending(1);
+        break;
     }
 }
 
@@ -679,6 +1459,23 @@ static void build_forest(struct process_info *procs, size_t count) {
 
 static size_t max_entries;
 
+/* Parse a replay seek target: "#N" selects frame N, anything else is a
+ * time understood by recording_parse_time(). */
+static size_t parse_seek(const char *arg, size_t frame) {
+    size_t frames = recording_frame_count(replay_rec);
+    double t;
+    if (arg[0] == '#') {
+        long n = atol(arg + 1);
+        if (n < 1)
+            n = 1;
+        return (size_t)n - 1 < frames ? (size_t)n - 1 : frames - 1;
+    }
+    if (recording_parse_time(replay_rec, arg,
+                             recording_frame_time(replay_rec, frame), &t) != 0)
+        return frame;
+    return recording_find_time(replay_rec, t);
+}
+
 int run_ui(unsigned int delay_ms, enum sort_field sort,
            unsigned int iterations, int columns, size_t max_entries_arg) {
     max_entries = max_entries_arg;
@@ -695,20 +1492,35 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
         apply_color_scheme();
     }
 
-    struct process_info *procs = NULL;
-    size_t proc_cap = 0;
-    struct cpu_stats cs;
-    struct mem_stats ms;
-    struct misc_stats misc;
-    double cpu_usage = 0.0;
-    double mem_usage = 0.0;
-    double swap_usage = 0.0;
+    struct snapshot snap = {0};
+    struct replay_cursor cursor;
+    size_t frame = 0;
+    double speed = 1.0;
+    int reload = 1;
     size_t count = 0;
     int paused = 0;
     unsigned int iter = 0;
     size_t scroll_offset = 0;
+    struct cgroup_list cgroups = {0};
+    size_t cg_sel = 0;
+    size_t cg_top = 0;
+    int cg_missing = 0;
+    int irq_missing = 0;
 
+    if (replay_rec)
+        replay_cursor_init(&cursor, replay_rec);
     set_sort(sort);
+    if (perfctr_get_top())
+        show_perf_columns();
+    if (smaps_enabled())
+        show_pss_columns();
+    /* --wait and --ctxsw ask for their columns, which keep them on */
+    if (get_wait_stats())
+        show_wait_columns();
+    if (get_switch_stats())
+        show_ctxsw_columns();
+    if (cgroup_get_throttle())
+        show_throttle_columns();
     show_threads = get_thread_mode();
     set_thread_mode(show_threads);
     set_show_idle(show_idle);
@@ -718,80 +1530,48 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
         interval = MIN_DELAY_MS;
     if (interval > MAX_DELAY_MS)
         interval = MAX_DELAY_MS;
+    /* so the status line shows the interval actually waited */
+    budget_set_max_delay(MAX_DELAY_MS);
     int ch = 0;
     while (ch != 'q' && (iterations == 0 || iter < iterations)) {
-        if (!paused && read_cpu_stats(&cs) == 0) {
-            unsigned long long idle = cs.idle + cs.iowait;
-            unsigned long long total = cs.user + cs.nice + cs.system +
-                                       cs.irq + cs.softirq + cs.steal + idle;
-            unsigned long long d_total = total - prev_total;
-            unsigned long long d_idle = idle - prev_idle;
-            if (d_total > 0)
-                cpu_usage = 100.0 * (double)(d_total - d_idle) / (double)d_total;
-            prev_total = total;
-            prev_idle = idle;
-
-            size_t n = get_cpu_core_count();
-            const struct cpu_core_stats *cores = get_cpu_core_stats();
-            if (n != core_count) {
-                free(core_usage);
-                free(core_prev_total);
-                free(core_prev_idle);
-                core_usage = calloc(n, sizeof(double));
-                core_prev_total = calloc(n, sizeof(unsigned long long));
-                core_prev_idle = calloc(n, sizeof(unsigned long long));
-                core_count = n;
-            }
-            for (size_t i = 0; i < n; i++) {
-                unsigned long long cidle = cores[i].idle + cores[i].iowait;
-                unsigned long long ctotal = cores[i].user + cores[i].nice +
-                                            cores[i].system + cores[i].irq +
-                                            cores[i].softirq + cores[i].steal +
-                                            cidle;
-                unsigned long long cd_total = ctotal - core_prev_total[i];
-                unsigned long long cd_idle = cidle - core_prev_idle[i];
-                double usage = 0.0;
-                if (cd_total > 0)
-                    usage = 100.0 * (double)(cd_total - cd_idle) /
-                            (double)cd_total;
-                core_usage[i] = usage;
-                core_prev_total[i] = ctotal;
-                core_prev_idle[i] = cidle;
+        if (!paused || reload) {
+            if (replay_rec) {
+                if (replay_seek(&cursor, frame) == 0)
+                    snapshot_copy(&snap, &cursor.snap);
+            } else if (show_cgroups) {
+                /* the cgroup files hold the totals, tasks are not read */
+                snapshot_collect_system(&snap);
+                cg_missing = cgroup_collect(&cgroups) != 0;
+            } else if (show_irqs) {
+                snapshot_collect_system(&snap);
+                irq_missing = irq_collect() != 0;
+            } else {
+                set_wait_stats(current_sort == SORT_WAIT || wait_shown());
+                set_switch_stats(current_sort == SORT_CTXSW || ctxsw_shown());
+                cgroup_set_throttle(current_sort == SORT_THROTTLE ||
+                                    throttle_shown());
+                if (current_sort == SORT_PSS || pss_shown())
+                    smaps_enable();
+                snapshot_collect(&snap, max_entries);
             }
+            reload = 0;
         }
-        if (!paused && read_mem_stats(&ms) == 0 && ms.total > 0) {
-            unsigned long long used = ms.total - ms.available;
-            mem_usage = 100.0 * (double)used / (double)ms.total;
-            if (ms.swap_total > 0)
-                swap_usage = 100.0 * (double)ms.swap_used /
-                             (double)ms.swap_total;
-            else
-                swap_usage = 0.0;
-        }
-        if (!paused)
-            read_misc_stats(&misc);
-
-        if (!paused) {
-            size_t need = count_processes();
-            if (max_entries && need > max_entries)
-                need = max_entries;
-            if (need > proc_cap) {
-                struct process_info *tmp = realloc(procs, need * sizeof(*procs));
-                if (tmp) {
-                    procs = tmp;
-                    proc_cap = need;
-                }
-            }
-            count = list_processes(procs, proc_cap);
-            if (max_entries && count > max_entries)
-                count = max_entries;
-        }
+        struct process_info *procs = snap.procs;
+        count = snap.count;
+        if (max_entries && count > max_entries)
+            count = max_entries;
+        uint64_t ts = self_now();
         if (show_forest) {
             qsort(procs, count, sizeof(struct process_info), cmp_proc_pid);
+            self_add(SELF_SORT, ts);
+            ts = self_now();
             build_forest(procs, count);
+            self_add(SELF_FOREST, ts);
         } else {
             qsort(procs, count, sizeof(struct process_info), compare_procs);
+            self_add(SELF_SORT, ts);
         }
+        uint64_t tr = self_now();
         erase();
         char fbuf[128] = "";
         const char *nf = get_name_filter();
@@ -804,54 +1584,141 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
             strncat(fbuf, " user=", sizeof(fbuf) - strlen(fbuf) - 1);
             strncat(fbuf, uf, sizeof(fbuf) - strlen(fbuf) - 1);
         }
-        double swap_u = scale_kb(ms.swap_used, summary_unit);
-        double swap_t = scale_kb(ms.swap_total, summary_unit);
+        const char *cf = cgroup_get_filter();
+        if (cf[0]) {
+            strncat(fbuf, " cgroup=", sizeof(fbuf) - strlen(fbuf) - 1);
+            strncat(fbuf, cf, sizeof(fbuf) - strlen(fbuf) - 1);
+        }
+        const struct cpu_stats *cs = &snap.cpu;
+        const struct mem_stats *ms = &snap.mem;
+        const struct misc_stats *misc = &snap.misc;
+        double mem_usage = 0.0;
+        double swap_usage = 0.0;
+        if (ms->total > 0)
+            mem_usage = 100.0 * (double)(ms->total - ms->available) /
+                        (double)ms->total;
+        if (ms->swap_total > 0)
+            swap_usage = 100.0 * (double)ms->swap_used / (double)ms->swap_total;
+        double swap_u = scale_kb(ms->swap_used, summary_unit);
+        double swap_t = scale_kb(ms->swap_total, summary_unit);
         const char *unit = mem_unit_suffix(summary_unit);
         int row = 0;
+        if (replay_rec) {
+            char tbuf[32] = "??:??:??";
+            time_t t = (time_t)snap.timestamp;
+            struct tm *tm = localtime(&t);
+            if (tm)
+                strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", tm);
+            mvprintw(row, 0, "replay %s  frame %zu/%zu  speed x%g%s",
+                     tbuf, frame + 1, recording_frame_count(replay_rec),
+                     speed, paused ? "  [PAUSED]" : "");
+            row++;
+        }
         if (show_cpu_summary) {
             mvprintw(row, 0,
                      "load %.2f %.2f %.2f  up %.0fs  tasks %d total, %d running, %d sleeping, %d stopped, %d zombie  cpu %5.1f%% us %.1f%% sy %.1f%% ni %.1f%% id %.1f%% wa %.1f%% hi %.1f%% si %.1f%% st %.1f%%  mem %5.1f%%  swap %.0f/%.0f%s %.1f%%  intv %.1fs%s%s",
-                     misc.load1, misc.load5, misc.load15, misc.uptime,
-                     misc.total_tasks, misc.running_tasks, misc.sleeping_tasks,
-                     misc.stopped_tasks, misc.zombie_tasks, cpu_usage,
-                     cs.user_percent - cs.nice_percent, cs.system_percent - cs.irq_percent - cs.softirq_percent - cs.steal_percent,
-                     cs.nice_percent, cs.idle_percent - cs.iowait_percent,
-                     cs.iowait_percent, cs.irq_percent, cs.softirq_percent, cs.steal_percent,
+                     misc->load1, misc->load5, misc->load15, misc->uptime,
+                     misc->total_tasks, misc->running_tasks, misc->sleeping_tasks,
+                     misc->stopped_tasks, misc->zombie_tasks, snap.cpu_usage,
+                     cs->user_percent - cs->nice_percent, cs->system_percent - cs->irq_percent - cs->softirq_percent - cs->steal_percent,
+                     cs->nice_percent, cs->idle_percent - cs->iowait_percent,
+                     cs->iowait_percent, cs->irq_percent, cs->softirq_percent, cs->steal_percent,
                      mem_usage, swap_u, swap_t, unit, swap_usage,
-                     interval / 1000.0, paused ? " [PAUSED]" : "", fbuf);
+                     interval / 1000.0, paused && !replay_rec ? " [PAUSED]" : "", fbuf);
             row++;
         }
 
         if (show_mem_summary) {
-            double total = scale_kb(ms.total, summary_unit);
-            double used = scale_kb(ms.total - ms.free, summary_unit);
-            double free = scale_kb(ms.free, summary_unit);
-            double bufs = scale_kb(ms.buffers, summary_unit);
-            double cached = scale_kb(ms.cached, summary_unit);
+            double total = scale_kb(ms->total, summary_unit);
+            double used = scale_kb(ms->total - ms->free, summary_unit);
+            double free = scale_kb(ms->free, summary_unit);
+            double bufs = scale_kb(ms->buffers, summary_unit);
+            double cached = scale_kb(ms->cached, summary_unit);
             mvprintw(row, 0,
                      "mem total %.0f%s used %.0f%s free %.0f%s buf %.0f%s cache %.0f%s swap %.0f/%.0f%s",
                      total, unit, used, unit, free, unit, bufs, unit, cached, unit,
                      swap_u, swap_t, unit);
+            if (ms->vm.available)
+                draw_vm_rates(&ms->vm);
             row++;
         }
 
-        if (show_cores && core_count > 0) {
-            char cbuf[256] = "";
-            for (size_t i = 0; i < core_count; i++) {
-                char seg[32];
-                snprintf(seg, sizeof(seg), "cpu%zu %5.1f%% ", i, core_usage[i]);
-                if (strlen(cbuf) + strlen(seg) < sizeof(cbuf))
-                    strcat(cbuf, seg);
-                else
-                    break;
-            }
-            mvprintw(row, 0, "%s", cbuf);
+        if (show_pressure && snap.psi.available) {
+            mvprintw(row, 0, "pressure");
+            draw_pressure("cpu", &snap.psi.cpu);
+            draw_pressure("memory", &snap.psi.memory);
+            draw_pressure("io", &snap.psi.io);
+            row++;
+        }
+
+        if (show_net)
+            row += draw_net_summary(row, &snap);
+
+        if (cgroup_get_throttle() && !replay_rec && !show_cgroups &&
+            !show_irqs) {
+            struct cgroup_throttle_summary tsum;
+            cgroup_throttle_summary(&tsum);
+            if (tsum.throttled && color_scheme)
+                attron(COLOR_PAIR(CP_SORT));
+            mvprintw(row, 0, "throttle %zu of %zu limited cgroups",
+                     tsum.throttled, tsum.limited);
+            if (tsum.worst[0])
+                printw(", worst %s %.1f%% of periods %.1fms/s", tsum.worst,
+                       tsum.worst_percent, tsum.worst_ms);
+            if (tsum.throttled && color_scheme)
+                attroff(COLOR_PAIR(CP_SORT));
+            row++;
+        }
+
+        if (show_self_stats) {
+            char sbuf[256];
+            self_format(sbuf, sizeof(sbuf));
+            mvprintw(row, 0, "%s", sbuf);
             row++;
+            if (budget_get() > 0.0 && !replay_rec) {
+                budget_format(sbuf, sizeof(sbuf));
+                mvprintw(row, 0, "%s", sbuf);
+                row++;
+            }
         }
-        draw_header(row);
+
+        /* a third of the screen at most, the tasks matter more */
+        if (show_cores && snap.core_count > 0)
+            row += draw_cores(row, &snap, (LINES - row) / 3);
+        if (show_disks)
+            row += draw_disks(row, &snap, (LINES - row) / 3);
+        if (show_net == 2)
+            row += draw_nets(row, &snap, (LINES - row) / 3);
         int visible_rows = LINES - row - 2;
         if (visible_rows < 0)
             visible_rows = 0;
+        if (show_cgroups && !replay_rec) {
+            if (cg_sel >= cgroups.count)
+                cg_sel = cgroups.count ? cgroups.count - 1 : 0;
+            if (cg_sel < cg_top)
+                cg_top = cg_sel;
+            if (visible_rows > 0 && cg_sel >= cg_top + (size_t)visible_rows)
+                cg_top = cg_sel - (size_t)visible_rows + 1;
+            if (cg_missing) {
+                mvprintw(row, 0, "no cgroup v2 hierarchy at %s",
+                         cgroup_get_root());
+            } else {
+                draw_cgroup_header(row);
+                for (size_t i = cg_top; i < cgroups.count &&
+                                        i < cg_top + (size_t)visible_rows; i++)
+                    draw_cgroup_row(i - cg_top + row + 1, &cgroups.items[i],
+                                    i == cg_sel);
+            }
+            count = 0;
+        } else if (show_irqs && !replay_rec) {
+            if (irq_missing)
+                mvprintw(row, 0, "cannot read /proc/interrupts");
+            else
+                draw_irqs(row, visible_rows + 1);
+            count = 0;
+        } else {
+            draw_header(row);
+        }
         size_t max_offset = 0;
         if ((size_t)visible_rows < count)
             max_offset = count - visible_rows;
@@ -860,18 +1727,84 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
         for (size_t i = scroll_offset; i < count && i < scroll_offset + (size_t)visible_rows; i++) {
             draw_process_row(i - scroll_offset + row + 1, &procs[i]);
         }
+        if (scroll_offset < count) {
+            size_t shown = count - scroll_offset;
+            if (shown > (size_t)visible_rows)
+                shown = (size_t)visible_rows;
+            smaps_prioritize(&procs[scroll_offset], shown);
+        }
         refresh();
-        usleep(interval * 1000);
+        self_add(SELF_RENDER, tr);
+        self_end_refresh();
+        unsigned int wait_ms = replay_rec ? interval : budget_next_delay(interval);
+        if (wait_ms > MAX_DELAY_MS)
+            wait_ms = MAX_DELAY_MS;
+        if (replay_rec) {
+            size_t frames = recording_frame_count(replay_rec);
+            wait_ms = MIN_DELAY_MS;
+            if (!paused && frame + 1 < frames) {
+                double gap = recording_frame_time(replay_rec, frame + 1) -
+                             recording_frame_time(replay_rec, frame);
+                double ms_d = gap * 1000.0 / speed;
+                if (ms_d < MIN_DELAY_MS)
+                    ms_d = MIN_DELAY_MS;
+                if (ms_d > MAX_DELAY_MS)
+                    ms_d = MAX_DELAY_MS;
+                wait_ms = (unsigned int)ms_d;
+            }
+        }
+        usleep(wait_ms * 1000);
         ch = getch();
         iter++;
+        if (replay_rec && !paused) {
+            if (frame + 1 < recording_frame_count(replay_rec))
+                frame++;
+            else
+                paused = 1;
+        }
+        if (replay_rec && (ch == '.' || ch == ',' || ch == '[' ||
+                           ch == ']' || ch == 'G')) {
+            size_t frames = recording_frame_count(replay_rec);
+            if (ch == '.') {
+                if (frame + 1 < frames)
+                    frame++;
+                paused = 1;
+            } else if (ch == ',') {
+                if (frame > 0)
+                    frame--;
+                paused = 1;
+            } else if (ch == '[') {
+                if (speed / 2.0 >= MIN_REPLAY_SPEED)
+                    speed /= 2.0;
+            } else if (ch == ']') {
+                if (speed * 2.0 <= MAX_REPLAY_SPEED)
+                    speed *= 2.0;
+            } else {
+                char buf[32];
+                nodelay(stdscr, FALSE);
+                echo();
+                curs_set(1);
+                mvprintw(LINES - 1, 0, "Seek (HH:MM:SS, +/-secs, #frame): ");
+                getnstr(buf, sizeof(buf) - 1);
+                if (buf[0])
+                    frame = parse_seek(buf, frame);
+                noecho();
+                curs_set(0);
+                nodelay(stdscr, TRUE);
+            }
+            reload = 1;
+            continue;
+        }
+        if (replay_rec && (ch == 'k' || ch == 'r'))
+            continue; /* recorded tasks cannot be signalled */
         if (ch == KEY_F(3) || ch == '>') {
-            if (current_sort == SORT_PRI)
+            if (current_sort == SORT_THROTTLE)
                 set_sort(SORT_PID);
             else
                 set_sort(current_sort + 1);
         } else if (ch == '<') {
             if (current_sort == SORT_PID)
-                set_sort(SORT_PRI);
+                set_sort(SORT_THROTTLE);
             else
                 set_sort(current_sort - 1);
         } else if (ch == '+') {
@@ -880,6 +1813,34 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
         } else if (ch == '-') {
             if (interval > MIN_DELAY_MS)
                 interval -= 100;
+        } else if (show_cgroups && !replay_rec &&
+                   (ch == KEY_UP || ch == KEY_DOWN || ch == KEY_PPAGE ||
+                    ch == KEY_NPAGE)) {
+            size_t page = visible_rows > 0 ? (size_t)visible_rows : 1;
+            if (ch == KEY_UP && cg_sel > 0)
+                cg_sel--;
+            else if (ch == KEY_DOWN && cg_sel + 1 < cgroups.count)
+                cg_sel++;
+            else if (ch == KEY_PPAGE)
+                cg_sel = cg_sel > page ? cg_sel - page : 0;
+            else if (ch == KEY_NPAGE)
+                cg_sel += page;
+        } else if (show_cgroups && !replay_rec &&
+                   (ch == '\n' || ch == '\r' || ch == KEY_ENTER)) {
+            /* drill into the selected cgroup */
+            if (cg_sel < cgroups.count) {
+                cgroup_set_filter(cgroups.items[cg_sel].path);
+                show_cgroups = 0;
+                scroll_offset = 0;
+            }
+        } else if (ch == 'v') {
+            if (!replay_rec) {
+                show_cgroups = !show_cgroups;
+                show_irqs = 0;
+                /* back to the tree from a cgroup's members */
+                if (show_cgroups)
+                    cgroup_set_filter(NULL);
+            }
         } else if (ch == KEY_UP) {
             if (scroll_offset > 0)
                 scroll_offset--;
@@ -996,8 +1957,22 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
             set_sort(SORT_CPU);
         } else if (ch == 'M') {
             set_sort(SORT_MEM);
+        } else if (ch == 'w') {
+            set_sort(SORT_WAIT);
+        } else if (ch == 'p') {
+            set_sort(SORT_PSS);
+        } else if (ch == 'R') {
+            set_sort(SORT_IO);
+        } else if (ch == 'F') {
+            set_sort(SORT_FAULTS);
+        } else if (ch == 'X') {
+            set_sort(SORT_CTXSW);
+        } else if (ch == 'Q') {
+            set_sort(SORT_THROTTLE);
         } else if (ch == 'c') {
-            show_cores = !show_cores;
+            show_cores = (show_cores + 1) % 3;
+        } else if (ch == 'Y') {
+            core_group = (core_group + 1) % CORE_GROUP_COUNT;
         } else if (ch == 'a') {
             show_full_cmd = !show_full_cmd;
         } else if (ch == 'H') {
@@ -1031,6 +2006,20 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
             show_cpu_summary = !show_cpu_summary;
         } else if (ch == 'm') {
             show_mem_summary = !show_mem_summary;
+        } else if (ch == 'y') {
+            show_pressure = !show_pressure;
+        } else if (ch == 'j') {
+            show_disks = !show_disks;
+        } else if (ch == 'J') {
+            disk_set_all(!disk_get_all());
+        } else if (ch == 'N') {
+            show_net = (show_net + 1) % 3;
+        } else if (ch == 'A') {
+            /* recordings hold no interrupt counters */
+            if (!replay_rec) {
+                show_irqs = !show_irqs;
+                show_cgroups = 0;
+            }
         } else if (ch == 'n') {
             char buf[16];
             nodelay(stdscr, FALSE);
@@ -1048,15 +2037,33 @@ int run_ui(unsigned int delay_ms, enum sort_field sort,
             field_manager();
         } else if (ch == ' ') {
             paused = !paused;
+        } else if (ch == 'O') {
+            show_self_stats = !show_self_stats;
+            self_set_enabled(show_self_stats);
         } else if (ch == 'h') {
             show_help();
+        } else if (ch == 'D') {
+            char buf[32];
+            nodelay(stdscr, FALSE);
+            echo();
+            curs_set(1);
+            mvprintw(LINES - 1, 0, "PID[/TID] to show: ");
+            getnstr(buf, sizeof(buf) - 1);
+            noecho();
+            curs_set(0);
+            nodelay(stdscr, TRUE);
+            char *end;
+            int pid = (int)strtol(buf, &end, 10);
+            int tid = *end == '/' ? atoi(end + 1) : pid;
+            if (pid > 0)
+                show_task_detail(pid, tid);
         }
     }
     endwin();
-    free(core_usage);
-    free(core_prev_total);
-    free(core_prev_idle);
-    free(procs);
+    if (replay_rec)
+        replay_cursor_free(&cursor);
+    cgroup_list_free(&cgroups);
+    snapshot_free(&snap);
     ui_save_config(interval, current_sort);
     return 0;
 }
@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include "watch.h"
+#include "proc.h"
+#include "net.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* upper edges of the utilization histogram buckets in percent; one more
+ * bucket holds what is above, which only multi-threaded processes reach */
+static const float hist_edges[] = { 0, 10, 25, 50, 75, 90, 100 };
+#define HIST_BUCKETS (sizeof(hist_edges) / sizeof(hist_edges[0]) + 1)
+
+/* samples at or above this utilization count as busy */
+#define BUSY_PERCENT 90.0f
+
+static const char hist_levels[] = " .:-=+*#%@";
+
+/* utilization samples of one report interval */
+struct series {
+    float *vals;
+    size_t n;
+    size_t cap;
+    /* current and longest stretch of busy samples */
+    double busy_ms;
+    double busy_max_ms;
+};
+
+struct wthread {
+    int tid;
+    /* schedstat, or stat when schedstat is missing */
+    int fd;
+    int use_stat;
+    unsigned long long last_ns;
+    int have_last;
+    int seen;
+    char name[64];
+    struct series s;
+};
+
+struct wproc {
+    int pid;
+    int alive;
+    char name[64];
+    struct wthread *threads;
+    size_t count;
+    size_t cap;
+    struct series s;
+};
+
+static volatile sig_atomic_t watch_stop;
+static long clk_tck = 100;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+int watch_parse_pids(const char *list, struct watch_options *opt) {
+    opt->pid_count = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long pid = strtol(p, &end, 10);
+        if (end == p || pid <= 0 || opt->pid_count >= WATCH_MAX_PIDS)
+            return -1;
+        opt->pids[opt->pid_count++] = (int)pid;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return opt->pid_count > 0 ? 0 : -1;
+}
+
+static void series_push(struct series *s, float v, double dt_ms) {
+    if (s->n == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 256;
+        float *vals = realloc(s->vals, cap * sizeof(*vals));
+        if (!vals)
+            return;
+        s->vals = vals;
+        s->cap = cap;
+    }
+    s->vals[s->n++] = v;
+    if (v >= BUSY_PERCENT) {
+        s->busy_ms += dt_ms;
+        if (s->busy_ms > s->busy_max_ms)
+            s->busy_max_ms = s->busy_ms;
+    } else {
+        s->busy_ms = 0;
+    }
+}
+
+static void series_reset(struct series *s) {
+    s->n = 0;
+    s->busy_ms = 0;
+    s->busy_max_ms = 0;
+}
+
+static void read_comm(const char *path, char *out, size_t size) {
+    out[0] = '\0';
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    ssize_t r = read(fd, out, size - 1);
+    close(fd);
+    if (r <= 0) {
+        out[0] = '\0';
+        return;
+    }
+    out[r] = '\0';
+    out[strcspn(out, "\n")] = '\0';
+}
+
+static int open_thread(int pid, struct wthread *t) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/task/%d/schedstat", get_proc_root(),
+             pid, t->tid);
+    t->fd = open(path, O_RDONLY | O_CLOEXEC);
+    t->use_stat = 0;
+    if (t->fd < 0) {
+        /* kernels without CONFIG_SCHED_INFO: clock ticks from stat */
+        snprintf(path, sizeof(path), "%s/%d/task/%d/stat", get_proc_root(),
+                 pid, t->tid);
+        t->fd = open(path, O_RDONLY | O_CLOEXEC);
+        t->use_stat = 1;
+    }
+    if (t->fd < 0)
+        return -1;
+    snprintf(path, sizeof(path), "%s/%d/task/%d/comm", get_proc_root(), pid,
+             t->tid);
+    read_comm(path, t->name, sizeof(t->name));
+    return 0;
+}
+
+/* CPU time of a thread in ns through its open descriptor. */
+static int read_runtime(const struct wthread *t, unsigned long long *ns) {
+    char buf[1024];
+    ssize_t r = pread(t->fd, buf, sizeof(buf) - 1, 0);
+    if (r <= 0)
+        return -1;
+    buf[r] = '\0';
+    if (!t->use_stat)
+        return sscanf(buf, "%llu", ns) == 1 ? 0 : -1;
+    const char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                     &utime, &stime) != 2)
+        return -1;
+    *ns = (utime + stime) * (1000000000ull / (unsigned long long)clk_tck);
+    return 0;
+}
+
+static void drop_thread(struct wproc *p, size_t i) {
+    struct wthread *t = &p->threads[i];
+    if (t->fd >= 0)
+        close(t->fd);
+    free(t->s.vals);
+    p->threads[i] = p->threads[--p->count];
+}
+
+/* Bring the thread list of p up to date. */
+static void rescan_threads(struct wproc *p) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/task", get_proc_root(), p->pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        p->alive = 0;
+        return;
+    }
+    for (size_t i = 0; i < p->count; i++)
+        p->threads[i].seen = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char *end;
+        long tid = strtol(ent->d_name, &end, 10);
+        if (*end != '\0' || end == ent->d_name)
+            continue;
+        size_t i = 0;
+        while (i < p->count && p->threads[i].tid != (int)tid)
+            i++;
+        if (i < p->count) {
+            p->threads[i].seen = 1;
+            continue;
+        }
+        if (p->count == p->cap) {
+            size_t cap = p->cap ? p->cap * 2 : 16;
+            struct wthread *th = realloc(p->threads, cap * sizeof(*th));
+            if (!th)
+                break;
+            p->threads = th;
+            p->cap = cap;
+        }
+        struct wthread *t = &p->threads[p->count];
+        memset(t, 0, sizeof(*t));
+        t->tid = (int)tid;
+        if (open_thread(p->pid, t) != 0)
+            continue;
+        t->seen = 1;
+        p->count++;
+    }
+    closedir(dir);
+    size_t i = 0;
+    while (i < p->count) {
+        if (!p->threads[i].seen)
+            drop_thread(p, i);
+        else
+            i++;
+    }
+}
+
+static void sample(struct wproc *procs, size_t n, double dt_ns, int threads) {
+    double dt_ms = dt_ns / 1e6;
+    for (size_t i = 0; i < n; i++) {
+        struct wproc *p = &procs[i];
+        if (!p->alive)
+            continue;
+        unsigned long long total = 0;
+        int have = 0;
+        size_t j = 0;
+        while (j < p->count) {
+            struct wthread *t = &p->threads[j];
+            unsigned long long ns;
+            if (read_runtime(t, &ns) != 0) {
+                drop_thread(p, j);
+                continue;
+            }
+            if (t->have_last && dt_ns > 0) {
+                unsigned long long d = ns >= t->last_ns ? ns - t->last_ns : 0;
+                total += d;
+                have = 1;
+                if (threads)
+                    series_push(&t->s, (float)(d * 100.0 / dt_ns), dt_ms);
+            }
+            t->last_ns = ns;
+            t->have_last = 1;
+            j++;
+        }
+        if (p->count == 0)
+            p->alive = 0;
+        else if (have)
+            series_push(&p->s, (float)(total * 100.0 / dt_ns), dt_ms);
+    }
+}
+
+static int cmp_float(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+struct summary {
+    double avg;
+    double p50;
+    double p99;
+    double max;
+    unsigned int hist[HIST_BUCKETS];
+};
+
+/* nearest rank percentile of sorted values */
+static double percentile(const float *v, size_t n, double q) {
+    size_t rank = (size_t)ceil(q * (double)n);
+    if (rank < 1)
+        rank = 1;
+    return v[rank - 1];
+}
+
+static void summarize(const struct series *s, float *scratch, struct summary *out) {
+    memset(out, 0, sizeof(*out));
+    if (s->n == 0)
+        return;
+    double sum = 0;
+    for (size_t i = 0; i < s->n; i++) {
+        float v = s->vals[i];
+        sum += v;
+        size_t b = 0;
+        while (b < HIST_BUCKETS - 1 && v > hist_edges[b])
+            b++;
+        out->hist[b]++;
+    }
+    memcpy(scratch, s->vals, s->n * sizeof(*scratch));
+    qsort(scratch, s->n, sizeof(*scratch), cmp_float);
+    out->avg = sum / (double)s->n;
+    out->p50 = percentile(scratch, s->n, 0.50);
+    out->p99 = percentile(scratch, s->n, 0.99);
+    out->max = scratch[s->n - 1];
+}
+
+static void json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void print_series(const struct watch_options *opt, double when, int pid,
+                         int tid, const char *name, const struct series *s,
+                         float *scratch) {
+    struct summary sum;
+    summarize(s, scratch, &sum);
+    if (opt->jsonl) {
+        printf("{\"time\":%.3f,\"pid\":%d,", when, pid);
+        if (tid)
+            printf("\"tid\":%d,", tid);
+        printf("\"name\":");
+        json_string(stdout, name);
+        printf(",\"samples\":%zu,\"sample_ms\":%u,\"avg\":%.2f,\"p50\":%.2f,"
+               "\"p99\":%.2f,\"max\":%.2f,\"busy_ms\":%.1f,\"hist\":[",
+               s->n, opt->sample_ms, sum.avg, sum.p50, sum.p99, sum.max,
+               s->busy_max_ms);
+        for (size_t b = 0; b < HIST_BUCKETS; b++)
+            printf("%s%u", b ? "," : "", sum.hist[b]);
+        printf("]}\n");
+        return;
+    }
+    unsigned int top = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; b++)
+        if (sum.hist[b] > top)
+            top = sum.hist[b];
+    char hist[HIST_BUCKETS + 1];
+    const unsigned int levels = sizeof(hist_levels) - 2;
+    for (size_t b = 0; b < HIST_BUCKETS; b++) {
+        unsigned int lvl = top ? (sum.hist[b] * levels + top - 1) / top : 0;
+        hist[b] = hist_levels[lvl];
+    }
+    hist[HIST_BUCKETS] = '\0';
+    char tidbuf[16] = "-";
+    if (tid)
+        snprintf(tidbuf, sizeof(tidbuf), "%d", tid);
+    printf("%-8d %-8s %-16.16s %7zu %6.1f %6.1f %6.1f %6.1f %7.1f  [%s]\n", pid,
+           tidbuf, name, s->n, sum.avg, sum.p50, sum.p99, sum.max,
+           s->busy_max_ms, hist);
+}
+
+/* Traffic of every interface since the previous report, one line each
+ * after the processes. */
+static void report_nets(const struct watch_options *opt, double when) {
+    size_t n;
+    if (net_collect() < 0)
+        return;
+    const struct net_info *nets = net_get(&n);
+    if (!opt->jsonl)
+        printf("%-16s %12s %12s %9s %9s %7s %7s\n", "IFACE", "RXBYTES/s",
+               "TXBYTES/s", "RXPKT/s", "TXPKT/s", "DROP/s", "ERR/s");
+    for (size_t i = 0; i < n; i++) {
+        const struct net_info *d = &nets[i];
+        if (opt->jsonl) {
+            printf("{\"time\":%.3f,\"iface\":", when);
+            json_string(stdout, d->name);
+            printf(",\"rx_bytes\":%.0f,\"tx_bytes\":%.0f,\"rx_packets\":%.1f,"
+                   "\"tx_packets\":%.1f,\"rx_drops\":%.1f,\"tx_drops\":%.1f,"
+                   "\"rx_errors\":%.1f,\"tx_errors\":%.1f}\n",
+                   d->rx_rate, d->tx_rate, d->rx_packets, d->tx_packets,
+                   d->rx_drops, d->tx_drops, d->rx_errors, d->tx_errors);
+        } else {
+            printf("%-16s %12.0f %12.0f %9.1f %9.1f %7.1f %7.1f\n", d->name,
+                   d->rx_rate, d->tx_rate, d->rx_packets, d->tx_packets,
+                   d->rx_drops + d->tx_drops, d->rx_errors + d->tx_errors);
+        }
+    }
+}
+
+static void report(const struct watch_options *opt, struct wproc *procs,
+                   size_t n, float *scratch) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double when = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    if (!opt->jsonl) {
+        char tbuf[16];
+        struct tm tm;
+        localtime_r(&ts.tv_sec, &tm);
+        strftime(tbuf, sizeof(tbuf), "%H:%M:%S", &tm);
+        printf("%s.%03ld  every %ums, histogram 0|10|25|50|75|90|100|more %%\n",
+               tbuf, ts.tv_nsec / 1000000, opt->sample_ms);
+        printf("%-8s %-8s %-16s %7s %6s %6s %6s %6s %7s  %s\n", "PID", "TID",
+               "NAME", "SAMPLES", "AVG%", "P50%", "P99%", "MAX%", "BUSYMS",
+               "HISTOGRAM");
+    }
+    for (size_t i = 0; i < n; i++) {
+        struct wproc *p = &procs[i];
+        if (p->s.n == 0 && !p->alive)
+            continue;
+        print_series(opt, when, p->pid, 0, p->name, &p->s, scratch);
+        series_reset(&p->s);
+        for (size_t j = 0; j < p->count; j++) {
+            struct wthread *t = &p->threads[j];
+            if (opt->threads && t->s.n > 0)
+                print_series(opt, when, p->pid, t->tid, t->name, &t->s, scratch);
+            series_reset(&t->s);
+        }
+    }
+    if (opt->net)
+        report_nets(opt, when);
+    if (!opt->jsonl)
+        printf("\n");
+    fflush(stdout);
+}
+
+int run_watch(const struct watch_options *opt) {
+    long tck = sysconf(_SC_CLK_TCK);
+    if (tck > 0)
+        clk_tck = tck;
+    struct wproc *procs = calloc(opt->pid_count, sizeof(*procs));
+    if (!procs)
+        return 1;
+    size_t alive = 0;
+    for (size_t i = 0; i < opt->pid_count; i++) {
+        struct wproc *p = &procs[i];
+        char path[512];
+        p->pid = opt->pids[i];
+        p->alive = 1;
+        snprintf(path, sizeof(path), "%s/%d/comm", get_proc_root(), p->pid);
+        read_comm(path, p->name, sizeof(p->name));
+        rescan_threads(p);
+        if (p->alive && p->count > 0)
+            alive++;
+        else
+            fprintf(stderr, "vtop: no such process %d\n", p->pid);
+    }
+    if (alive == 0) {
+        free(procs);
+        return 1;
+    }
+
+    /* the first report needs counters to compare with */
+    if (opt->net)
+        net_collect();
+
+    watch_stop = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    /* room for the samples of one report interval */
+    size_t scratch_n = opt->report_ms / opt->sample_ms + 64;
+    float *scratch = malloc(scratch_n * sizeof(*scratch));
+    unsigned long long step = (unsigned long long)opt->sample_ms * 1000000ull;
+    unsigned long long start = now_ns();
+    unsigned long long next = start;
+    unsigned long long next_report = start + (unsigned long long)opt->report_ms * 1000000ull;
+    unsigned long long prev = 0;
+    unsigned int reports = 0;
+    while (!watch_stop && scratch) {
+        unsigned long long now = now_ns();
+        sample(procs, opt->pid_count, prev ? (double)(now - prev) : 0.0,
+               opt->threads);
+        prev = now;
+        if (now >= next_report) {
+            size_t need = 64;
+            for (size_t i = 0; i < opt->pid_count; i++)
+                if (procs[i].s.n > need)
+                    need = procs[i].s.n;
+            if (need > scratch_n) {
+                float *s = realloc(scratch, need * sizeof(*s));
+                if (!s)
+                    break;
+                scratch = s;
+                scratch_n = need;
+            }
+            report(opt, procs, opt->pid_count, scratch);
+            reports++;
+            size_t left = 0;
+            for (size_t i = 0; i < opt->pid_count; i++) {
+                if (procs[i].alive)
+                    rescan_threads(&procs[i]);
+                if (procs[i].alive && procs[i].count > 0)
+                    left++;
+            }
+            if (left == 0 || (opt->iterations && reports >= opt->iterations))
+                break;
+            next_report += (unsigned long long)opt->report_ms * 1000000ull;
+            /* the rescan is not part of any sample interval */
+            prev = 0;
+            next = now_ns();
+            continue;
+        }
+        next += step;
+        now = now_ns();
+        if (next <= now) {
+            /* fell behind, do not try to catch up with a burst */
+            next = now + step;
+        }
+        struct timespec ts = { (time_t)(next / 1000000000ull),
+                               (long)(next % 1000000000ull) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR &&
+               !watch_stop)
+            ;
+    }
+
+    for (size_t i = 0; i < opt->pid_count; i++) {
+        while (procs[i].count > 0)
+            drop_thread(&procs[i], 0);
+        free(procs[i].threads);
+        free(procs[i].s.vals);
+    }
+    free(procs);
+    free(scratch);
+    return 0;
+}